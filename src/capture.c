@@ -21,6 +21,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <sys/time.h>
 #include <sys/types.h>
@@ -28,35 +29,201 @@
 #include <sys/socket.h>
 
 #include <linux/if_packet.h>
+#include <linux/sockios.h>
 
 #include "pangolin.h"
 
-int capture(struct packet *packet, int fd, int loindex)
+void capture_guard(struct packet *packet)
+{
+    size_t guard;
+
+    /* clear only what decoders may read past the captured bytes */
+    guard = PKT_DATA_LEN - packet->caplen;
+
+    if (guard > PKT_GUARD_LEN)
+	guard = PKT_GUARD_LEN;
+
+    memset(packet->base + packet->caplen, 0, guard);
+}
+
+/* status and stripped tag, from the auxdata or the ring header */
+static void capture_aux(struct packet *packet, U32 status, U16 tci, U16 tpid)
+{
+    packet->status = status;
+
+    if (!(status & TP_STATUS_VLAN_VALID)) {
+	packet->vlan_tpid = 0;
+	packet->vlan_tci = 0;
+	return;
+    }
+
+    packet->vlan_tpid = status & TP_STATUS_VLAN_TPID_VALID ? tpid : 0x8100;
+    packet->vlan_tci = tci;
+}
+
+int capture(struct packet *packet, int fd, int loindex, size_t snaplen,
+	    int spin)
 {
     struct sockaddr_ll from;
-    socklen_t fromlen = sizeof(struct sockaddr_ll);
-    memset(packet, 0, sizeof(struct packet));
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    union {
+	struct cmsghdr align;
+	U8 buf[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+    } control;
+    ssize_t n;
+    size_t len = 0;
 
-    if (recvfrom(fd, packet->base, PKT_DATA_LEN, MSG_TRUNC,
-		 (struct sockaddr *)&from, &fromlen) < 0) {
-	fprintf(stderr, "error: recvfrom(): %s", strerror(errno));
+    if (snaplen > PKT_DATA_LEN)
+	snaplen = PKT_DATA_LEN;
+
+    iov.iov_base = packet->base;
+    iov.iov_len = snaplen;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    /* spinning trades a core for the wake up latency */
+    do {
+	n = recvmsg(fd, &msg, MSG_TRUNC | (spin ? MSG_DONTWAIT : 0));
+    } while (n < 0 && spin && (errno == EAGAIN || errno == EWOULDBLOCK));
+
+    if (n < 0) {
+	fprintf(stderr, "error: recvmsg(): %s\n", strerror(errno));
 	return -1;
     }
 
-    packet->data = packet->base;
+    packet->status = 0;
+    packet->vlan_tpid = 0;
+    packet->vlan_tci = 0;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	struct tpacket_auxdata aux;
+
+	if (cmsg->cmsg_level != SOL_PACKET || cmsg->cmsg_type != PACKET_AUXDATA)
+	    continue;
+
+	memcpy(&aux, CMSG_DATA(cmsg), sizeof(aux));
+	capture_aux(packet, aux.tp_status, aux.tp_vlan_tci, aux.tp_vlan_tpid);
+	len = aux.tp_len;
+    }
+
+    /*
+     * with MSG_TRUNC recvmsg() returns the length of the skb, which a
+     * filter returning less than the packet (-S) has already trimmed:
+     * the length on the wire comes with the auxiliary data
+     */
+    packet->len = len ? len : (size_t)n;
+    packet->caplen = (size_t)n < snaplen ? (size_t)n : snaplen;
     packet->type = 0;
+    packet->ifindex = from.sll_ifindex;
+    capture_guard(packet);
 
     if (from.sll_pkttype == PACKET_OUTGOING) {
-	if (from.sll_ifindex == loindex)
+	if (from.sll_ifindex == loindex) {
+	    errno = 0;
 	    return 0;
-	else
+	} else
 	    packet->type = 0;
     }
 
-    if (ioctl(fd, SIOCGSTAMP, &packet->time) < 0) {
-	fprintf(stderr, "error: ioctl(SIOCGSTAMP): %s", strerror(errno));
+    if (ioctl(fd, SIOCGSTAMPNS, &packet->time) < 0) {
+	fprintf(stderr, "error: ioctl(SIOCGSTAMPNS): %s\n", strerror(errno));
+	return -1;
+    }
+
+    return 1;
+}
+
+/* same as capture(), from a ring published by another pangolin */
+int capture_fanout(struct packet *packet, struct fanout *f, size_t snaplen)
+{
+    const struct fanout_slot *s;
+
+    if (fanout_next(f, &s, 1) < 0) {
+	fprintf(stderr, "error: fanout_next(): %s\n", strerror(errno));
 	return -1;
     }
 
+    if (snaplen > PKT_DATA_LEN)
+	snaplen = PKT_DATA_LEN;
+
+    packet->time.tv_sec = s->desc.time / 1000000000;
+    packet->time.tv_nsec = s->desc.time % 1000000000;
+    packet->len = s->desc.len;
+    packet->caplen = s->desc.caplen < snaplen ? s->desc.caplen : snaplen;
+    packet->type = 0;
+    packet->status = s->desc.status;
+    packet->vlan_tpid = s->desc.vlan_tpid;
+    packet->vlan_tci = s->desc.vlan_tci;
+    packet->ifindex = s->desc.ifindex;
+    packet->netns = 0;
+    memcpy(packet->base, s->data, packet->caplen);
+    capture_guard(packet);
+
+    /* overwritten while we copied it */
+    if (!fanout_done(f)) {
+	errno = 0;
+	return 0;
+    }
+
     return 1;
 }
+
+/* same as capture(), but reads the next frame of the mapped ring */
+int capture_ring(struct packet *packet, int fd, struct ring *ring,
+		 int loindex, int spin)
+{
+    struct tpacket2_hdr *hdr;
+    struct sockaddr_ll *from;
+    int sts = 1;
+
+    hdr = (struct tpacket2_hdr *)(ring->map + ring->cur * ring->framesize);
+
+    while (!(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) &
+	     TP_STATUS_USER)) {
+	struct pollfd pfd;
+
+	if (spin)
+	    continue;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN | POLLERR;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+	    fprintf(stderr, "error: poll(): %s\n", strerror(errno));
+	    return -1;
+	}
+    }
+
+    from = (struct sockaddr_ll *)((U8 *) hdr +
+				  TPACKET_ALIGN(sizeof(struct tpacket2_hdr)));
+
+    if (from->sll_pkttype == PACKET_OUTGOING && from->sll_ifindex == loindex) {
+	sts = 0;
+	goto release;
+    }
+
+    packet->len = hdr->tp_len;
+    packet->caplen = hdr->tp_snaplen < PKT_DATA_LEN ?
+	hdr->tp_snaplen : PKT_DATA_LEN;
+    packet->time.tv_sec = hdr->tp_sec;
+    packet->time.tv_nsec = hdr->tp_nsec;
+    packet->type = 0;
+    packet->ifindex = from->sll_ifindex;
+    capture_aux(packet, hdr->tp_status, hdr->tp_vlan_tci, hdr->tp_vlan_tpid);
+    memcpy(packet->base, (U8 *) hdr + hdr->tp_mac, packet->caplen);
+    capture_guard(packet);
+
+ release:
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    ring->cur = (ring->cur + 1) % ring->nframes;
+    errno = 0;
+    return sts;
+}
@@ -0,0 +1,254 @@
+/*
+ * checksum.c -- IPv4, TCP and UDP checksum verification
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <linux/if_packet.h>
+
+#include "pangolin.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+# include <immintrin.h>
+# define HAVE_AVX2_TARGET 1
+#endif
+
+/*
+ * The one's complement sum does not depend on the byte order (RFC 1071),
+ * so words are added as loaded and a correct checksum folds to 0xFFFF
+ * either way. Vector code widens 16 bits words into 32 bits lanes: at
+ * most 64 KB per call cannot overflow them.
+ */
+
+static U64 sum_scalar(const U8 *p, U32 len, U32 *done)
+{
+    U64 sum = 0;
+    U32 i;
+
+    for (i = 0; i + 2 <= len; i += 2) {
+	U16 w;
+
+	memcpy(&w, p + i, 2);
+	sum += w;
+    }
+
+    *done = i;
+    return sum;
+}
+
+#if defined(__SSE2__)
+static U64 sum_sse2(const U8 *p, U32 len, U32 *done)
+{
+    __m128i acc = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    U32 lanes[4], i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+
+	acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+	acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+    }
+
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    *done = i;
+    return (U64) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+#if defined(HAVE_AVX2_TARGET)
+__attribute__ ((target("avx2")))
+static U64 sum_avx2(const U8 *p, U32 len, U32 *done)
+{
+    __m256i acc = _mm256_setzero_si256();
+    __m256i zero = _mm256_setzero_si256();
+    U32 lanes[8], i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+	__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+
+	acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+	acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+    }
+
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    *done = i;
+    return (U64) lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+	lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+#endif
+
+static U64 sum_init(const U8 *, U32, U32 *);
+
+/* the widest implementation the CPU runs, chosen on the first call */
+static U64(*sum_block) (const U8 *, U32, U32 *) = sum_init;
+
+static U64 sum_init(const U8 *p, U32 len, U32 *done)
+{
+    sum_block = sum_scalar;
+
+#if defined(__SSE2__)
+    sum_block = sum_sse2;
+#endif
+
+#if defined(HAVE_AVX2_TARGET)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+	sum_block = sum_avx2;
+#endif
+
+    return sum_block(p, len, done);
+}
+
+/* folded, not complemented, sum of len bytes plus seed */
+U16 csum_partial(const U8 *p, U32 len, U32 seed)
+{
+    U64 sum = seed;
+    U32 done = 0, n;
+
+    sum += sum_block(p, len, &done);
+
+    /* what the vector loop left, then the odd byte padded with zero */
+    sum += sum_scalar(p + done, len - done, &n);
+    done += n;
+
+    if (done < len) {
+	U16 w = 0;
+
+	memcpy(&w, p + done, 1);
+	sum += w;
+    }
+
+    while (sum >> 16)
+	sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return sum;
+}
+
+/* sum of the pseudo header for an upper layer of len bytes */
+static U16 pseudo_sum(const struct packet *packet, U32 len)
+{
+    const struct layers *l = &packet->layers;
+    const U8 *h = packet->base + l->l3;
+    U8 pseudo[40];
+
+    if (l->l3_proto == PROTO_IP) {
+	memcpy(pseudo, h + 12, 8);
+	pseudo[8] = 0;
+	pseudo[9] = l->ip_proto;
+	pseudo[10] = len >> 8;
+	pseudo[11] = len & 0xFF;
+	return csum_partial(pseudo, 12, 0);
+    }
+
+    memcpy(pseudo, h + 8, 32);
+    pseudo[32] = len >> 24;
+    pseudo[33] = (len >> 16) & 0xFF;
+    pseudo[34] = (len >> 8) & 0xFF;
+    pseudo[35] = len & 0xFF;
+    pseudo[36] = pseudo[37] = pseudo[38] = 0;
+    pseudo[39] = l->ip_proto;
+    return csum_partial(pseudo, 40, 0);
+}
+
+/*
+ * Verifies the IP header and the transport checksums of the innermost
+ * packet, returns the CSUM_BAD_* flags of the failed ones.
+ */
+int checksum_verify(struct checksum *cs, const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+    const U8 *h = packet->base + l->l3;
+    U32 end, len;
+    int bad = 0;
+
+    if (l->l3_proto == PROTO_IP) {
+	U16 hlen = (h[0] & 0xF) * 4;
+
+	if (csum_partial(h, hlen, 0) != 0xFFFF) {
+	    cs->bad_ip++;
+	    bad |= CSUM_BAD_IP;
+	}
+
+	/* fragments are verified by the reassembly, not here */
+	if (GET16(h + 6) & 0x3FFF) {
+	    cs->truncated++;
+	    return bad;
+	}
+
+	end = l->l3 + GET16(h + 2);
+    } else if (l->l3_proto == PROTO_IP6) {
+	end = l->l3 + 40 + GET16(h + 4);
+    } else
+	return 0;
+
+    if (l->l4_proto != PROTO_TCP && l->l4_proto != PROTO_UDP)
+	return bad;
+
+    /* not computed yet on output, or already validated by the NIC */
+    if (packet->status & (TP_STATUS_CSUMNOTREADY | TP_STATUS_CSUM_VALID)) {
+	cs->offloaded++;
+	return bad;
+    }
+
+    if (end > packet->caplen || end <= l->l4) {
+	cs->truncated++;
+	return bad;
+    }
+
+    len = end - l->l4;
+
+    /* a zero UDP checksum over IPv4 was not computed */
+    if (l->l4_proto == PROTO_UDP && l->l3_proto == PROTO_IP
+	&& GET16(packet->base + l->l4 + 6) == 0)
+	return bad;
+
+    cs->verified++;
+
+    if (csum_partial(packet->base + l->l4, len, pseudo_sum(packet, len))
+	!= 0xFFFF) {
+	if (l->l4_proto == PROTO_TCP) {
+	    cs->bad_tcp++;
+	    bad |= CSUM_BAD_TCP;
+	} else {
+	    cs->bad_udp++;
+	    bad |= CSUM_BAD_UDP;
+	}
+    }
+
+    return bad;
+}
+
+void checksum_report(const struct checksum *cs)
+{
+    fprintf(stdout, "\nChecksums\n---------\n");
+    fprintf(stdout, "\n%llu verified, %llu offloaded, %llu not captured in full",
+	    (unsigned long long)cs->verified,
+	    (unsigned long long)cs->offloaded,
+	    (unsigned long long)cs->truncated);
+    fprintf(stdout, "\nbad: ip %llu, tcp %llu, udp %llu\n",
+	    (unsigned long long)cs->bad_ip,
+	    (unsigned long long)cs->bad_tcp,
+	    (unsigned long long)cs->bad_udp);
+}
@@ -0,0 +1,109 @@
+/*
+ * counter.c -- per name counters in a fixed size table
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pangolin.h"
+
+/*
+ * Open addressing with linear probing, keyed by a 32 bits hash of the
+ * name: no allocation on the packet path, and a quarter of the table is
+ * kept free so that probes stay short. Names only serve the report.
+ */
+
+/* FNV-1a, seed with COUNTER_SEED */
+U32 counter_hash(const U8 *p, U32 len, U32 h)
+{
+    while (len--)
+	h = (h ^ *p++) * 16777619;
+
+    return h;
+}
+
+/* wire bytes made safe for a terminal */
+void printable(char *buf, const U8 *p, U32 len)
+{
+    U32 i;
+
+    for (i = 0; i < len; i++)
+	buf[i] = p[i] >= 0x20 && p[i] < 0x7F ? p[i] : '.';
+
+    buf[i] = '\0';
+}
+
+/* the counter of hash, a new one has count 0, NULL if the table is full */
+struct counter *counter_get(struct counters *t, U32 hash)
+{
+    U32 i, n;
+
+    for (i = hash % COUNTERS, n = 0; n < COUNTERS; i = (i + 1) % COUNTERS, n++) {
+	struct counter *c = &t->slot[i];
+
+	if (c->count == 0) {
+	    if (t->used >= COUNTERS / 4 * 3)
+		break;
+
+	    c->hash = hash;
+	    c->name[0] = '\0';
+	    t->used++;
+	    return c;
+	}
+
+	if (c->hash == hash)
+	    return c;
+    }
+
+    t->other++;
+    return NULL;
+}
+
+/* the COUNTER_TOP highest counters */
+void counter_report(const struct counters *t, const char *what)
+{
+    const struct counter *top[COUNTER_TOP];
+    U32 i, j, n = 0;
+
+    for (i = 0; i < COUNTERS; i++) {
+	const struct counter *c = &t->slot[i];
+
+	if (c->count == 0)
+	    continue;
+
+	if (n < COUNTER_TOP)
+	    j = n++;
+	else if (top[COUNTER_TOP - 1]->count < c->count)
+	    j = COUNTER_TOP - 1;
+	else
+	    continue;
+
+	for (; j > 0 && top[j - 1]->count < c->count; j--)
+	    top[j] = top[j - 1];
+
+	top[j] = c;
+    }
+
+    for (i = 0; i < n; i++)
+	fprintf(stdout, "  %10llu %s\n", (unsigned long long)top[i]->count,
+		top[i]->name);
+
+    if (t->other)
+	fprintf(stdout, "  %10llu (other %s)\n", (unsigned long long)t->other,
+		what);
+}
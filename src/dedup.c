@@ -0,0 +1,113 @@
+/*
+ * dedup.c -- drop the copies of a packet seen on several interfaces
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pangolin.h"
+
+/*
+ * Capturing on every interface, a routed or bridged packet is seen once
+ * per hop inside the host. Its L3 header and payload stay the same but
+ * for the TTL (and so the IPv4 checksum) or the hop limit, while the
+ * MAC addresses and VLAN tags may all change.
+ *
+ * The hash covers the invariant bytes from the network header on, up to
+ * DEDUP_BYTES of them, and indexes a direct mapped table: a packet is a
+ * copy if its slot holds the same hash and length, seen on another
+ * interface less than DEDUP_WINDOW ago. A collision only overwrites the
+ * slot, missing a duplicate at worst.
+ */
+
+#define DEDUP_BYTES 256
+
+#define ETH_HDR_LEN 14
+#define VLAN_TAG_LEN 4
+
+static U32 dedup_hash(const struct packet *packet, U32 *len)
+{
+    const U8 *p = packet->base;
+    U32 off = ETH_HDR_LEN, end, h = COUNTER_SEED;
+    U16 type;
+
+    if (packet->caplen < ETH_HDR_LEN) {
+	*len = packet->len;
+	return counter_hash(p, packet->caplen, h);
+    }
+
+    /* tags may be added or stripped on the way, skip them */
+    for (type = GET16(p + 12); (type == 0x8100 || type == 0x88A8)
+	 && off + VLAN_TAG_LEN <= packet->caplen; off += VLAN_TAG_LEN)
+	type = GET16(p + off + 2);
+
+    end = packet->caplen - off > DEDUP_BYTES ? off + DEDUP_BYTES :
+	packet->caplen;
+    *len = packet->len - off;
+
+    if (type == 0x0800 && end >= off + 20) {
+	/* all but the TTL and the checksum */
+	h = counter_hash(p + off, 8, h);
+	h = counter_hash(p + off + 9, 1, h);
+	return counter_hash(p + off + 12, end - off - 12, h);
+    }
+
+    if (type == 0x86DD && end >= off + 40) {
+	/* all but the hop limit */
+	h = counter_hash(p + off, 7, h);
+	return counter_hash(p + off + 8, end - off - 8, h);
+    }
+
+    return counter_hash(p + off, end - off, h);
+}
+
+/* 1 if packet is a copy of one just seen on another interface */
+int dedup_check(struct dedup *d, const struct packet *packet)
+{
+    struct dedup_slot *s;
+    U64 now, age;
+    U32 h, len;
+    int dup;
+
+    h = dedup_hash(packet, &len);
+    now = (U64) packet->time.tv_sec * 1000000000 + packet->time.tv_nsec;
+    s = &d->slot[h % DEDUP_SLOTS];
+
+    /* timestamps of different CPUs are not strictly ordered */
+    age = now > s->time ? now - s->time : s->time - now;
+    dup = s->time && s->hash == h && s->len == len
+	&& (s->ifindex != packet->ifindex || s->netns != packet->netns)
+	&& age <= DEDUP_WINDOW;
+
+    s->hash = h;
+    s->len = len;
+    s->ifindex = packet->ifindex;
+    s->netns = packet->netns;
+    s->time = now;
+
+    d->packets++;
+    d->duplicates += dup;
+    return dup;
+}
+
+void dedup_report(const struct dedup *d)
+{
+    fprintf(stdout, "%llu duplicate%s of %llu packet%s suppressed.\n",
+	    (unsigned long long)d->duplicates, d->duplicates != 1 ? "s" : "",
+	    (unsigned long long)d->packets, d->packets != 1 ? "s" : "");
+}
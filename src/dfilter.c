@@ -0,0 +1,860 @@
+/*
+ * dfilter.c -- display filters over the dissected fields
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <arpa/inet.h>
+
+#include "pangolin.h"
+
+/*
+ * Grammar:
+ *
+ *   expr    := and { ("or" | "||") and }
+ *   and     := not { ("and" | "&&") not }
+ *   not     := ("not" | "!") not | "(" expr ")" | test
+ *   test    := "true" | "false" | field [ relop value | "in" set ]
+ *   relop   := "==" | "!=" | "<" | "<=" | ">" | ">=" | "eq" | "ne" ...
+ *   set     := net | "{" value { value } "}"
+ *
+ * A field alone tests that it is present, a flag that it is set. Values
+ * are numbers, dotted quads, networks (10/8, 192.168.0.0/16), IPv6
+ * addresses and prefixes (2001:db8::/32) or per field names such as
+ * "reply" for bootp.op.
+ *
+ * The parse tree is compiled backwards into jumping code, so that each
+ * test is one instruction that jumps on true and on false: "and" and
+ * "or" short-circuit for free and constant subtrees vanish.
+ */
+
+/* layers a field is read from */
+#define DF_L2 0
+#define DF_L3 1
+#define DF_L4 2
+#define DF_L7 3
+#define DF_VLAN 4		/* tags in the descriptor, see dissect() */
+#define DF_TUN 5		/* innermost tunnel header */
+
+struct dname {
+    const char *name;
+    U32 value;
+};
+
+static const struct dname arp_ops[] = {
+    {"request", 1}, {"reply", 2}, {"rarp-request", 3}, {"rarp-reply", 4},
+    {NULL, 0}
+};
+
+static const struct dname bootp_ops[] = {
+    {"request", 1}, {"query", 1}, {"reply", 2}, {NULL, 0}
+};
+
+static const struct dname ip_protos[] = {
+    {"icmp", 1}, {"tcp", 6}, {"udp", 17}, {"icmpv6", 58}, {NULL, 0}
+};
+
+static const struct dname icmp6_types[] = {
+    {"echo-request", 128}, {"echo-reply", 129},
+    {"router-solicitation", 133}, {"router-advertisement", 134},
+    {"neighbor-solicitation", 135}, {"neighbor-advertisement", 136},
+    {"redirect", 137}, {NULL, 0}
+};
+
+struct dfield {
+    const char *name;
+    U8 layer;
+    U8 proto;
+    U8 size;			/* 0 only tests the protocol, 16 an IPv6 address */
+    U8 shift;			/* value is (load & mask) >> shift */
+    U16 off;
+    U16 alt;			/* second offset for "either" fields */
+    U32 mask;
+    const struct dname *names;
+};
+
+/* *INDENT-OFF* */
+static const struct dfield dfields[] = {
+	{ "eth",		DF_L2, PROTO_ETH,   0, 0,  0,  0, 0, NULL },
+	{ "eth.type",		DF_L2, PROTO_ETH,   2, 0, 12,  0, 0xFFFF, NULL },
+	{ "vlan",		DF_VLAN, PROTO_NONE, 0, 0, 0,  0, 0, NULL },
+	{ "vlan.tpid",		DF_VLAN, PROTO_NONE, 2, 0, 0,  0, 0xFFFF, NULL },
+	{ "vlan.id",		DF_VLAN, PROTO_NONE, 2, 0, 2,  0, 0x0FFF, NULL },
+	{ "vlan.pcp",		DF_VLAN, PROTO_NONE, 2, 13, 2, 0, 0xE000, NULL },
+	{ "vlan.dei",		DF_VLAN, PROTO_NONE, 2, 12, 2, 0, 0x1000, NULL },
+	{ "vlan.inner.id",	DF_VLAN, PROTO_NONE, 2, 0, 6,  0, 0x0FFF, NULL },
+	{ "arp",		DF_L3, PROTO_ARP,   0, 0,  0,  0, 0, NULL },
+	{ "arp.hrd",		DF_L3, PROTO_ARP,   2, 0,  0,  0, 0xFFFF, NULL },
+	{ "arp.pro",		DF_L3, PROTO_ARP,   2, 0,  2,  0, 0xFFFF, NULL },
+	{ "arp.op",		DF_L3, PROTO_ARP,   2, 0,  6,  0, 0xFFFF, arp_ops },
+	{ "arp.spa",		DF_L3, PROTO_ARP,   4, 0, 14,  0, 0xFFFFFFFF, NULL },
+	{ "arp.tpa",		DF_L3, PROTO_ARP,   4, 0, 24,  0, 0xFFFFFFFF, NULL },
+	{ "ip",			DF_L3, PROTO_IP,    0, 0,  0,  0, 0, NULL },
+	{ "ip.version",		DF_L3, PROTO_IP,    1, 4,  0,  0, 0xF0, NULL },
+	{ "ip.hl",		DF_L3, PROTO_IP,    1, 0,  0,  0, 0x0F, NULL },
+	{ "ip.tos",		DF_L3, PROTO_IP,    1, 0,  1,  0, 0xFF, NULL },
+	{ "ip.len",		DF_L3, PROTO_IP,    2, 0,  2,  0, 0xFFFF, NULL },
+	{ "ip.id",		DF_L3, PROTO_IP,    2, 0,  4,  0, 0xFFFF, NULL },
+	{ "ip.flags.df",	DF_L3, PROTO_IP,    2, 14, 6,  0, 0x4000, NULL },
+	{ "ip.flags.mf",	DF_L3, PROTO_IP,    2, 13, 6,  0, 0x2000, NULL },
+	{ "ip.frag_offset",	DF_L3, PROTO_IP,    2, 0,  6,  0, 0x1FFF, NULL },
+	{ "ip.ttl",		DF_L3, PROTO_IP,    1, 0,  8,  0, 0xFF, NULL },
+	{ "ip.proto",		DF_L3, PROTO_IP,    1, 0,  9,  0, 0xFF, ip_protos },
+	{ "ip.checksum",	DF_L3, PROTO_IP,    2, 0, 10,  0, 0xFFFF, NULL },
+	{ "ip.src",		DF_L3, PROTO_IP,    4, 0, 12,  0, 0xFFFFFFFF, NULL },
+	{ "ip.dst",		DF_L3, PROTO_IP,    4, 0, 16,  0, 0xFFFFFFFF, NULL },
+	{ "ip.addr",		DF_L3, PROTO_IP,    4, 0, 12, 16, 0xFFFFFFFF, NULL },
+	{ "ipv6",		DF_L3, PROTO_IP6,   0, 0,  0,  0, 0, NULL },
+	{ "ipv6.version",	DF_L3, PROTO_IP6,   1, 4,  0,  0, 0xF0, NULL },
+	{ "ipv6.tclass",	DF_L3, PROTO_IP6,   2, 4,  0,  0, 0x0FF0, NULL },
+	{ "ipv6.flow",		DF_L3, PROTO_IP6,   4, 0,  0,  0, 0x000FFFFF, NULL },
+	{ "ipv6.plen",		DF_L3, PROTO_IP6,   2, 0,  4,  0, 0xFFFF, NULL },
+	{ "ipv6.nxt",		DF_L3, PROTO_IP6,   1, 0,  6,  0, 0xFF, ip_protos },
+	{ "ipv6.hlim",		DF_L3, PROTO_IP6,   1, 0,  7,  0, 0xFF, NULL },
+	{ "ipv6.src",		DF_L3, PROTO_IP6,  16, 0,  8,  0, 0xFFFFFFFF, NULL },
+	{ "ipv6.dst",		DF_L3, PROTO_IP6,  16, 0, 24,  0, 0xFFFFFFFF, NULL },
+	{ "ipv6.addr",		DF_L3, PROTO_IP6,  16, 0,  8, 24, 0xFFFFFFFF, NULL },
+	{ "icmp",		DF_L4, PROTO_ICMP,  0, 0,  0,  0, 0, NULL },
+	{ "icmp.type",		DF_L4, PROTO_ICMP,  1, 0,  0,  0, 0xFF, NULL },
+	{ "icmp.code",		DF_L4, PROTO_ICMP,  1, 0,  1,  0, 0xFF, NULL },
+	{ "icmp.id",		DF_L4, PROTO_ICMP,  2, 0,  4,  0, 0xFFFF, NULL },
+	{ "icmp.seq",		DF_L4, PROTO_ICMP,  2, 0,  6,  0, 0xFFFF, NULL },
+	{ "icmpv6",		DF_L4, PROTO_ICMP6, 0, 0,  0,  0, 0, NULL },
+	{ "icmpv6.type",	DF_L4, PROTO_ICMP6, 1, 0,  0,  0, 0xFF, icmp6_types },
+	{ "icmpv6.code",	DF_L4, PROTO_ICMP6, 1, 0,  1,  0, 0xFF, NULL },
+	{ "tcp",		DF_L4, PROTO_TCP,   0, 0,  0,  0, 0, NULL },
+	{ "tcp.srcport",	DF_L4, PROTO_TCP,   2, 0,  0,  0, 0xFFFF, NULL },
+	{ "tcp.dstport",	DF_L4, PROTO_TCP,   2, 0,  2,  0, 0xFFFF, NULL },
+	{ "tcp.port",		DF_L4, PROTO_TCP,   2, 0,  0,  2, 0xFFFF, NULL },
+	{ "tcp.seq",		DF_L4, PROTO_TCP,   4, 0,  4,  0, 0xFFFFFFFF, NULL },
+	{ "tcp.ack",		DF_L4, PROTO_TCP,   4, 0,  8,  0, 0xFFFFFFFF, NULL },
+	/* in bytes, the header counts 32 bit words */
+	{ "tcp.hdr_len",	DF_L4, PROTO_TCP,   1, 2, 12,  0, 0xF0, NULL },
+	{ "tcp.flags",		DF_L4, PROTO_TCP,   1, 0, 13,  0, 0x3F, NULL },
+	{ "tcp.flags.fin",	DF_L4, PROTO_TCP,   1, 0, 13,  0, 0x01, NULL },
+	{ "tcp.flags.syn",	DF_L4, PROTO_TCP,   1, 1, 13,  0, 0x02, NULL },
+	{ "tcp.flags.rst",	DF_L4, PROTO_TCP,   1, 2, 13,  0, 0x04, NULL },
+	{ "tcp.flags.push",	DF_L4, PROTO_TCP,   1, 3, 13,  0, 0x08, NULL },
+	{ "tcp.flags.ack",	DF_L4, PROTO_TCP,   1, 4, 13,  0, 0x10, NULL },
+	{ "tcp.flags.urg",	DF_L4, PROTO_TCP,   1, 5, 13,  0, 0x20, NULL },
+	{ "tcp.window",		DF_L4, PROTO_TCP,   2, 0, 14,  0, 0xFFFF, NULL },
+	{ "tcp.checksum",	DF_L4, PROTO_TCP,   2, 0, 16,  0, 0xFFFF, NULL },
+	{ "tcp.urgent",		DF_L4, PROTO_TCP,   2, 0, 18,  0, 0xFFFF, NULL },
+	{ "udp",		DF_L4, PROTO_UDP,   0, 0,  0,  0, 0, NULL },
+	{ "udp.srcport",	DF_L4, PROTO_UDP,   2, 0,  0,  0, 0xFFFF, NULL },
+	{ "udp.dstport",	DF_L4, PROTO_UDP,   2, 0,  2,  0, 0xFFFF, NULL },
+	{ "udp.port",		DF_L4, PROTO_UDP,   2, 0,  0,  2, 0xFFFF, NULL },
+	{ "udp.length",		DF_L4, PROTO_UDP,   2, 0,  4,  0, 0xFFFF, NULL },
+	{ "udp.checksum",	DF_L4, PROTO_UDP,   2, 0,  6,  0, 0xFFFF, NULL },
+	{ "http",		DF_L7, PROTO_HTTP,  0, 0,  0,  0, 0, NULL },
+	{ "tls",		DF_L7, PROTO_TLS,   0, 0,  0,  0, 0, NULL },
+	{ "gre",		DF_TUN, PROTO_GRE,  0, 0,  0,  0, 0, NULL },
+	{ "gre.proto",		DF_TUN, PROTO_GRE,  2, 0,  2,  0, 0xFFFF, NULL },
+	{ "vxlan",		DF_TUN, PROTO_VXLAN, 0, 0, 0,  0, 0, NULL },
+	{ "vxlan.vni",		DF_TUN, PROTO_VXLAN, 4, 8, 4,  0, 0xFFFFFF00, NULL },
+	{ "geneve",		DF_TUN, PROTO_GENEVE, 0, 0, 0, 0, 0, NULL },
+	{ "geneve.vni",		DF_TUN, PROTO_GENEVE, 4, 8, 4, 0, 0xFFFFFF00, NULL },
+	{ "ipip",		DF_TUN, PROTO_IPIP, 0, 0,  0,  0, 0, NULL },
+	{ "bootp",		DF_L7, PROTO_BOOTP, 0, 0,  0,  0, 0, NULL },
+	{ "bootp.op",		DF_L7, PROTO_BOOTP, 1, 0,  0,  0, 0xFF, bootp_ops },
+	{ "bootp.htype",	DF_L7, PROTO_BOOTP, 1, 0,  1,  0, 0xFF, NULL },
+	{ "bootp.hops",		DF_L7, PROTO_BOOTP, 1, 0,  3,  0, 0xFF, NULL },
+	{ "bootp.xid",		DF_L7, PROTO_BOOTP, 4, 0,  4,  0, 0xFFFFFFFF, NULL },
+	{ "bootp.secs",		DF_L7, PROTO_BOOTP, 2, 0,  8,  0, 0xFFFF, NULL },
+	{ "bootp.ciaddr",	DF_L7, PROTO_BOOTP, 4, 0, 12,  0, 0xFFFFFFFF, NULL },
+	{ "bootp.yiaddr",	DF_L7, PROTO_BOOTP, 4, 0, 16,  0, 0xFFFFFFFF, NULL },
+	{ "bootp.siaddr",	DF_L7, PROTO_BOOTP, 4, 0, 20,  0, 0xFFFFFFFF, NULL },
+	{ "bootp.giaddr",	DF_L7, PROTO_BOOTP, 4, 0, 24,  0, 0xFFFFFFFF, NULL },
+	{ NULL,			0,     0,           0, 0,  0,  0, 0, NULL }
+};
+/* *INDENT-ON* */
+
+/* parse tree */
+enum {
+    N_TRUE,
+    N_FALSE,
+    N_AND,
+    N_OR,
+    N_NOT,
+    N_TEST
+};
+
+#define DF_MAX_NODES 256
+#define DF_MAX_TOKEN 64
+
+struct dnode {
+    U8 kind;
+    U8 op;
+    const struct dfield *field;
+    U32 mask;
+    U32 k;
+    U16 off;			/* word of an IPv6 address, see df_test6() */
+    int left;
+    int right;
+};
+
+struct dparser {
+    const char *p;
+    char tok[DF_MAX_TOKEN];
+    struct dnode nodes[DF_MAX_NODES];
+    int nnodes;
+    struct dfilter *df;
+    int error;
+};
+
+static void df_error(struct dparser *ps, const char *msg)
+{
+    if (!ps->error)
+	fprintf(stderr, "error: filter: %s near '%s'\n", msg, ps->tok);
+
+    ps->error = 1;
+}
+
+/* reads the next token into ps->tok */
+static void df_next(struct dparser *ps)
+{
+    const char *p = ps->p;
+    size_t n = 0;
+
+    while (isspace((unsigned char)*p))
+	p++;
+
+    if (*p == '\0') {
+	ps->tok[0] = '\0';
+    } else if (isalnum((unsigned char)*p) || *p == '_' || *p == ':') {
+	while ((isalnum((unsigned char)p[n]) || (p[n] && strchr("._/-:", p[n])))
+	       && n < DF_MAX_TOKEN - 1)
+	    ps->tok[n] = p[n], n++;
+
+	ps->tok[n] = '\0';
+    } else {
+	static const char *ops[] = { "==", "!=", "<=", ">=", "&&", "||",
+	    "<", ">", "!", "(", ")", "{", "}", NULL
+	};
+	int i;
+
+	for (i = 0; ops[i]; i++)
+	    if (strncmp(p, ops[i], strlen(ops[i])) == 0)
+		break;
+
+	n = ops[i] ? strlen(ops[i]) : 1;
+	memcpy(ps->tok, p, n);
+	ps->tok[n] = '\0';
+    }
+
+    ps->p = p + n;
+}
+
+static int df_is(struct dparser *ps, const char *a, const char *b)
+{
+    return strcmp(ps->tok, a) == 0 || (b && strcmp(ps->tok, b) == 0);
+}
+
+static int df_node(struct dparser *ps, U8 kind, int left, int right)
+{
+    struct dnode *n;
+
+    if (ps->nnodes == DF_MAX_NODES) {
+	df_error(ps, "expression too long");
+	return 0;
+    }
+
+    n = &ps->nodes[ps->nnodes];
+    memset(n, 0, sizeof(*n));
+    n->kind = kind;
+    n->left = left;
+    n->right = right;
+    return ps->nnodes++;
+}
+
+/* folds constants, so that "x and false" never reaches the code */
+static int df_fold(struct dparser *ps, U8 kind, int l, int r)
+{
+    U8 lk = ps->nodes[l].kind;
+    U8 rk = r >= 0 ? ps->nodes[r].kind : N_TEST;
+
+    switch (kind) {
+    case N_NOT:
+	if (lk == N_TRUE || lk == N_FALSE)
+	    return df_node(ps, lk == N_TRUE ? N_FALSE : N_TRUE, -1, -1);
+
+	if (lk == N_NOT)
+	    return ps->nodes[l].left;
+	break;
+
+    case N_AND:
+	if (lk == N_FALSE || rk == N_TRUE)
+	    return l;
+	if (rk == N_FALSE || lk == N_TRUE)
+	    return r;
+	break;
+
+    case N_OR:
+	if (lk == N_TRUE || rk == N_FALSE)
+	    return l;
+	if (rk == N_TRUE || lk == N_FALSE)
+	    return r;
+	break;
+    }
+
+    return df_node(ps, kind, l, r);
+}
+
+/* parses a number, a dotted quad or a network into k and mask */
+static int df_addr(const char *s, U32 * k, U32 * mask)
+{
+    const char *slash = strchr(s, '/');
+    U32 addr = 0;
+    int octets = 0, bits;
+    char *ep;
+
+    if (!strchr(s, '.') && !slash) {
+	*k = strtoul(s, &ep, 0);
+	*mask = 0xFFFFFFFF;
+	return ep != s && *ep == '\0' ? 0 : -1;
+    }
+
+    /* 10/8, 172.16/12, 192.168.1.0/24 or a plain address */
+    while (octets < 4) {
+	unsigned long o = strtoul(s, &ep, 10);
+
+	if (ep == s || o > 255)
+	    return -1;
+
+	addr |= o << (24 - 8 * octets++);
+	s = ep;
+
+	if (*s != '.')
+	    break;
+
+	s++;
+    }
+
+    bits = octets * 8;
+
+    if (*s == '/') {
+	bits = strtol(s + 1, &ep, 10);
+
+	if (ep == s + 1 || *ep != '\0' || bits < 0 || bits > 32)
+	    return -1;
+    } else if (*s != '\0' || octets != 4) {
+	return -1;
+    }
+
+    *mask = bits ? 0xFFFFFFFF << (32 - bits) : 0;
+    *k = addr & *mask;
+    return 0;
+}
+
+/* a test that the field is there, whatever its value */
+static int df_present(struct dparser *ps, const struct dfield *f)
+{
+    int n = df_node(ps, N_TEST, -1, -1);
+
+    ps->nodes[n].field = f;
+    ps->nodes[n].op = DF_PRESENT;
+    ps->nodes[n].mask = f->mask;
+    ps->nodes[n].off = f->off;
+    return n;
+}
+
+/*
+ * An IPv6 address or prefix: one test per 32 bit word the prefix covers,
+ * and for ipv6.addr the same again on the destination. != tests that
+ * the address is there and none of them matches, like ip.addr.
+ */
+static int df_test6(struct dparser *ps, const struct dfield *f, U8 op)
+{
+    char buf[DF_MAX_TOKEN], *slash, *ep;
+    U8 a[16];
+    int bits = 128, side, i, n, m;
+
+    strcpy(buf, ps->tok);
+
+    if ((slash = strchr(buf, '/')) != NULL) {
+	*slash = '\0';
+	bits = strtol(slash + 1, &ep, 10);
+
+	if (ep == slash + 1 || *ep != '\0' || bits < 0 || bits > 128)
+	    bits = -1;
+    }
+
+    if (bits < 0 || inet_pton(AF_INET6, buf, a) != 1) {
+	df_error(ps, "invalid value");
+	return 0;
+    }
+
+    if (op != DF_EQ && op != DF_NE) {
+	df_error(ps, "addresses can only be compared with == and !=");
+	return 0;
+    }
+
+    df_next(ps);
+
+    if (bits == 0)
+	return op == DF_EQ ? df_present(ps, f) : df_node(ps, N_FALSE, -1, -1);
+
+    n = df_node(ps, N_FALSE, -1, -1);
+
+    for (side = 0; side < (f->alt ? 2 : 1); side++) {
+	m = df_node(ps, N_TRUE, -1, -1);
+
+	for (i = 0; i < 4 && bits > 32 * i; i++) {
+	    int w = df_node(ps, N_TEST, -1, -1);
+	    struct dnode *t = &ps->nodes[w];
+
+	    t->field = f;
+	    t->op = DF_EQ;
+	    t->mask = bits >= 32 * (i + 1) ? 0xFFFFFFFF :
+		0xFFFFFFFF << (32 * (i + 1) - bits);
+	    t->k = GET32(a + 4 * i) & t->mask;
+	    t->off = (side ? f->alt : f->off) + 4 * i;
+	    m = df_fold(ps, N_AND, m, w);
+	}
+
+	n = df_fold(ps, N_OR, n, m);
+    }
+
+    if (op == DF_NE)
+	n = df_fold(ps, N_AND, df_present(ps, f), df_fold(ps, N_NOT, n, -1));
+
+    return n;
+}
+
+/* a comparison of field against the value in ps->tok */
+static int df_test(struct dparser *ps, const struct dfield *f, U8 op)
+{
+    const struct dname *nm;
+    int n;
+    U32 k, mask, rem;
+    U32 step = (f->mask & -f->mask) >> f->shift;	/* 4 for tcp.hdr_len */
+
+    if (f->size == 16)
+	return df_test6(ps, f, op);
+
+    for (nm = f->names; nm && nm->name; nm++)
+	if (strcmp(ps->tok, nm->name) == 0)
+	    break;
+
+    if (nm && nm->name) {
+	k = nm->value;
+	mask = 0xFFFFFFFF;
+    } else if (df_addr(ps->tok, &k, &mask)) {
+	df_error(ps, "invalid value");
+	return 0;
+    }
+
+    df_next(ps);
+
+    /*
+     * A value that doesn't fit the field is above any value it holds:
+     * != and < hold whenever the field is there, == and > never do.
+     */
+    if (k > f->mask >> f->shift) {
+	if (op == DF_NE || op == DF_LT || op == DF_LE)
+	    return df_present(ps, f);
+
+	return df_node(ps, N_FALSE, -1, -1);
+    }
+
+    /* between two values the field can hold, round to the one that decides */
+    if ((rem = k % step) != 0) {
+	if (op == DF_EQ)
+	    return df_node(ps, N_FALSE, -1, -1);
+
+	if (op == DF_NE)
+	    return df_present(ps, f);
+
+	k += op == DF_LT || op == DF_GE ? step - rem : -rem;
+    }
+
+    /* scale the value to the field bits instead of shifting each load */
+    mask = (mask << f->shift) & f->mask;
+    k = (k << f->shift) & mask;
+
+    n = df_node(ps, N_TEST, -1, -1);
+    ps->nodes[n].field = f;
+    ps->nodes[n].op = op;
+    ps->nodes[n].k = k;
+    ps->nodes[n].mask = mask;
+    return n;
+}
+
+static int df_expr(struct dparser *ps);
+
+static int df_primary(struct dparser *ps)
+{
+    static const struct {
+	const char *sym, *word;
+	U8 op;
+    } relops[] = {
+	{"==", "eq", DF_EQ}, {"!=", "ne", DF_NE}, {"<=", "le", DF_LE},
+	{">=", "ge", DF_GE}, {"<", "lt", DF_LT}, {">", "gt", DF_GT},
+	{NULL, NULL, 0}
+    };
+    const struct dfield *f;
+    int i, n;
+
+    if (df_is(ps, "(", NULL)) {
+	df_next(ps);
+	n = df_expr(ps);
+
+	if (!df_is(ps, ")", NULL))
+	    df_error(ps, "missing )");
+
+	df_next(ps);
+	return n;
+    }
+
+    if (df_is(ps, "true", NULL) || df_is(ps, "false", NULL)) {
+	n = df_node(ps, df_is(ps, "true", NULL) ? N_TRUE : N_FALSE, -1, -1);
+	df_next(ps);
+	return n;
+    }
+
+    for (f = dfields; f->name; f++)
+	if (strcmp(ps->tok, f->name) == 0)
+	    break;
+
+    if (!f->name) {
+	df_error(ps, "unknown field");
+	return 0;
+    }
+
+    if (f->layer == DF_L7 && ps->df->depth < DEPTH_L7)
+	ps->df->depth = DEPTH_L7;
+    else if ((f->layer == DF_L4 || f->layer == DF_TUN)
+	     && ps->df->depth < DEPTH_L4)
+	ps->df->depth = DEPTH_L4;
+
+    df_next(ps);
+
+    for (i = 0; relops[i].sym; i++)
+	if (df_is(ps, relops[i].sym, relops[i].word))
+	    break;
+
+    if (relops[i].sym) {
+	if (f->size == 0) {
+	    df_error(ps, "protocols can only be tested for presence");
+	    return 0;
+	}
+
+	df_next(ps);
+	return df_test(ps, f, relops[i].op);
+    }
+
+    if (df_is(ps, "in", NULL)) {
+	df_next(ps);
+
+	if (!df_is(ps, "{", NULL))
+	    return df_test(ps, f, DF_EQ);
+
+	/* a set is a chain of "or" */
+	df_next(ps);
+	n = df_node(ps, N_FALSE, -1, -1);
+
+	while (!ps->error && !df_is(ps, "}", NULL) && ps->tok[0])
+	    n = df_fold(ps, N_OR, n, df_test(ps, f, DF_EQ));
+
+	if (!df_is(ps, "}", NULL))
+	    df_error(ps, "missing }");
+
+	df_next(ps);
+	return n;
+    }
+
+    /* a flag alone tests the bit, any other field its presence */
+    n = df_present(ps, f);
+
+    if (f->size && !(f->mask & (f->mask - 1)))
+	ps->nodes[n].op = DF_NE;
+
+    return n;
+}
+
+static int df_not(struct dparser *ps)
+{
+    if (df_is(ps, "not", "!")) {
+	df_next(ps);
+	return df_fold(ps, N_NOT, df_not(ps), -1);
+    }
+
+    return df_primary(ps);
+}
+
+static int df_and(struct dparser *ps)
+{
+    int n = df_not(ps);
+
+    while (!ps->error && df_is(ps, "and", "&&")) {
+	df_next(ps);
+	n = df_fold(ps, N_AND, n, df_not(ps));
+    }
+
+    return n;
+}
+
+static int df_expr(struct dparser *ps)
+{
+    int n = df_and(ps);
+
+    while (!ps->error && df_is(ps, "or", "||")) {
+	df_next(ps);
+	n = df_fold(ps, N_OR, n, df_and(ps));
+    }
+
+    return n;
+}
+
+/* emits one instruction at the front of the code being built */
+static U16 df_emit(struct dparser *ps, const struct dnode *n, U16 off,
+		   U16 t, U16 f)
+{
+    struct dfilter *df = ps->df;
+    struct dinsn *i;
+
+    if (t == f)			/* the outcome doesn't depend on it */
+	return t;
+
+    if (df->start == 0) {
+	df_error(ps, "expression too long");
+	return t;
+    }
+
+    i = &df->code[--df->start];
+    i->layer = n->field->layer;
+    i->proto = n->field->proto;
+    i->size = n->field->size == 16 ? 4 : n->field->size;
+    i->op = n->op;
+    i->off = off;
+    i->jt = t;
+    i->jf = f;
+    i->mask = n->mask;
+    i->k = n->k;
+    return df->start;
+}
+
+/* compiles node so that it jumps to t or f, returns its entry point */
+static U16 df_compile(struct dparser *ps, int node, U16 t, U16 f)
+{
+    const struct dnode *n = &ps->nodes[node];
+    U16 entry;
+
+    switch (n->kind) {
+    case N_TRUE:
+	return t;
+
+    case N_FALSE:
+	return f;
+
+    case N_NOT:
+	return df_compile(ps, n->left, f, t);
+
+    case N_AND:
+	entry = df_compile(ps, n->right, t, f);
+	return df_compile(ps, n->left, entry, f);
+
+    case N_OR:
+	entry = df_compile(ps, n->right, t, f);
+	return df_compile(ps, n->left, t, entry);
+
+    default:
+	/* already split in words and sides by df_test6() */
+	if (n->field->size == 16)
+	    return df_emit(ps, n, n->off, t, f);
+
+	/* ip.addr == x is ip.src == x or ip.dst == x, != is the dual */
+	if (n->field->alt && n->op == DF_NE) {
+	    entry = df_emit(ps, n, n->field->alt, t, f);
+	    return df_emit(ps, n, n->field->off, entry, f);
+	}
+
+	if (n->field->alt) {
+	    entry = df_emit(ps, n, n->field->alt, t, f);
+	    return df_emit(ps, n, n->field->off, t, entry);
+	}
+
+	return df_emit(ps, n, n->field->off, t, f);
+    }
+}
+
+int dfilter_compile(struct dfilter *df, const char *expr)
+{
+    static struct dparser ps;
+    U16 entry, i;
+
+    memset(&ps, 0, sizeof(ps));
+    ps.p = expr;
+    ps.df = df;
+    df->depth = DEPTH_L3;
+    df->start = DF_MAX_INSNS;
+
+    df_next(&ps);
+    entry = df_compile(&ps, df_expr(&ps), DF_ACCEPT, DF_REJECT);
+
+    if (!ps.error && ps.tok[0])
+	df_error(&ps, "unexpected token");
+
+    if (ps.error)
+	return -1;
+
+    /* move the code to the front and rebase the jumps */
+    df->len = DF_MAX_INSNS - df->start;
+    memmove(df->code, df->code + df->start, df->len * sizeof(struct dinsn));
+
+    for (i = 0; i < df->len; i++) {
+	if (df->code[i].jt < DF_MAX_INSNS)
+	    df->code[i].jt -= df->start;
+	if (df->code[i].jf < DF_MAX_INSNS)
+	    df->code[i].jf -= df->start;
+    }
+
+    df->entry = entry < DF_MAX_INSNS ? entry - df->start : entry;
+    df->start = 0;
+    return 0;
+}
+
+int dfilter_match(const struct dfilter *df, const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+    U16 pc = df->entry;
+
+    while (pc < DF_MAX_INSNS) {
+	const struct dinsn *i = &df->code[pc];
+	const U8 *p = packet->base;
+	U32 a, off, end = packet->caplen;
+	int t;
+
+	switch (i->layer) {
+	case DF_L2:
+	    off = 0;
+	    t = packet->caplen >= 14;
+	    break;
+	case DF_VLAN:
+	    off = 0;
+	    t = l->vlans > 0;
+	    p = l->vlan;
+	    end = l->vlans * 4;
+	    break;
+	case DF_TUN:
+	    off = l->tun;
+	    t = l->tunnel == i->proto;
+	    break;
+	case DF_L3:
+	    off = l->l3;
+	    t = l->l3_proto == i->proto;
+	    break;
+	case DF_L4:
+	    off = l->l4;
+	    t = l->l4_proto == i->proto;
+	    break;
+	default:
+	    off = l->l7;
+	    t = l->l7_proto == i->proto;
+	    break;
+	}
+
+	/* a missing field fails any comparison */
+	off += i->off;
+
+	if (!t || off + i->size > end) {
+	    pc = i->jf;
+	    continue;
+	}
+
+	p += off;
+
+	switch (i->size) {
+	case 1:
+	    a = p[0];
+	    break;
+	case 2:
+	    a = GET16(p);
+	    break;
+	case 4:
+	    a = GET32(p);
+	    break;
+	default:
+	    a = 0;
+	}
+
+	a &= i->mask;
+
+	switch (i->op) {
+	case DF_EQ:
+	    t = a == i->k;
+	    break;
+	case DF_NE:
+	    t = a != i->k;
+	    break;
+	case DF_LT:
+	    t = a < i->k;
+	    break;
+	case DF_LE:
+	    t = a <= i->k;
+	    break;
+	case DF_GT:
+	    t = a > i->k;
+	    break;
+	case DF_GE:
+	    t = a >= i->k;
+	    break;
+	default:		/* DF_PRESENT */
+	    t = 1;
+	}
+
+	pc = t ? i->jt : i->jf;
+    }
+
+    return pc == DF_ACCEPT;
+}
+
+/* prints the compiled code, like tcpdump -d */
+static const char *df_target(U16 pc, char *buf, size_t bufsize)
+{
+    if (pc == DF_ACCEPT)
+	return "accept";
+
+    if (pc == DF_REJECT)
+	return "reject";
+
+    snprintf(buf, bufsize, "%d", pc);
+    return buf;
+}
+
+void dfilter_dump(const struct dfilter *df)
+{
+    static const char *ops[] = { "present", "==", "!=", "<", "<=", ">", ">=" };
+    static const char *layers[] = { "l2", "l3", "l4", "l7", "vlan", "tun" };
+    char t[8], f[8];
+    U16 i;
+
+    fprintf(stdout, "entry %s\n", df_target(df->entry, t, sizeof t));
+
+    for (i = 0; i < df->len; i++) {
+	const struct dinsn *in = &df->code[i];
+
+	fprintf(stdout, "(%03d) %s+%d/%d & 0x%x %s 0x%x jt %s jf %s\n", i,
+		layers[in->layer], in->off, in->size, in->mask, ops[in->op],
+		in->k, df_target(in->jt, t, sizeof t),
+		df_target(in->jf, f, sizeof f));
+    }
+}
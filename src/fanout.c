@@ -0,0 +1,371 @@
+/*
+ * fanout.c -- single writer, many readers packet ring in shared memory
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "fanout.h"
+
+/*
+ * Packet n goes to slot n % slots, whatever the readers: each slot is
+ * a seqlock. The writer zeroes its seq, fills it, then stores n + 1; a
+ * reader holding packet n checks, once done with the data in place,
+ * that seq is still n + 1, so that it knows whether the writer lapped
+ * it in the meantime. A reader a whole ring behind jumps half a ring
+ * back from the head and counts the packets it skipped.
+ *
+ * Readers sleep on a futex the writer bumps for every packet, waking
+ * them only when some are asleep: no system call on the fast path.
+ */
+
+static struct fanout_slot *slot(const struct fanout_ring *r, uint64_t n)
+{
+    return (struct fanout_slot *)((uint8_t *) r + FANOUT_SLOTS_OFF +
+				  (size_t)(n & (r->slots - 1)) * r->slot_len);
+}
+
+/* shm_open() wants a single leading slash */
+static void fanout_name(struct fanout *f, const char *name)
+{
+    snprintf(f->name, sizeof(f->name), "%s%s", name[0] == '/' ? "" : "/",
+	     name);
+}
+
+static int alive(uint32_t pid)
+{
+    return pid && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+static int fanout_map(struct fanout *f, int fd, size_t len)
+{
+    f->ring = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (f->ring == MAP_FAILED) {
+	fprintf(stderr, "error: mmap(%s): %s\n", f->name, strerror(errno));
+	f->ring = NULL;
+	return -1;
+    }
+
+    f->maplen = len;
+    return 0;
+}
+
+/* maps an existing ring, checking that it is one, quietly if quiet */
+static int fanout_open(struct fanout *f, const char *name, int quiet)
+{
+    struct stat st;
+    int fd;
+
+    memset(f, 0, sizeof(*f));
+    fanout_name(f, name);
+
+    if ((fd = shm_open(f->name, O_RDWR, 0)) < 0) {
+	if (!quiet)
+	    fprintf(stderr, "error: shm_open(%s): %s\n", f->name,
+		    strerror(errno));
+	return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size < FANOUT_SLOTS_OFF) {
+	if (!quiet)
+	    fprintf(stderr, "error: %s is not a pangolin fan-out\n",
+		    f->name);
+	close(fd);
+	return -1;
+    }
+
+    if (fanout_map(f, fd, st.st_size))
+	return -1;
+
+    if (__atomic_load_n(&f->ring->magic, __ATOMIC_ACQUIRE) != FANOUT_MAGIC
+	|| f->ring->version != FANOUT_VERSION
+	|| (size_t)FANOUT_SLOTS_OFF + (size_t)f->ring->slots *
+	f->ring->slot_len > (size_t)st.st_size) {
+	if (!quiet)
+	    fprintf(stderr, "error: %s is not a pangolin fan-out\n",
+		    f->name);
+	fanout_close(f);
+	return -1;
+    }
+
+    return 0;
+}
+
+int fanout_create(struct fanout *f, const char *name, uint32_t snaplen)
+{
+    struct fanout_ring *r;
+    uint32_t slot_len = 128;
+    int fd;
+
+    memset(f, 0, sizeof(*f));
+    fanout_name(f, name);
+    f->writer = 1;
+
+    while (slot_len < sizeof(struct fanout_slot) + snaplen)
+	slot_len <<= 1;
+
+    fd = shm_open(f->name, O_RDWR | O_CREAT | O_EXCL, 0660);
+
+    /*
+     * left behind by a publisher that did not exit cleanly: anything
+     * else, including a ring whose publisher has not stored the magic
+     * yet, is not ours to remove
+     */
+    if (fd < 0 && errno == EEXIST) {
+	struct fanout old;
+	uint32_t pid;
+
+	if (fanout_open(&old, f->name, 1)) {
+	    fprintf(stderr, "error: %s exists and is not a pangolin fan-out\n",
+		    f->name);
+	    return -1;
+	}
+
+	pid = old.ring->writer;
+	fanout_close(&old);
+
+	if (alive(pid)) {
+	    fprintf(stderr, "error: %s is published by process %u\n",
+		    f->name, pid);
+	    return -1;
+	}
+
+	shm_unlink(f->name);
+	fd = shm_open(f->name, O_RDWR | O_CREAT | O_EXCL, 0660);
+    }
+
+    if (fd < 0) {
+	fprintf(stderr, "error: shm_open(%s): %s\n", f->name,
+		strerror(errno));
+	return -1;
+    }
+
+    if (ftruncate(fd, FANOUT_SLOTS_OFF + FANOUT_BYTES) < 0) {
+	fprintf(stderr, "error: ftruncate(%s): %s\n", f->name,
+		strerror(errno));
+	close(fd);
+	shm_unlink(f->name);
+	return -1;
+    }
+
+    if (fanout_map(f, fd, FANOUT_SLOTS_OFF + FANOUT_BYTES)) {
+	shm_unlink(f->name);
+	return -1;
+    }
+
+    r = f->ring;
+    r->version = FANOUT_VERSION;
+    r->nreaders = FANOUT_READERS;
+    r->slots = FANOUT_BYTES / slot_len;
+    r->slot_len = slot_len;
+    r->snaplen = slot_len - sizeof(struct fanout_slot);
+    r->writer = getpid();
+    __atomic_store_n(&r->magic, FANOUT_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void fanout_publish(struct fanout *f, const struct fanout_desc *d,
+		    const void *data)
+{
+    struct fanout_ring *r = f->ring;
+    struct fanout_slot *s = slot(r, r->head);
+    uint32_t caplen = d->caplen < r->snaplen ? d->caplen : r->snaplen;
+
+    __atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    s->desc = *d;
+    s->desc.caplen = caplen;
+    memcpy(s->data, data, caplen);
+
+    __atomic_store_n(&s->seq, r->head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&r->futex, 1, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&r->sleepers, __ATOMIC_ACQUIRE))
+	syscall(SYS_futex, &r->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* every reader for the writer, its own counters for a reader */
+void fanout_report(const struct fanout *f)
+{
+    const struct fanout_ring *r = f->ring;
+    int i;
+
+    fprintf(stdout, "\nFan-out %s\n", f->name);
+
+    if (f->me) {
+	fprintf(stdout, "%llu packets read, %llu skipped.\n",
+		(unsigned long long)f->me->read,
+		(unsigned long long)f->me->skipped);
+	return;
+    }
+
+    fprintf(stdout, "%llu packets published.\n",
+	    (unsigned long long)r->head);
+
+    for (i = 0; i < FANOUT_READERS; i++) {
+	const struct fanout_reader *rd = &r->reader[i];
+
+	if (!rd->pid)
+	    continue;
+
+	fprintf(stdout, "  reader %u: %llu read, %llu skipped, %llu behind%s\n",
+		rd->pid, (unsigned long long)rd->read,
+		(unsigned long long)rd->skipped,
+		(unsigned long long)(r->head - rd->cursor),
+		alive(rd->pid) ? "" : ", gone");
+    }
+}
+
+/* a reader slot, taken over from a dead reader if need be */
+int fanout_attach(struct fanout *f, const char *name)
+{
+    struct fanout_ring *r;
+    uint32_t pid = getpid();
+    int i;
+
+    if (fanout_open(f, name, 0))
+	return -1;
+
+    r = f->ring;
+
+    for (i = 0; i < FANOUT_READERS; i++) {
+	struct fanout_reader *rd = &r->reader[i];
+	uint32_t old = __atomic_load_n(&rd->pid, __ATOMIC_ACQUIRE);
+
+	if (alive(old))
+	    continue;
+
+	if (!__atomic_compare_exchange_n(&rd->pid, &old, pid, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	    continue;
+
+	rd->read = 0;
+	rd->skipped = 0;
+	rd->cursor = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	f->me = rd;
+	return 0;
+    }
+
+    fprintf(stderr, "error: %s has %d readers already\n", f->name,
+	    FANOUT_READERS);
+    fanout_close(f);
+    return -1;
+}
+
+/*
+ * The next packet, in place: 1 and *s set, or 0 if there is none and
+ * wait is 0. The slot is the reader's until fanout_done().
+ */
+int fanout_next(struct fanout *f, const struct fanout_slot **s, int wait)
+{
+    struct fanout_ring *r = f->ring;
+    struct fanout_reader *rd = f->me;
+
+    for (;;) {
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t futex;
+	long sts;
+
+	if (head - rd->cursor > r->slots) {
+	    uint64_t to = head - r->slots / 2;
+
+	    rd->skipped += to - rd->cursor;
+	    __atomic_store_n(&rd->cursor, to, __ATOMIC_RELEASE);
+	}
+
+	if (head != rd->cursor) {
+	    f->cur = slot(r, rd->cursor);
+
+	    /* lapped between the two loads */
+	    if (__atomic_load_n(&f->cur->seq, __ATOMIC_ACQUIRE)
+		!= rd->cursor + 1) {
+		rd->skipped++;
+		__atomic_store_n(&rd->cursor, rd->cursor + 1,
+				 __ATOMIC_RELEASE);
+		continue;
+	    }
+
+	    *s = f->cur;
+	    return 1;
+	}
+
+	if (!wait)
+	    return 0;
+
+	futex = __atomic_load_n(&r->futex, __ATOMIC_ACQUIRE);
+	__atomic_add_fetch(&r->sleepers, 1, __ATOMIC_ACQ_REL);
+	sts = 0;
+
+	if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == rd->cursor)
+	    sts = syscall(SYS_futex, &r->futex, FUTEX_WAIT, futex, NULL,
+			  NULL, 0);
+
+	__atomic_sub_fetch(&r->sleepers, 1, __ATOMIC_ACQ_REL);
+
+	/* a signal: let the caller decide */
+	if (sts < 0 && errno == EINTR)
+	    return -1;
+    }
+}
+
+/* 1 if the packet was still intact when the reader let it go, else 0 */
+int fanout_done(struct fanout *f)
+{
+    struct fanout_reader *rd = f->me;
+    int ok;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    ok = __atomic_load_n(&f->cur->seq, __ATOMIC_RELAXED) == rd->cursor + 1;
+
+    if (ok)
+	rd->read++;
+    else
+	rd->skipped++;
+
+    __atomic_store_n(&rd->cursor, rd->cursor + 1, __ATOMIC_RELEASE);
+    return ok;
+}
+
+void fanout_close(struct fanout *f)
+{
+    if (f->me)
+	__atomic_store_n(&f->me->pid, 0, __ATOMIC_RELEASE);
+
+    if (f->ring)
+	munmap(f->ring, f->maplen);
+
+    if (f->writer)
+	shm_unlink(f->name);
+
+    f->ring = NULL;
+    f->me = NULL;
+}
@@ -0,0 +1,88 @@
+/*
+ * fanout.h -- packets published by pangolin --publish, for any reader
+ *
+ * One writer, any number of readers, no locks: the writer never waits,
+ * a reader that falls a whole ring behind is moved forward and counts
+ * what it missed. Readers see the packets in place, see fanout.c.
+ */
+
+#ifndef PANGOLIN_FANOUT_H
+#define PANGOLIN_FANOUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FANOUT_MAGIC 0x464c474e	/* "NGLF" little endian */
+#define FANOUT_VERSION 1
+#define FANOUT_READERS 32
+#define FANOUT_BYTES (1 << 25)	/* of slots */
+#define FANOUT_SLOTS_OFF 4096	/* past the header */
+
+/* what capture() knows about a packet */
+struct fanout_desc {
+    uint64_t time;		/* ns since the epoch */
+    uint32_t caplen;		/* bytes in data */
+    uint32_t len;		/* length on the wire */
+    int32_t ifindex;
+    uint32_t status;		/* TP_STATUS_* */
+    uint16_t vlan_tpid;		/* tag stripped by the kernel, 0 if none */
+    uint16_t vlan_tci;
+    uint32_t pad;
+};
+
+struct fanout_slot {
+    uint64_t seq;		/* packet number + 1, 0 while written */
+    struct fanout_desc desc;
+    uint8_t data[];
+};
+
+/* one cache line each, so that readers do not slow each other down */
+struct fanout_reader {
+    uint32_t pid;		/* 0 if free */
+    uint32_t pad;
+    uint64_t cursor;		/* next packet number to read */
+    uint64_t read;
+    uint64_t skipped;		/* overwritten before being read */
+    uint8_t align[32];
+};
+
+struct fanout_ring {
+    uint32_t magic;		/* written last */
+    uint16_t version;
+    uint16_t nreaders;
+    uint32_t slots;		/* a power of two */
+    uint32_t slot_len;
+    uint32_t snaplen;
+    uint32_t writer;		/* pid */
+    uint8_t align1[40];
+    uint64_t head;		/* packets published */
+    uint32_t futex;		/* bumped on every packet */
+    uint32_t sleepers;		/* readers waiting on it */
+    uint8_t align2[48];
+    struct fanout_reader reader[FANOUT_READERS];
+};
+
+struct fanout {
+    struct fanout_ring *ring;
+    size_t maplen;
+    char name[64];
+    int writer;
+    struct fanout_reader *me;	/* readers only */
+    struct fanout_slot *cur;	/* given out by fanout_next() */
+};
+
+/* writer */
+int fanout_create(struct fanout *, const char *, uint32_t);
+void fanout_publish(struct fanout *, const struct fanout_desc *,
+		    const void *);
+void fanout_report(const struct fanout *);
+
+/* readers */
+int fanout_attach(struct fanout *, const char *);
+int fanout_next(struct fanout *, const struct fanout_slot **, int);
+int fanout_done(struct fanout *);
+
+/* both */
+void fanout_close(struct fanout *);
+
+#endif /* PANGOLIN_FANOUT_H */
@@ -17,8 +17,15 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "pangolin.h"
 
+/* BPF opcodes used when chaining programs */
+#define BPF_RET_K 0x06
+#define BPF_JMP_JA 0x05
+
 struct sock_filter ARP_code[] = {
     {0x28, 0, 0, 0x0000000c},
     {0x15, 0, 1, 0x00000806},
@@ -40,10 +47,21 @@ struct sock_filter IP_code[] = {
     {0x6, 0, 0, 0x00000000}
 };
 
+struct sock_filter IP6_code[] = {
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 1, 0x000086dd},
+    {0x6, 0, 0, 0x00000044},
+    {0x6, 0, 0, 0x00000000}
+};
+
+// TCP and UDP over IPv4 or IPv6 (next header of the fixed header)
 struct sock_filter TCP_code[] = {
     {0x28, 0, 0, 0x0000000c},
-    {0x15, 0, 3, 0x00000800},
+    {0x15, 0, 2, 0x00000800},
     {0x30, 0, 0, 0x00000017},
+    {0x05, 0, 0, 0x00000002},
+    {0x15, 0, 3, 0x000086dd},
+    {0x30, 0, 0, 0x00000014},
     {0x15, 0, 1, 0x00000006},
     {0x6, 0, 0, 0x00000044},
     {0x6, 0, 0, 0x00000000}
@@ -51,8 +69,11 @@ struct sock_filter TCP_code[] = {
 
 struct sock_filter UDP_code[] = {
     {0x28, 0, 0, 0x0000000c},
-    {0x15, 0, 3, 0x00000800},
+    {0x15, 0, 2, 0x00000800},
     {0x30, 0, 0, 0x00000017},
+    {0x05, 0, 0, 0x00000002},
+    {0x15, 0, 3, 0x000086dd},
+    {0x30, 0, 0, 0x00000014},
     {0x15, 0, 1, 0x00000011},
     {0x6, 0, 0, 0x00000044},
     {0x6, 0, 0, 0x00000000}
@@ -67,6 +88,15 @@ struct sock_filter ICMP_code[] = {
     {0x6, 0, 0, 0x00000000}
 };
 
+struct sock_filter ICMP6_code[] = {
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 3, 0x000086dd},
+    {0x30, 0, 0, 0x00000014},
+    {0x15, 0, 1, 0x0000003a},
+    {0x6, 0, 0, 0x00000044},
+    {0x6, 0, 0, 0x00000000}
+};
+
 // filter by host (customizable)
 struct sock_filter HOST_code[] = {
     {0x28, 0, 0, 0x0000000c},
@@ -85,9 +115,42 @@ struct sock_filter HOST_code[] = {
     {0x6, 0, 0, 0x00000000}
 };
 
-// TCP/UDP port filter (customizable)
+// filter by IPv6 host (customizable), one word of the address at a time
+struct sock_filter HOST6_code[] = {
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 17, 0x000086dd},
+    {0x20, 0, 0, 0x00000016},
+    {0x15, 0, 6, 0xffffffff},	/* <--- IP6 */
+    {0x20, 0, 0, 0x0000001a},
+    {0x15, 0, 4, 0xffffffff},	/* <--- IP6 */
+    {0x20, 0, 0, 0x0000001e},
+    {0x15, 0, 2, 0xffffffff},	/* <--- IP6 */
+    {0x20, 0, 0, 0x00000022},
+    {0x15, 8, 0, 0xffffffff},	/* <--- IP6 */
+    {0x20, 0, 0, 0x00000026},
+    {0x15, 0, 7, 0xffffffff},	/* <--- IP6 */
+    {0x20, 0, 0, 0x0000002a},
+    {0x15, 0, 5, 0xffffffff},	/* <--- IP6 */
+    {0x20, 0, 0, 0x0000002e},
+    {0x15, 0, 3, 0xffffffff},	/* <--- IP6 */
+    {0x20, 0, 0, 0x00000032},
+    {0x15, 0, 1, 0xffffffff},	/* <--- IP6 */
+    {0x6, 0, 0, 0x00000044},
+    {0x6, 0, 0, 0x00000000}
+};
+
+// TCP/UDP port filter (customizable), IPv6 first then IPv4
 struct sock_filter PORT_code[] = {
     {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 8, 0x000086dd},
+    {0x30, 0, 0, 0x00000014},
+    {0x15, 2, 0, 0x00000084},
+    {0x15, 1, 0, 0x00000006},
+    {0x15, 0, 17, 0x00000011},
+    {0x28, 0, 0, 0x00000036},
+    {0x15, 14, 0, 0x000000ff},	/* <--- PORT */
+    {0x28, 0, 0, 0x00000038},
+    {0x15, 12, 13, 0x000000ff},	/* <--- PORT */
     {0x15, 0, 12, 0x00000800},
     {0x30, 0, 0, 0x00000017},
     {0x15, 2, 0, 0x00000084},
@@ -103,3 +166,211 @@ struct sock_filter PORT_code[] = {
     {0x6, 0, 0, 0x00000044},
     {0x6, 0, 0, 0x00000000}
 };
+
+// Ethernet and loopback only: on "any" tun, wireguard or ipip devices
+// hand in packets starting at the network header, which the other
+// stages, dissect() and dedup would all read as an Ethernet frame
+struct sock_filter HATYPE_code[] = {
+    {0x20, 0, 0, 0xfffff01c},	/* A = hatype */
+    {0x15, 1, 0, 0x00000001},	/* ARPHRD_ETHER */
+    {0x15, 0, 1, 0x00000304},	/* ARPHRD_LOOPBACK */
+    {0x6, 0, 0, 0x00000044},
+    {0x6, 0, 0, 0x00000000}
+};
+
+// headers only: accepts L2-L4 headers, length computed per packet
+struct sock_filter HEADERS_code[] = {
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 0, 11, 0x00000800},
+    {0xb1, 0, 0, 0x0000000e},	/* X = IP header length */
+    {0x30, 0, 0, 0x00000017},
+    {0x15, 0, 4, 0x00000006},
+    {0x50, 0, 0, 0x0000001a},	/* A = TCP data offset */
+    {0x54, 0, 0, 0x000000f0},
+    {0x74, 0, 0, 0x00000002},
+    {0x05, 0, 0, 0x00000001},
+    {0x00, 0, 0, 0x00000008},	/* A = UDP/ICMP header length */
+    {0x0c, 0, 0, 0x00000000},
+    {0x04, 0, 0, 0x0000000e},
+    {0x16, 0, 0, 0x00000000},
+    {0x15, 0, 8, 0x000086dd},
+    {0x30, 0, 0, 0x00000014},
+    {0x15, 0, 5, 0x00000006},
+    {0x30, 0, 0, 0x00000042},	/* A = TCP data offset */
+    {0x54, 0, 0, 0x000000f0},
+    {0x74, 0, 0, 0x00000002},
+    {0x04, 0, 0, 0x00000036},
+    {0x16, 0, 0, 0x00000000},
+    {0x6, 0, 0, 0x00000080},	/* IPv6 extension headers, ICMPv6 and UDP */
+    {0x6, 0, 0, 0x00000040}	/* non IP: ARP fits in 64 bytes */
+};
+
+#define HEADERS_LEN 23
+
+// VLAN id filter (customizable): the tag stripped by the kernel through
+// the ancillary loads, else the outermost 802.1Q/802.1ad tag in the frame.
+// The other stages read the ethertype at offset 12, so a frame matched on
+// a tag it still carries passes none of them: --vlan with -p, -h or -s
+// only matches the tags the kernel stripped
+struct sock_filter VLAN_code[] = {
+    {0x20, 0, 0, 0xfffff030},	/* A = vlan tag present */
+    {0x15, 0, 5, 0x00000000},
+    {0x28, 0, 0, 0x0000000c},
+    {0x15, 1, 0, 0x00008100},
+    {0x15, 0, 6, 0x000088a8},
+    {0x28, 0, 0, 0x0000000e},
+    {0x05, 0, 0, 0x00000001},
+    {0x20, 0, 0, 0xfffff02c},	/* A = vlan tag */
+    {0x54, 0, 0, 0x00000fff},
+    {0x15, 0, 1, 0x00000000},	/* <--- VLAN */
+    {0x6, 0, 0, 0x00000044},
+    {0x6, 0, 0, 0x00000000}
+};
+
+// sampling (customizable): keeps a packet when a random 32 bits number
+// is below the threshold, so the others are dropped before the copy
+struct sock_filter SAMPLE_code[] = {
+    {0x20, 0, 0, 0xfffff038},	/* A = random */
+    {0x35, 1, 0, 0xffffffff},	/* <--- THRESHOLD */
+    {0x6, 0, 0, 0x00000044},
+    {0x6, 0, 0, 0x00000000}
+};
+
+void filter_init(struct filter *f)
+{
+    f->len = 0;
+}
+
+/*
+ * Appends a predefined program as a stage of f: rejects are kept,
+ * accepts jump to the first instruction of the next stage.
+ */
+int filter_append(struct filter *f, const struct sock_filter *code, U16 len)
+{
+    U16 i;
+
+    if (f->len + len > FILTER_MAX_LEN) {
+	fprintf(stderr, "error: filter too long\n");
+	return -1;
+    }
+
+    memcpy(f->code + f->len, code, len * sizeof(struct sock_filter));
+
+    for (i = 0; i < len; i++) {
+	struct sock_filter *insn = &f->code[f->len + i];
+
+	if (insn->code == BPF_RET_K && insn->k != 0) {
+	    insn->code = BPF_JMP_JA;
+	    insn->k = len - i - 1;
+	}
+    }
+
+    f->len += len;
+    return 0;
+}
+
+/* terminates f, accepting snaplen bytes (or the headers only) */
+int filter_finish(struct filter *f, U32 snaplen)
+{
+    struct sock_filter accept = { BPF_RET_K, 0, 0, 0 };
+
+    if (snaplen == SNAPLEN_HEADERS) {
+	if (f->len + HEADERS_LEN > FILTER_MAX_LEN) {
+	    fprintf(stderr, "error: filter too long\n");
+	    return -1;
+	}
+
+	memcpy(f->code + f->len, HEADERS_code, sizeof(HEADERS_code));
+	f->len += HEADERS_LEN;
+	return 0;
+    }
+
+    if (f->len + 1 > FILTER_MAX_LEN) {
+	fprintf(stderr, "error: filter too long\n");
+	return -1;
+    }
+
+    accept.k = snaplen;
+    f->code[f->len++] = accept;
+    return 0;
+}
+
+/*
+ * VXLAN inner 5-tuple filter, built from the set fields of t: IPv4
+ * underlay on port 4789 carrying untagged IPv4 without options, so that
+ * the inner headers sit at fixed offsets past the outer IP header.
+ */
+#define VXLAN_MAX_LEN 32
+
+static U16 vx_emit(struct sock_filter *code, U16 n, U16 op, U32 k)
+{
+    struct sock_filter insn = { 0, 0, 0, 0 };
+
+    insn.code = op;
+    insn.k = k;
+    code[n] = insn;
+    return n + 1;
+}
+
+int filter_vxlan(struct filter *f, const struct tuple *t)
+{
+    struct sock_filter code[VXLAN_MAX_LEN];
+    U16 n = 0, i;
+
+    n = vx_emit(code, n, 0x28, 12);
+    n = vx_emit(code, n, 0x15, 0x0800);
+    n = vx_emit(code, n, 0x30, 23);
+    n = vx_emit(code, n, 0x15, 17);
+    n = vx_emit(code, n, 0x28, 20);
+    n = vx_emit(code, n, 0x45, 0x1FFF);	/* later fragments */
+    n = vx_emit(code, n, 0xb1, 14);	/* X = outer IP header length */
+    n = vx_emit(code, n, 0x48, 16);
+    n = vx_emit(code, n, 0x15, 4789);
+
+    if (t->vni) {
+	n = vx_emit(code, n, 0x40, 26);
+	n = vx_emit(code, n, 0x54, 0xFFFFFF00);
+	n = vx_emit(code, n, 0x15, t->vni << 8);
+    }
+
+    n = vx_emit(code, n, 0x48, 42);	/* inner ethertype */
+    n = vx_emit(code, n, 0x15, 0x0800);
+
+    if (t->proto) {
+	n = vx_emit(code, n, 0x50, 53);
+	n = vx_emit(code, n, 0x15, t->proto);
+    }
+
+    if (t->saddr) {
+	n = vx_emit(code, n, 0x40, 56);
+	n = vx_emit(code, n, 0x15, t->saddr);
+    }
+
+    if (t->daddr) {
+	n = vx_emit(code, n, 0x40, 60);
+	n = vx_emit(code, n, 0x15, t->daddr);
+    }
+
+    if (t->sport) {
+	n = vx_emit(code, n, 0x48, 64);
+	n = vx_emit(code, n, 0x15, t->sport);
+    }
+
+    if (t->dport) {
+	n = vx_emit(code, n, 0x48, 66);
+	n = vx_emit(code, n, 0x15, t->dport);
+    }
+
+    n = vx_emit(code, n, BPF_RET_K, 0x44);
+    n = vx_emit(code, n, BPF_RET_K, 0);
+
+    /* every test falls to the reject at the end, jset jumps on true */
+    for (i = 0; i < n - 2; i++) {
+	if (code[i].code == 0x15)
+	    code[i].jf = n - 1 - i - 1;
+	else if (code[i].code == 0x45)
+	    code[i].jt = n - 1 - i - 1;
+    }
+
+    return filter_append(f, code, n);
+}
@@ -0,0 +1,459 @@
+/*
+ * follow.c -- follow interfaces by name as they come and go
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fnmatch.h>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <linux/if_packet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "pangolin.h"
+
+/*
+ * One packet socket per interface whose name matches the pattern, all
+ * in one epoll set with the RTMGRP_LINK subscription: links are opened
+ * and closed as the kernel announces them, nothing is ever polled.
+ *
+ * Taps are keyed by ifindex, which a rename keeps, so counters survive
+ * renames and interfaces leaving and re-entering the pattern. Closed
+ * taps stay in the table for the report until it is three quarters
+ * full, then they are folded into a single total.
+ */
+
+/* the epoll key of the netlink socket, no link has index 0 */
+#define FOLLOW_NETLINK 0
+
+/* enough for a burst of a few thousand link events */
+#define FOLLOW_RCVBUF (4 << 20)
+
+static struct tap *tap_find(struct follow *f, int index)
+{
+    U32 i, n;
+
+    for (i = (U32)index * 2654435761u % FOLLOW_MAX, n = 0; n < FOLLOW_MAX;
+	 i = (i + 1) % FOLLOW_MAX, n++) {
+	if (f->taps[i].index == index)
+	    return &f->taps[i];
+
+	if (f->taps[i].index == 0)
+	    break;
+    }
+
+    return NULL;
+}
+
+/* a new tap for index, the table must have a free slot */
+static struct tap *tap_insert(struct follow *f, int index)
+{
+    U32 i;
+
+    for (i = (U32)index * 2654435761u % FOLLOW_MAX; f->taps[i].index;
+	 i = (i + 1) % FOLLOW_MAX) ;
+
+    memset(&f->taps[i], 0, sizeof(f->taps[i]));
+    f->taps[i].index = index;
+    f->taps[i].fd = -1;
+    f->used++;
+    return &f->taps[i];
+}
+
+/* counters of the socket, which the kernel resets on every read */
+static void tap_drops(struct tap *t)
+{
+    struct tpacket_stats stats;
+    socklen_t len = sizeof(stats);
+
+    if (getsockopt(t->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0)
+	t->drops += stats.tp_drops;
+}
+
+static void tap_close(struct follow *f, struct tap *t, const char *why)
+{
+    fprintf(stderr, "follow: %s (%d) %s\n", t->name, t->index, why);
+    tap_drops(t);
+    close(t->fd);
+    t->fd = -1;
+    f->open--;
+}
+
+/* folds the closed taps into the totals and rehashes the open ones */
+static void tap_compact(struct follow *f)
+{
+    struct tap *old;
+    int i;
+
+    if ((old = malloc(sizeof(f->taps))) == NULL)
+	return;
+
+    memcpy(old, f->taps, sizeof(f->taps));
+    memset(f->taps, 0, sizeof(f->taps));
+    f->used = 0;
+
+    for (i = 0; i < FOLLOW_MAX; i++) {
+	if (old[i].index == 0)
+	    continue;
+
+	if (old[i].fd < 0) {
+	    f->gone++;
+	    f->gone_packets += old[i].packets;
+	    f->gone_bytes += old[i].bytes;
+	    f->gone_drops += old[i].drops;
+	    continue;
+	}
+
+	/* open taps always fit, a quarter of the table was free */
+	*tap_insert(f, old[i].index) = old[i];
+    }
+
+    free(old);
+}
+
+/* a new tap for index, NULL if the table is full of open ones */
+static struct tap *tap_add(struct follow *f, int index)
+{
+    if (f->used >= FOLLOW_MAX / 4 * 3) {
+	if (f->open >= FOLLOW_MAX / 4 * 3)
+	    return NULL;
+
+	tap_compact(f);
+    }
+
+    return tap_insert(f, index);
+}
+
+static void tap_open(struct follow *f, struct tap *t)
+{
+    struct epoll_event ev;
+
+    if ((t->fd = if_open_index(t->index, t->name)) < 0)
+	return;
+
+    if (f->filter->len > 0)
+	if_filter(t->fd, (struct sock_filter *)f->filter->code,
+		  f->filter->len);
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = t->index;
+
+    if (epoll_ctl(f->epfd, EPOLL_CTL_ADD, t->fd, &ev) < 0) {
+	fprintf(stderr, "error: epoll_ctl(): %s\n", strerror(errno));
+	close(t->fd);
+	t->fd = -1;
+	return;
+    }
+
+    f->open++;
+    fprintf(stderr, "follow: %s (%d) opened\n", t->name, t->index);
+}
+
+/* a link was announced or dumped: open, rename or close its tap */
+static void follow_link(struct follow *f, const struct if_link *l)
+{
+    struct tap *t = tap_find(f, l->index);
+    int match = fnmatch(f->pattern, l->name, 0) == 0;
+
+    if (t && t->fd >= 0) {
+	t->seen = f->gen;
+
+	if (strcmp(t->name, l->name) != 0) {
+	    fprintf(stderr, "follow: %s (%d) renamed %s\n", t->name,
+		    t->index, l->name);
+	    snprintf(t->name, sizeof(t->name), "%s", l->name);
+	    t->renames++;
+	    eth_ifname_forget(t->index);
+	}
+
+	if (!match)
+	    tap_close(f, t, "no longer matches");
+
+	return;
+    }
+
+    if (!match)
+	return;
+
+    if (t == NULL && (t = tap_add(f, l->index)) == NULL) {
+	fprintf(stderr, "warning: too many interfaces, %s not followed\n",
+		l->name);
+	return;
+    }
+
+    if (t->name[0] && strcmp(t->name, l->name) != 0) {
+	t->renames++;
+	eth_ifname_forget(t->index);
+    }
+
+    snprintf(t->name, sizeof(t->name), "%s", l->name);
+    t->seen = f->gen;
+    tap_open(f, t);
+}
+
+/* the whole table again, after open or when events were lost */
+static int follow_sync(struct follow *f)
+{
+    struct if_link *links;
+    int fd, n, i;
+
+    /* not the subscribed socket, the dump would swallow its events */
+    if ((fd = rtnl_open(0)) < 0)
+	return -1;
+
+    n = if_links(fd, &links);
+    close(fd);
+
+    if (n < 0)
+	return -1;
+
+    f->gen++;
+
+    for (i = 0; i < n; i++)
+	follow_link(f, &links[i]);
+
+    for (i = 0; i < FOLLOW_MAX; i++)
+	if (f->taps[i].index && f->taps[i].fd >= 0
+	    && f->taps[i].seen != f->gen)
+	    tap_close(f, &f->taps[i], "gone");
+
+    free(links);
+    return 0;
+}
+
+/* drains the link events queued on the netlink socket */
+static int follow_events(struct follow *f)
+{
+    U8 buf[16384];
+
+    for (;;) {
+	struct nlmsghdr *nh;
+	ssize_t n = recv(f->nl, buf, sizeof(buf), MSG_DONTWAIT);
+
+	if (n < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+
+	    if (errno == EINTR)
+		continue;
+
+	    /* the socket overflowed: some events are lost for good */
+	    if (errno == ENOBUFS) {
+		fprintf(stderr, "warning: link events lost, rescanning\n");
+
+		if (follow_sync(f))
+		    return -1;
+
+		continue;
+	    }
+
+	    fprintf(stderr, "error: netlink: %s\n", strerror(errno));
+	    return -1;
+	}
+
+	for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (U32) n);
+	     nh = NLMSG_NEXT(nh, n)) {
+	    struct if_link l;
+	    struct tap *t;
+
+	    if (rtnl_link(nh, &l))
+		continue;
+
+	    if (nh->nlmsg_type == RTM_NEWLINK)
+		follow_link(f, &l);
+	    else if ((t = tap_find(f, l.index)) && t->fd >= 0)
+		tap_close(f, t, "gone");
+	}
+    }
+}
+
+int follow_open(struct follow *f, const char *pattern,
+		const struct filter *filter, int loindex)
+{
+    struct epoll_event ev;
+    int size = FOLLOW_RCVBUF;
+
+    memset(f, 0, sizeof(*f));
+    f->pattern = pattern;
+    f->filter = filter;
+    f->loindex = loindex;
+    f->nl = -1;
+
+    if ((f->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+	fprintf(stderr, "error: epoll_create1(): %s\n", strerror(errno));
+	return -1;
+    }
+
+    /* subscribed before the dump, so that no link can slip in between */
+    if ((f->nl = rtnl_open(RTMGRP_LINK)) < 0)
+	return -1;
+
+    if (setsockopt(f->nl, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size))
+	< 0)
+	setsockopt(f->nl, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = FOLLOW_NETLINK;
+
+    if (epoll_ctl(f->epfd, EPOLL_CTL_ADD, f->nl, &ev) < 0) {
+	fprintf(stderr, "error: epoll_ctl(): %s\n", strerror(errno));
+	return -1;
+    }
+
+    return follow_sync(f);
+}
+
+/* as capture(), from whichever followed interface has a packet */
+int follow_capture(struct follow *f, struct packet *packet, size_t snaplen)
+{
+    for (;;) {
+	struct epoll_event events[FOLLOW_EVENTS];
+	int i, n;
+
+	while (f->cur < f->nready) {
+	    struct tap *t;
+	    int sts;
+
+	    if (f->ready[f->cur] == FOLLOW_NETLINK) {
+		f->cur++;
+
+		if (follow_events(f))
+		    return -1;
+
+		continue;
+	    }
+
+	    /* closed since epoll_wait() */
+	    if ((t = tap_find(f, f->ready[f->cur++])) == NULL || t->fd < 0)
+		continue;
+
+	    if ((sts = capture(packet, t->fd, f->loindex, snaplen, 0)) > 0) {
+		t->packets++;
+		t->bytes += packet->len;
+	    }
+
+	    return sts;
+	}
+
+	n = epoll_wait(f->epfd, events, FOLLOW_EVENTS, -1);
+
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+
+	    fprintf(stderr, "error: epoll_wait(): %s\n", strerror(errno));
+	    return -1;
+	}
+
+	f->nready = 0;
+	f->cur = 0;
+
+	for (i = 0; i < n; i++) {
+	    struct tap *t;
+
+	    /*
+	     * A link going down leaves ENETDOWN on its sockets, which
+	     * keep working once it is up again: clear it and carry on.
+	     */
+	    if (events[i].events & EPOLLERR && events[i].data.u64
+		&& (t = tap_find(f, events[i].data.u64)) && t->fd >= 0) {
+		int err;
+		socklen_t len = sizeof(err);
+
+		getsockopt(t->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+	    }
+
+	    if (events[i].events & EPOLLIN)
+		f->ready[f->nready++] = events[i].data.u64;
+	}
+    }
+}
+
+static int tap_cmp(const void *a, const void *b)
+{
+    return (*(const struct tap **)a)->index - (*(const struct tap **)b)->index;
+}
+
+void follow_report(struct follow *f)
+{
+    struct tap **taps;
+    int i, n = 0;
+
+    if ((taps = malloc(FOLLOW_MAX * sizeof(*taps))) == NULL)
+	return;
+
+    for (i = 0; i < FOLLOW_MAX; i++)
+	if (f->taps[i].index) {
+	    if (f->taps[i].fd >= 0)
+		tap_drops(&f->taps[i]);
+
+	    taps[n++] = &f->taps[i];
+	}
+
+    qsort(taps, n, sizeof(*taps), tap_cmp);
+
+    fprintf(stdout, "\nFollowed interfaces\n-------------------\n");
+    fprintf(stdout, "%d open, %d closed\n", f->open, n - f->open + f->gone);
+
+    for (i = 0; i < n; i++) {
+	fprintf(stdout, "  %5d %-16s %10llu packets %12llu bytes %8llu dropped",
+		taps[i]->index, taps[i]->name,
+		(unsigned long long)taps[i]->packets,
+		(unsigned long long)taps[i]->bytes,
+		(unsigned long long)taps[i]->drops);
+
+	if (taps[i]->renames)
+	    fprintf(stdout, ", %u rename%s", taps[i]->renames,
+		    taps[i]->renames > 1 ? "s" : "");
+
+	fprintf(stdout, "%s\n", taps[i]->fd < 0 ? ", closed" : "");
+    }
+
+    if (f->gone)
+	fprintf(stdout, "  %d earlier interfaces: %llu packets %llu bytes "
+		"%llu dropped\n", f->gone,
+		(unsigned long long)f->gone_packets,
+		(unsigned long long)f->gone_bytes,
+		(unsigned long long)f->gone_drops);
+
+    free(taps);
+}
+
+void follow_close(struct follow *f)
+{
+    int i;
+
+    for (i = 0; i < FOLLOW_MAX; i++)
+	if (f->taps[i].index && f->taps[i].fd >= 0) {
+	    close(f->taps[i].fd);
+	    f->taps[i].fd = -1;
+	}
+
+    if (f->nl >= 0)
+	close(f->nl);
+
+    if (f->epfd >= 0)
+	close(f->epfd);
+
+    f->nl = f->epfd = -1;
+}
@@ -26,6 +26,7 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
 
 #include <linux/if.h>
 #include <netinet/ether.h>
@@ -48,92 +49,89 @@
 # define SOL_PACKET 263
 #endif
 
-int if_list(void)
-{
-    struct ifconf ifc;
-    struct ifreq *ifreqs, *ifr;
-    int fd, nif, i, sts = 0;
-    unsigned rqlen;
-
-    fd = socket(PF_INET, SOCK_DGRAM, 0);
-
-    if (fd < 0) {
-	fprintf(stderr, "error: cannot create an helper socket: %s\n",
-		strerror(errno));
-	return -1;
-    }
-
-    ifc.ifc_buf = NULL;
-    rqlen = 2 * sizeof(struct ifreq);	// TODO: this is a bug, ioctl
-    // always returns two interfaces
-
-    do {
-	ifc.ifc_len = rqlen;
-	ifc.ifc_buf = realloc(ifc.ifc_buf, ifc.ifc_len);
-
-	if (ifc.ifc_buf == NULL) {
-	    fprintf(stderr, "error: realloc()\n");
-	    sts = 1;
-	    goto outclose;
-	}
+/* Linux 4.20 */
+#ifndef PACKET_IGNORE_OUTGOING
+# define PACKET_IGNORE_OUTGOING 23
+#endif
 
-	if (ioctl(fd, SIOCGIFCONF, &ifc) < 0) {
-	    fprintf(stderr, "error: ioctl(SIOCGIFCONF): %s\n", strerror(errno));
-	    sts = -1;
+static int link_cmp(const void *a, const void *b)
+{
+    return ((const struct if_link *)a)->index -
+	((const struct if_link *)b)->index;
+}
 
-	    if (ifc.ifc_buf)
-		free(ifc.ifc_buf);
+static int addr_cmp(const void *a, const void *b)
+{
+    return ((const struct if_addr *)a)->index -
+	((const struct if_addr *)b)->index;
+}
 
-	    goto outclose;
-	}
+/* links with their addresses and kernel counters, from two dumps */
+int if_list(void)
+{
+    struct if_link *links;
+    struct if_addr *addrs = NULL;
+    int fd, nlinks, naddrs, i, j = 0;
 
-	rqlen *= 2;
-    }
-    while (rqlen < sizeof(struct ifreq) + ifc.ifc_len);
+    if ((fd = rtnl_open(0)) < 0)
+	return -1;
 
-    nif = ifc.ifc_len / sizeof(struct ifreq);
-    ifr = ifreqs = realloc(ifc.ifc_buf, ifc.ifc_len);
+    nlinks = if_links(fd, &links);
+    naddrs = nlinks < 0 ? -1 : if_addrs(fd, &addrs);
+    close(fd);
 
-    if (ifr == NULL) {
-	fprintf(stderr, "error: realloc()\n");
-	sts = -1;
-	goto outclose;
+    if (naddrs < 0) {
+	free(links);
+	return -1;
     }
 
+    /* before 6.7 links come in hash order, ifindex mod 256, not by index */
+    qsort(links, nlinks, sizeof(*links), link_cmp);
+    qsort(addrs, naddrs, sizeof(*addrs), addr_cmp);
     fprintf(stdout, "Listing available interface(s):\n");
 
-    for (i = 0; i < nif; i++, ifr++) {
-	U8 mac[6];
+    for (i = 0; i < nlinks; i++) {
+	const struct if_link *l = &links[i];
+	char buf[INET6_ADDRSTRLEN];
 
-	/* skip non IPv4 interfaces */
-	if (ifr->ifr_addr.sa_family != PF_INET)
-	    continue;
+	fprintf(stdout, "  %d: %s\t%s%s%s%smtu %u\n", l->index, l->name,
+		l->flags & IFF_UP ? "UP " : "",
+		l->flags & IFF_LOOPBACK ? "LOOPBACK " : "",
+		l->flags & IFF_POINTOPOINT ? "POINTOPOINT " : "",
+		l->flags & IFF_PROMISC ? "PROMISC " : "", l->mtu);
 
-	/* skip PPP interfaces */
-	if (ioctl(fd, SIOCGIFFLAGS, ifr) < 0) {
-	    fprintf(stderr, "error: ioctl(SIOCGIFFLAGS): %s\n",
-		    strerror(errno));
-	    sts = -1;
-	    goto outfree;
+	if (l->has_mac) {
+	    eth_mac_addr(l->mac, buf, sizeof buf);
+	    fprintf(stdout, "\tether %s\n", buf);
 	}
 
-	if (ifr->ifr_flags & IFF_POINTOPOINT)
-	    continue;
+	/* links and sorted addresses both go by index */
+	while (j < naddrs && addrs[j].index < l->index)
+	    j++;
 
-	/* print accepted interface */
-	memcpy(&mac, &ifr->ifr_hwaddr, 6);
-	fprintf(stdout, "  %s\t%s%s%s\n", ifr->ifr_name,
-		ifr->ifr_flags & IFF_UP ? "UP " : "",
-		ifr->ifr_flags & IFF_LOOPBACK ? "LOOPBACK " : "",
-		ifr->ifr_flags & IFF_PROMISC ? "PROMISC " : "");
-    }
+	for (; j < naddrs && addrs[j].index == l->index; j++) {
+	    inet_ntop(addrs[j].family, addrs[j].addr, buf, sizeof buf);
+	    fprintf(stdout, "\t%s %s/%u\n",
+		    addrs[j].family == AF_INET6 ? "inet6" : "inet", buf,
+		    addrs[j].prefix);
+	}
 
- outfree:
-    free(ifreqs);
+	if (l->has_stats)
+	    fprintf(stdout, "\trx %llu packets %llu bytes %llu errors "
+		    "%llu dropped\n\ttx %llu packets %llu bytes %llu errors "
+		    "%llu dropped\n", (unsigned long long)l->rx_packets,
+		    (unsigned long long)l->rx_bytes,
+		    (unsigned long long)l->rx_errors,
+		    (unsigned long long)l->rx_dropped,
+		    (unsigned long long)l->tx_packets,
+		    (unsigned long long)l->tx_bytes,
+		    (unsigned long long)l->tx_errors,
+		    (unsigned long long)l->tx_dropped);
+    }
 
- outclose:
-    close(fd);
-    return sts;
+    free(links);
+    free(addrs);
+    return 0;
 }
 
 int if_index(int fd, const char *iface)
@@ -176,62 +174,46 @@ int if_promisc(int fd, const char *iface, int state)
     return 0;
 }
 
-int if_open(const char *iface)
+/* binds fd to the interface, with every multicast and promiscuous */
+static int if_bind(int fd, int index, const char *iface)
 {
     struct packet_mreq mreq;
     struct sockaddr_ll sll;
-    int fd;
     int err;
+    int one = 1;
     size_t errlen = sizeof(err);
 
-    fd = socket(PF_PACKET, SOCK_RAW, TONET16(ETH_P_ALL));	// TODO: extension point
-
-    if (fd < 0) {
-	fprintf(stderr, "error: cannot create socket: %s\n", strerror(errno));
-	err = -1;
-	goto out;
-    }
-
     /* bind socket to a specific interface */
     memset(&sll, 0, sizeof(sll));
     sll.sll_family = PF_PACKET;
-    sll.sll_ifindex = if_index(fd, iface);
-
-    if (sll.sll_ifindex < 0) {
-	err = -1;
-	goto outclose;
-    }
-
+    sll.sll_ifindex = index;
     sll.sll_protocol = TONET16(ETH_P_ALL);
 
     if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
 	fprintf(stderr, "error: bind(): %s\n", strerror(errno));
-	err = -1;
-	goto outclose;
+	return -1;
     }
 
     /* check for pending errors on socket */
     if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) == -1) {
 	fprintf(stderr, "error: getsockopt(): %s\n", strerror(errno));
-	err = -1;
-	goto outclose;
+	return -1;
     }
 
-    if (err > 0) {
-	fprintf(stderr, "error: pending error: %s\n", strerror(errno));
-	err = -1;
-	goto outclose;
+    /* a link that is down delivers once it comes up */
+    if (err > 0 && err != ENETDOWN) {
+	fprintf(stderr, "error: pending error: %s\n", strerror(err));
+	return -1;
     }
 
+    /* memberships need a device */
+    if (index == 0)
+	goto aux;
+
     /* enable promisc mode */
     memset(&mreq, 0, sizeof(struct packet_mreq));
     mreq.mr_type = PACKET_MR_PROMISC;
-    mreq.mr_ifindex = if_index(fd, iface);
-
-    if (mreq.mr_ifindex < 0) {
-	err = -1;
-	goto outclose;
-    }
+    mreq.mr_ifindex = index;
 
     if (setsockopt
 	(fd, SOL_SOCKET, PACKET_ADD_MEMBERSHIP, &mreq,
@@ -239,19 +221,13 @@ int if_open(const char *iface)
 	fprintf(stderr,
 		"error: cannot enter promiscuous mode on interface %s: %s\n",
 		iface, strerror(errno));
-	err = -1;
-	goto outclose;
+	return -1;
     }
 
     /* enabling multicast */
     memset(&mreq, 0, sizeof(struct packet_mreq));
     mreq.mr_type = PACKET_MR_ALLMULTI;
-    mreq.mr_ifindex = if_index(fd, iface);
-
-    if (mreq.mr_ifindex < 0) {
-	err = -1;
-	goto outclose;
-    }
+    mreq.mr_ifindex = index;
 
     if (setsockopt
 	(fd, SOL_SOCKET, PACKET_ADD_MEMBERSHIP, &mreq,
@@ -259,17 +235,73 @@ int if_open(const char *iface)
 	fprintf(stderr,
 		"error: cannot receive all multicast packets on interface %s: %s\n",
 		iface, strerror(errno));
-	err = -1;
-	goto outclose;
+	return -1;
     }
 
+ aux:
+    /* the wire length and stripped VLAN tags come in a control message */
+    if (setsockopt(fd, SOL_PACKET, PACKET_AUXDATA, &one, sizeof(one)) < 0)
+	fprintf(stderr, "warning: cannot enable PACKET_AUXDATA: %s\n",
+		strerror(errno));
+
+    return 0;
+}
+
+static int if_socket(void)
+{
+    int fd;
+
+    fd = socket(PF_PACKET, SOCK_RAW, TONET16(ETH_P_ALL));	// TODO: extension point
+
+    if (fd < 0)
+	fprintf(stderr, "error: cannot create socket: %s\n", strerror(errno));
+
     return fd;
+}
 
- outclose:
-    close(fd);
+/*
+ * "any" binds to every interface, with ifindex 0. With netns, a path or
+ * a PID, the socket and so the interface belong to that namespace.
+ */
+int if_open(const char *iface, const char *netns)
+{
+    int fd, index, self;
+
+    if (netns && netns_enter(netns, &self))
+	return -1;
+
+    fd = if_socket();
+
+    if (netns)
+	netns_leave(self);
+
+    if (fd < 0)
+	return -1;
+
+    index = strcmp(iface, IF_ANY) ? if_index(fd, iface) : 0;
+
+    if (index < 0 || if_bind(fd, index, iface)) {
+	close(fd);
+	return -1;
+    }
+
+    return fd;
+}
+
+/* same as if_open(), by index: names can change under our feet */
+int if_open_index(int index, const char *iface)
+{
+    int fd;
+
+    if ((fd = if_socket()) < 0)
+	return -1;
 
- out:
-    return -1;
+    if (if_bind(fd, index, iface)) {
+	close(fd);
+	return -1;
+    }
+
+    return fd;
 }
 
 void if_close(int fd)
@@ -278,7 +310,8 @@ void if_close(int fd)
     (void)close(fd);
 }
 
-int if_stats(int fd)
+/* packets and drops since the last call: the kernel resets them */
+int if_counters(int fd, U32 * packets, U32 * drops)
 {
     struct tpacket_stats stats;
     socklen_t statslen = sizeof(struct tpacket_stats);
@@ -290,11 +323,29 @@ int if_stats(int fd)
 	return -1;
     }
 
+    *packets = stats.tp_packets;
+    *drops = stats.tp_drops;
+    return 0;
+}
+
+/* scale is the inverse of the sampling probability, 1 if not sampled */
+int if_stats(int fd, double scale)
+{
+    struct tpacket_stats stats;
+
+    if (if_counters(fd, &stats.tp_packets, &stats.tp_drops))
+	return -1;
+
     fprintf(stdout, "\nPacket statistics\n-----------------\n");
     fprintf(stdout, "\n%u packet%s captured.", stats.tp_packets,
 	    stats.tp_packets > 1 ? "s" : "");
     fprintf(stdout, "\n%u packet%s dropped.\n", stats.tp_drops,
 	    stats.tp_drops > 1 ? "s" : "");
+
+    if (scale > 1)
+	fprintf(stdout, "about %.0f packets matched, 1 in %g sampled.\n",
+		stats.tp_packets * scale, scale);
+
     return 0;
 }
 
@@ -316,3 +367,99 @@ int if_filter(int fd, struct sock_filter *code, U16 size)
 
     return 0;
 }
+
+int if_busy_poll(int fd, int usecs)
+{
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0) {
+	fprintf(stderr, "warning: cannot enable busy polling: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+/* the kernel drops what the host sends before copying it to us */
+int if_ignore_outgoing(int fd)
+{
+    int one = 1;
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one,
+		   sizeof(one)) < 0) {
+	fprintf(stderr, "warning: cannot ignore outgoing packets: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Maps a TPACKET_V2 receive ring on fd. Frames are a power of two, so
+ * that they never cross a block and the ring is a plain array.
+ */
+int if_ring(int fd, struct ring *ring, U32 snaplen)
+{
+    struct tpacket_req req;
+    int version = TPACKET_V2;
+    U32 need, blocksize;
+
+    need = TPACKET_ALIGN(TPACKET2_HDRLEN + 16) + snaplen;
+
+    /* no bigger than a packet, or the kernel copies more than fits */
+    if (need > PKT_DATA_LEN)
+	need = PKT_DATA_LEN;
+
+    for (ring->framesize = TPACKET_ALIGNMENT; ring->framesize < need;)
+	ring->framesize <<= 1;
+
+    blocksize = getpagesize();
+
+    while (blocksize < ring->framesize)
+	blocksize <<= 1;
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = blocksize;
+    req.tp_block_nr = RING_BYTES / blocksize;
+
+    if (req.tp_block_nr < 8)
+	req.tp_block_nr = 8;
+
+    req.tp_frame_size = ring->framesize;
+    req.tp_frame_nr = req.tp_block_nr * (blocksize / ring->framesize);
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version,
+		   sizeof(version)) < 0) {
+	fprintf(stderr, "error: setsockopt(PACKET_VERSION): %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+	fprintf(stderr, "error: setsockopt(PACKET_RX_RING): %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    ring->maplen = (size_t)req.tp_block_size * req.tp_block_nr;
+    ring->map = mmap(NULL, ring->maplen, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_LOCKED, fd, 0);
+
+    if (ring->map == MAP_FAILED) {
+	fprintf(stderr, "error: mmap(): %s\n", strerror(errno));
+	ring->map = NULL;
+	return -1;
+    }
+
+    ring->nframes = req.tp_frame_nr;
+    ring->cur = 0;
+    return 0;
+}
+
+void if_ring_close(struct ring *ring)
+{
+    if (ring->map != NULL)
+	(void)munmap(ring->map, ring->maplen);
+
+    ring->map = NULL;
+}
@@ -0,0 +1,171 @@
+/*
+ * latency.c -- low latency capture: pinning, scheduling, delivery latency
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "pangolin.h"
+
+/* from linux/mempolicy.h */
+#ifndef MPOL_PREFERRED
+# define MPOL_PREFERRED 1
+#endif
+
+/*
+ * Pins the process to cpu and prefers memory from its NUMA node, so
+ * that the ring and the packet buffer are local to the capture core.
+ */
+int cpu_pin(int cpu)
+{
+    cpu_set_t set;
+    unsigned c, node;
+    unsigned long nodemask;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+	fprintf(stderr, "error: cannot pin to cpu %d: %s\n", cpu,
+		strerror(errno));
+	return -1;
+    }
+
+    if (syscall(SYS_getcpu, &c, &node, NULL) < 0 || node >= 8 * sizeof(long)) {
+	fprintf(stderr, "warning: cannot find the NUMA node of cpu %d\n", cpu);
+	return 0;
+    }
+
+    nodemask = 1UL << node;
+
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodemask,
+		8 * sizeof(nodemask)) < 0)
+	fprintf(stderr, "warning: cannot prefer NUMA node %u: %s\n", node,
+		strerror(errno));
+
+    /* no page faults in the capture loop */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+	fprintf(stderr, "warning: mlockall(): %s\n", strerror(errno));
+
+    return 0;
+}
+
+int sched_fifo(int prio)
+{
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = prio;
+
+    if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+	fprintf(stderr, "error: cannot switch to SCHED_FIFO: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+/* log2 histograms, here and in profile.c: the last bucket is open ended */
+int log2_bucket(U64 v, int buckets)
+{
+    int b = 0;
+
+    while (v >>= 1)
+	b++;
+
+    return b < buckets ? b : buckets - 1;
+}
+
+/* upper bound of the bucket holding the q-th quantile of count values */
+U64 log2_quantile(const U64 *bucket, int buckets, U64 count, double q)
+{
+    U64 seen = 0, rank = q * count;
+    int b;
+
+    for (b = 0; b < buckets - 1; b++) {
+	seen += bucket[b];
+
+	if (seen > rank)
+	    break;
+    }
+
+    return (1ULL << (b + 1)) - 1;
+}
+
+/* stamp is the kernel receive time of the packet */
+void latency_record(struct latency *lat, const struct timespec *stamp)
+{
+    struct timespec now;
+    I32 sec;
+    U64 ns;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    sec = now.tv_sec - stamp->tv_sec;
+
+    /* clock stepped backwards */
+    if (sec < 0 || (sec == 0 && now.tv_nsec < stamp->tv_nsec))
+	return;
+
+    ns = (U64) sec * 1000000000 + now.tv_nsec - stamp->tv_nsec;
+    lat->count++;
+    lat->sum += ns;
+
+    if (ns > lat->max)
+	lat->max = ns;
+
+    lat->bucket[log2_bucket(ns, LATENCY_BUCKETS)]++;
+}
+
+static U64 latency_quantile(const struct latency *lat, double q)
+{
+    U64 ns = log2_quantile(lat->bucket, LATENCY_BUCKETS, lat->count, q);
+
+    return ns < lat->max ? ns : lat->max;
+}
+
+void latency_report(const struct latency *lat)
+{
+    int b;
+
+    if (lat->count == 0)
+	return;
+
+    fprintf(stdout, "\nDelivery latency\n----------------\n");
+    fprintf(stdout, "\navg %llu ns, max %llu ns",
+	    (unsigned long long)(lat->sum / lat->count),
+	    (unsigned long long)lat->max);
+    fprintf(stdout, "\np50 < %llu ns, p99 < %llu ns, p99.9 < %llu ns\n",
+	    (unsigned long long)latency_quantile(lat, 0.5),
+	    (unsigned long long)latency_quantile(lat, 0.99),
+	    (unsigned long long)latency_quantile(lat, 0.999));
+
+    for (b = 0; b < LATENCY_BUCKETS; b++) {
+	if (lat->bucket[b] == 0)
+	    continue;
+
+	fprintf(stdout, "  >= %10llu ns: %llu\n", 1ULL << b,
+		(unsigned long long)lat->bucket[b]);
+    }
+}
@@ -0,0 +1,232 @@
+/*
+ * lease.c -- DHCP lease tracking: which MAC had an IP address, and when
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "pangolin.h"
+
+/*
+ * Two fixed open addressing tables: by client MAC, its current address,
+ * and by address, its last LEASE_HISTORY bindings as [start, end)
+ * intervals. "Who had x at t" is one hash probe and a few comparisons.
+ * Bindings are opened by a DHCPACK and closed by their expiry, by a
+ * DHCPRELEASE, or by the client or the address moving elsewhere.
+ */
+
+#define DHCP_ACK 5
+#define DHCP_RELEASE 7
+
+static U32 ip_hash(U32 ip)
+{
+    return (ip * 2654435761U) % LEASES;
+}
+
+/* the slot of ip, a free one if not there, NULL if the table is full */
+static struct lease_ip *ip_slot(struct leases *t, U32 ip, int add)
+{
+    U32 i, n;
+
+    for (i = ip_hash(ip), n = 0; n < LEASES; i = (i + 1) % LEASES, n++) {
+	struct lease_ip *s = &t->ip[i];
+
+	if (s->ip == ip)
+	    return s;
+
+	if (s->ip == 0) {
+	    if (!add || t->ips >= LEASES / 4 * 3)
+		return NULL;
+
+	    s->ip = ip;
+	    t->ips++;
+	    return s;
+	}
+    }
+
+    return NULL;
+}
+
+static struct lease_mac *mac_slot(struct leases *t, const U8 *mac)
+{
+    U32 i, n;
+
+    for (i = counter_hash(mac, 6, COUNTER_SEED) % LEASES, n = 0; n < LEASES;
+	 i = (i + 1) % LEASES, n++) {
+	struct lease_mac *s = &t->mac[i];
+
+	if (s->used && memcmp(s->mac, mac, 6) == 0)
+	    return s;
+
+	if (!s->used) {
+	    if (t->macs >= LEASES / 4 * 3)
+		return NULL;
+
+	    memcpy(s->mac, mac, 6);
+	    s->used = 1;
+	    s->ip = 0;
+	    t->macs++;
+	    return s;
+	}
+    }
+
+    return NULL;
+}
+
+static struct binding *latest(struct lease_ip *s)
+{
+    return s->n ? &s->h[(s->next + LEASE_HISTORY - 1) % LEASE_HISTORY] : NULL;
+}
+
+/* ends the binding of mac to ip at now, if still open */
+static void lease_close(struct leases *t, U32 ip, const U8 *mac, U64 now)
+{
+    struct lease_ip *s = ip_slot(t, ip, 0);
+    struct binding *b;
+
+    if (s && (b = latest(s)) && memcmp(b->mac, mac, 6) == 0 && b->end > now)
+	b->end = now;
+}
+
+static void lease_open(struct leases *t, U32 ip, const U8 *mac, U64 now,
+		       U64 end)
+{
+    struct lease_ip *s = ip_slot(t, ip, 1);
+    struct binding *b;
+
+    if (s == NULL) {
+	t->dropped++;
+	return;
+    }
+
+    /* a renewal extends the current binding */
+    if ((b = latest(s)) && b->end >= now) {
+	if (memcmp(b->mac, mac, 6) == 0) {
+	    b->end = end;
+	    return;
+	}
+
+	b->end = now;
+    }
+
+    b = &s->h[s->next];
+    memcpy(b->mac, mac, 6);
+    b->start = now;
+    b->end = end;
+    s->next = (s->next + 1) % LEASE_HISTORY;
+
+    if (s->n < LEASE_HISTORY)
+	s->n++;
+}
+
+/* DHCPACK and DHCPRELEASE update the table, other messages are ignored */
+void lease_update(struct leases *t, const struct packet *packet)
+{
+    struct dhcp dhcp;
+    struct lease_mac *m;
+    U64 now = packet->time.tv_sec;
+
+    if (packet->layers.l7_proto != PROTO_BOOTP
+	|| dhcp_parse(packet, packet->layers.l7, &dhcp))
+	return;
+
+    if (dhcp.type == DHCP_ACK && dhcp.yiaddr) {
+	if ((m = mac_slot(t, dhcp.chaddr)) == NULL) {
+	    t->dropped++;
+	    return;
+	}
+
+	if (m->ip && m->ip != dhcp.yiaddr)
+	    lease_close(t, m->ip, dhcp.chaddr, now);
+
+	m->ip = dhcp.yiaddr;
+	lease_open(t, dhcp.yiaddr, dhcp.chaddr, now,
+		   dhcp.lease == 0 || dhcp.lease == 0xFFFFFFFF ?
+		   LEASE_FOREVER : now + dhcp.lease);
+    } else if (dhcp.type == DHCP_RELEASE && dhcp.ciaddr) {
+	lease_close(t, dhcp.ciaddr, dhcp.chaddr, now);
+
+	if ((m = mac_slot(t, dhcp.chaddr)) && m->ip == dhcp.ciaddr)
+	    m->ip = 0;
+    }
+}
+
+/* the MAC bound to ip (network byte order) at time t, NULL if none */
+const U8 *lease_lookup(struct leases *t, U32 ip, U64 when)
+{
+    struct lease_ip *s = ip_slot(t, ip, 0);
+    int i;
+
+    if (s == NULL)
+	return NULL;
+
+    for (i = 0; i < s->n; i++) {
+	const struct binding *b = &s->h[i];
+
+	if (b->start <= when && when < b->end)
+	    return b->mac;
+    }
+
+    return NULL;
+}
+
+static void lease_time(U64 t, char *buf, size_t size)
+{
+    time_t tt = t;
+
+    if (t == LEASE_FOREVER)
+	snprintf(buf, size, "forever");
+    else
+	strftime(buf, size, "%Y-%m-%d %H:%M:%S", localtime(&tt));
+}
+
+void lease_report(const struct leases *t)
+{
+    char mac[18], from[32], to[32];
+    U32 i;
+    int j;
+
+    fprintf(stdout, "\nDHCP leases\n-----------\n\n");
+
+    for (i = 0; i < LEASES; i++) {
+	const struct lease_ip *s = &t->ip[i];
+	struct in_addr in;
+
+	if (s->ip == 0)
+	    continue;
+
+	in.s_addr = s->ip;
+
+	/* oldest first */
+	for (j = 0; j < s->n; j++) {
+	    const struct binding *b =
+		&s->h[(s->next + LEASE_HISTORY - s->n + j) % LEASE_HISTORY];
+
+	    eth_mac_addr(b->mac, mac, sizeof mac);
+	    lease_time(b->start, from, sizeof from);
+	    lease_time(b->end, to, sizeof to);
+	    fprintf(stdout, "  %-15s %s %s - %s\n", inet_ntoa(in), mac, from,
+		    to);
+	}
+    }
+
+    if (t->dropped)
+	fprintf(stdout, "  %llu leases not tracked, table full\n",
+		(unsigned long long)t->dropped);
+}
@@ -18,21 +18,56 @@
  */
 
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sched.h>
 #include <argp.h>
+#include <net/if.h>
 
 #include "config.h"
 #include "pangolin.h"
 
 static int fd = -1;
+static struct ring ring;
+static struct latency latency;
+static struct dfilter dfilter;
+static struct output output;
+static struct checksum checksum;
+static struct matcher matcher;
+static struct http_stats http_stats;
+static struct tls_stats tls_stats;
+static struct leases leases;
+static struct neigh_table neigh;
+static struct follow follow;
+static struct dedup dedup;
+static struct netns_set netns;
+static struct xsk xsk;
+static struct fanout fanout;
+static struct pcap pcap;
+static struct replay replay;
+static struct prof prof;
+static volatile sig_atomic_t prof_dump;
 
 struct arguments {
     char *iface;
+    char *follow;
+    int any;
+    const char *netns[NETNS_MAX];
+    int nnetns;
+    int dedup;
+    int xdp;
+    U32 xdp_queue;
+    char *publish;
+    char *subscribe;
+    char *replay;
+    double speed;		/* 0 for flat out */
+    U32 loops;
+    int inbound;
 
     /* by protocol filters */
     int filter;
@@ -42,29 +77,119 @@ struct arguments {
     int icmp;
     int tcp;
     int udp;
+    int ip6;
+    int icmp6;
 
     long host;
+    int host6;
+    struct in6_addr addr6;
     int port;
+    int vlan;
+    int vxlan;
+    double sample;		/* probability, 0 if not sampling */
+    struct tuple inner;
 
     int promisc;
+    U32 snaplen;
 
     int count;
     int list;
     int mac;
     int raw;
     int dns;
+    char *dfilter;
+    int dfilter_dump;
+    int format;
+    int checksum;
+    int match;
+    int icase;
+    int http_stats;
+    int tls_stats;
+    int leases;
+    int arp_watch;
+
+    int profile;
+
+    /* low latency */
+    int ring;
+    int cpu;
+    int spin;
+    int fifo;
 };
 
 static struct arguments args;
 
 void cleanup(int sts)
 {
-    if (sts != EXIT_FAILURE)
-	if (if_stats(fd))
+    /* records first, summaries must not end up in the middle of them */
+    if (args.format != OUT_TEXT) {
+	output_close(&output);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    if (sts != EXIT_FAILURE) {
+	if (args.replay)
+	    replay_report(&replay);
+	else if (args.follow)
+	    follow_report(&follow);
+	else if (args.nnetns)
+	    netns_report(&netns);
+	else if (args.xdp)
+	    xdp_stats(&xsk);
+	else if (!args.subscribe
+		 && if_stats(fd, args.sample > 0 ? 1 / args.sample : 1))
 	    sts = EXIT_FAILURE;
 
+	if (fanout.ring)
+	    fanout_report(&fanout);
+
+	if (args.dedup)
+	    dedup_report(&dedup);
+    }
+
+    if (args.cpu >= 0)
+	latency_report(&latency);
+
+    if (args.profile)
+	prof_report(&prof);
+
+    if (args.checksum)
+	checksum_report(&checksum);
+
+    if (args.http_stats)
+	http_report(&http_stats);
+
+    if (args.tls_stats)
+	tls_report(&tls_stats);
+
+    if (args.leases)
+	lease_report(&leases);
+
+    if (args.arp_watch)
+	neigh_report(&neigh);
+
+    if_ring_close(&ring);
+
+    /* opened only once the filter is built */
+    if (follow.pattern)
+	follow_close(&follow);
+
+    if (netns.epfd > 0)
+	netns_close(&netns);
+
+    if (args.xdp)
+	xdp_close(&xsk);
+
+    if (fanout.ring)
+	fanout_close(&fanout);
+
+    if (args.replay) {
+	replay_close(&replay);
+	pcap_close(&pcap);
+    }
+
     if (fd != -1) {
-	if (if_promisc(fd, args.iface, 0))
+	if (args.promisc && if_promisc(fd, args.iface, 0))
 	    sts = EXIT_FAILURE;
 	if_close(fd);
     }
@@ -84,30 +209,166 @@ void sigterm_handler(int signal)
     cleanup(EXIT_FAILURE);
 }
 
+/* printed by the loop, stdio is not for signal handlers */
+void sigusr1_handler(int signal)
+{
+    (void)signal;
+    prof_dump = 1;
+}
+
 const char *argp_program_version = PACKAGE_VERSION;
 const char *argp_program_bug_address = PACKAGE_BUGREPORT;
 const char program_doc[] = "a simple sniffer for GNU/linux";
 
+enum {
+    OPT_SPIN = 256,
+    OPT_FIFO,
+    OPT_VLAN,
+    OPT_VXLAN,
+    OPT_CHECKSUM,
+    OPT_SAMPLE,
+    OPT_SAMPLE_PROB,
+    OPT_MATCH_FILE,
+    OPT_ICASE,
+    OPT_HTTP_STATS,
+    OPT_TLS_PORT,
+    OPT_TLS_STATS,
+    OPT_LEASES,
+    OPT_ARP_WATCH,
+    OPT_FOLLOW,
+    OPT_INBOUND,
+    OPT_NETNS,
+    OPT_XDP,
+    OPT_XDP_QUEUE,
+    OPT_PUBLISH,
+    OPT_SUBSCRIBE,
+    OPT_REPLAY,
+    OPT_SPEED,
+    OPT_LOOP,
+    OPT_PROFILE
+};
+
 /* *INDENT-OFF* */
 static const struct argp_option options[] = {
-	{ 0, 'i', "interface", 0, "select which interface to sniff" },
-	{ 0, 'p', "protocol", 0, "protocol filtering: arp, rarp, ip, icmp, tcp, udp"},
- 	{ 0, 'h', "host", 0, "host filtering"},
+	{ 0, 'i', "interface", 0, "select which interface to sniff, 'any' for all the Ethernet and loopback ones, each packet once" },
+	{ "follow", OPT_FOLLOW, "pattern", 0, "sniff every interface whose name matches the shell pattern, e.g. \"veth*\", as they come and go" },
+	{ 0, 'p', "protocol", 0, "protocol filtering: arp, rarp, ip, icmp, tcp, udp, ip6, icmp6"},
+	{ 0, 'h', "host", 0, "host filtering, IPv4 or IPv6"},
  	{ 0, 's', "port", 0, "port filtering"},
+	{ "vlan", OPT_VLAN, "id", 0, "VLAN filtering, on the outermost tag; "
+	 "with -p, -h or -s only on the tag stripped by the kernel"},
+	{ "vxlan", OPT_VXLAN, "tuple", 0, "VXLAN inner filtering, e.g. vni=42,proto=tcp,src=10.0.0.1,dst=10.0.0.2,sport=1024,dport=80"},
+	{ "sample", OPT_SAMPLE, "N", 0, "capture about 1 packet in N, chosen in the kernel"},
+	{ "sample-prob", OPT_SAMPLE_PROB, "p", 0, "capture each packet with probability p, chosen in the kernel"},
 	{ 0, 'P', 0, 0, "don't switch to promiscuous mode"},
+	{ "netns", OPT_NETNS, "ns", 0, "sniff the interface inside network namespace ns, a path or a PID, repeatable"},
+	{ "inbound", OPT_INBOUND, 0, 0, "capture received packets only, dropping what the host sends in the kernel"},
+	{ 0, 'S', "snaplen", 0, "capture at most snaplen bytes per packet, 'headers' for L2-L4 headers only"},
 	{ 0, 'c', "count", 0, "stop after count packet" },
 	{ 0, 'l', 0, 0, "list interfaces" },
 	{ 0, 'e', 0, 0, "print ethernet mac addresses" },
 	{ 0, 'r', 0, 0, "dump raw packets" },
 	{ 0, 'n', 0, 0, "don't resolve DNS names" },
+	{ "output", 'o', "format", 0, "output format: text, json, csv, binary" },
+	{ "filter", 'f', "expr", 0, "display only packets matching expr, e.g. \"tcp.flags.syn and not ip.src in 10/8\"" },
+	{ "dump-filter", 'd', 0, 0, "print the compiled display filter and exit" },
+	{ "match", 'm', "pattern", 0, "display only TCP and UDP packets whose payload contains pattern (text, or hex as 0x...), repeatable" },
+	{ "match-file", OPT_MATCH_FILE, "file", 0, "read payload patterns from file, one per line" },
+	{ "icase", OPT_ICASE, 0, 0, "match payload patterns ignoring case" },
+	{ "http-stats", OPT_HTTP_STATS, 0, 0, "count HTTP requests per endpoint and responses per status code" },
+	{ "tls-port", OPT_TLS_PORT, "port", 0, "decode TLS hellos on port too (443 always), repeatable" },
+	{ "tls-stats", OPT_TLS_STATS, 0, 0, "count TLS client hellos per server name and negotiated versions" },
+	{ "leases", OPT_LEASES, 0, 0, "track DHCP leases by client MAC and print them on exit" },
+	{ "arp-watch", OPT_ARP_WATCH, 0, 0, "track ARP bindings, flag conflicts, flapping, gratuitous storms and spoofed senders; -e shows the address of each MAC" },
+	{ "checksum", OPT_CHECKSUM, "print", OPTION_ARG_OPTIONAL, "verify IP, TCP and UDP checksums, 'print' to show the failures" },
+	{ "ring", 'R', 0, 0, "capture through a memory mapped ring" },
+	{ "xdp", OPT_XDP, "native", OPTION_ARG_OPTIONAL, "capture through AF_XDP, in generic mode unless 'native'; -p filters in XDP, the packets captured no longer reach the host" },
+	{ "publish", OPT_PUBLISH, "name", 0, "capture once and share the packets with other processes through shared memory name, printing nothing" },
+	{ "subscribe", OPT_SUBSCRIBE, "name", 0, "read the packets published as name instead of capturing" },
+	{ "replay", OPT_REPLAY, "file", 0, "transmit the packets of pcap file on -i through a memory mapped ring, then exit" },
+	{ "speed", OPT_SPEED, "factor", 0, "--replay factor times as fast as recorded, 'max' for flat out (default 1)" },
+	{ "loop", OPT_LOOP, "N", 0, "--replay the file N times, 0 for ever (default 1)" },
+	{ "xdp-queue", OPT_XDP_QUEUE, "queue", 0, "receive queue for --xdp, 0 by default" },
+	{ "profile", OPT_PROFILE, 0, 0, "time each stage of the loop per packet and protocol path, report on exit or SIGUSR1; output goes out in 64 KB blocks" },
+	{ "cpu", 'L', "cpu", 0, "low latency: pin to cpu and its NUMA node, busy poll, spin and report delivery latency" },
+	{ "spin", OPT_SPIN, 0, 0, "spin on the socket or ring instead of sleeping" },
+	{ "fifo", OPT_FIFO, "prio", OPTION_ARG_OPTIONAL, "run under SCHED_FIFO (default priority 50)" },
 	{ 0 }
 };
 /* *INDENT-ON* */
 
+/* vni=,proto=,src=,dst=,sport=,dport= */
+static int parse_tuple(char *arg, struct tuple *t)
+{
+    enum { VNI, PROTO, SRC, DST, SPORT, DPORT };
+    char *const keys[] = { "vni", "proto", "src", "dst", "sport", "dport",
+	NULL
+    };
+    char *value, *ep;
+    struct in_addr in;
+    long n;
+
+    memset(t, 0, sizeof(struct tuple));
+
+    while (*arg) {
+	int key = getsubopt(&arg, keys, &value);
+
+	if (key < 0 || value == NULL) {
+	    fprintf(stderr, "error: invalid VXLAN tuple\n");
+	    return -1;
+	}
+
+	switch (key) {
+	case SRC:
+	case DST:
+	    if (!inet_aton(value, &in)) {
+		fprintf(stderr, "error: invalid IP address\n");
+		return -1;
+	    }
+
+	    if (key == SRC)
+		t->saddr = TOHOST32(in.s_addr);
+	    else
+		t->daddr = TOHOST32(in.s_addr);
+
+	    continue;
+
+	case PROTO:
+	    if (strcmp(value, "tcp") == 0) {
+		t->proto = 6;
+		continue;
+	    } else if (strcmp(value, "udp") == 0) {
+		t->proto = 17;
+		continue;
+	    }
+	}
+
+	n = strtol(value, &ep, 10);
+
+	if (*ep != '\0' || n < 1 || n > (key == VNI ? 0xFFFFFF : 0xFFFF)
+	    || (key == PROTO && n > 0xFF)) {
+	    fprintf(stderr, "error: invalid %s\n", keys[key]);
+	    return -1;
+	}
+
+	if (key == VNI)
+	    t->vni = n;
+	else if (key == PROTO)
+	    t->proto = n;
+	else if (key == SPORT)
+	    t->sport = n;
+	else
+	    t->dport = n;
+    }
+
+    return 0;
+}
+
 error_t parse_opt(int key, char *arg, struct argp_state *state)
 {
     struct arguments *args = state->input;
     char *ep;
+    long n;
 
     switch (key) {
     case 'c':
@@ -139,6 +400,12 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 
 	    memset(&in, 0, sizeof(struct in_addr));
 
+	    if (inet_pton(AF_INET6, arg, &args->addr6) == 1) {
+		args->host6 = 1;
+		args->filter = 1;
+		break;
+	    }
+
 	    if (!inet_aton(arg, &in)) {
 		fprintf(stderr, "error: invalid IP address\n");
 		return -1;
@@ -154,6 +421,82 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	args->iface = arg;
 	break;
 
+    case OPT_FOLLOW:
+	args->follow = arg;
+	break;
+
+    case OPT_INBOUND:
+	args->inbound = 1;
+	break;
+
+    case OPT_XDP:
+	if (arg && strcmp(arg, "native") != 0) {
+	    fprintf(stderr, "error: invalid XDP mode: %s\n", arg);
+	    return -1;
+	}
+
+	args->xdp = arg ? XSK_NATIVE : XSK_SKB;
+	break;
+
+    case OPT_XDP_QUEUE:
+	n = strtol(arg, &ep, 10);
+
+	if (*ep != '\0' || n < 0) {
+	    fprintf(stderr, "error: invalid queue\n");
+	    return -1;
+	}
+
+	args->xdp_queue = n;
+	break;
+
+    case OPT_PUBLISH:
+	args->publish = arg;
+	break;
+
+    case OPT_SUBSCRIBE:
+	args->subscribe = arg;
+	break;
+
+    case OPT_REPLAY:
+	args->replay = arg;
+	break;
+
+    case OPT_SPEED:
+	if (strcmp(arg, "max") == 0) {
+	    args->speed = 0;
+	    break;
+	}
+
+	args->speed = strtod(arg, &ep);
+
+	if (*ep != '\0' || !(args->speed > 0)) {
+	    fprintf(stderr, "error: invalid speed\n");
+	    return -1;
+	}
+
+	break;
+
+    case OPT_LOOP:
+	n = strtol(arg, &ep, 10);
+
+	if (*ep != '\0' || n < 0) {
+	    fprintf(stderr, "error: invalid loop count\n");
+	    return -1;
+	}
+
+	args->loops = n;
+	break;
+
+    case OPT_NETNS:
+	if (args->nnetns == NETNS_MAX) {
+	    fprintf(stderr, "error: more than %d network namespaces\n",
+		    NETNS_MAX);
+	    return -1;
+	}
+
+	args->netns[args->nnetns++] = arg;
+	break;
+
     case 'l':
 	args->list = 1;
 	break;
@@ -162,6 +505,123 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	args->promisc = 0;
 	break;
 
+    case 'f':
+	args->dfilter = arg;
+	break;
+
+    case 'm':
+	if (matcher_add(&matcher, arg))
+	    return -1;
+
+	args->match = 1;
+	break;
+
+    case OPT_MATCH_FILE:
+	if (matcher_load(&matcher, arg))
+	    return -1;
+
+	args->match = 1;
+	break;
+
+    case OPT_TLS_PORT:
+	n = strtol(arg, &ep, 10);
+
+	if (*ep != '\0' || n < 1 || n > 0xFFFF) {
+	    fprintf(stderr, "error: invalid port\n");
+	    return -1;
+	}
+
+	tls_port_add(n);
+	break;
+
+    case OPT_ARP_WATCH:
+	args->arp_watch = 1;
+	break;
+
+    case OPT_LEASES:
+	args->leases = 1;
+	break;
+
+    case OPT_TLS_STATS:
+	args->tls_stats = 1;
+	break;
+
+    case OPT_HTTP_STATS:
+	args->http_stats = 1;
+	break;
+
+    case OPT_ICASE:
+	args->icase = 1;
+	break;
+
+    case 'd':
+	args->dfilter_dump = 1;
+	break;
+
+    case 'o':
+	if (strcmp(arg, "text") == 0)
+	    args->format = OUT_TEXT;
+	else if (strcmp(arg, "json") == 0)
+	    args->format = OUT_JSON;
+	else if (strcmp(arg, "csv") == 0)
+	    args->format = OUT_CSV;
+	else if (strcmp(arg, "binary") == 0)
+	    args->format = OUT_BINARY;
+	else {
+	    fprintf(stderr, "error: %s is not a valid output format\n", arg);
+	    return -1;
+	}
+
+	break;
+
+    case 'R':
+	args->ring = 1;
+	break;
+
+    case 'L':
+	args->cpu = strtol(arg, &ep, 10);
+
+	if (*ep != '\0' || args->cpu < 0 || args->cpu >= CPU_SETSIZE) {
+	    fprintf(stderr, "error: invalid cpu\n");
+	    return -1;
+	}
+
+	args->spin = 1;
+	break;
+
+    case OPT_SPIN:
+	args->spin = 1;
+	break;
+
+    case OPT_PROFILE:
+	args->profile = 1;
+	break;
+
+    case OPT_FIFO:
+	args->fifo = arg ? strtol(arg, &ep, 10) : 50;
+
+	if ((arg && *ep != '\0') || args->fifo < 1 || args->fifo > 99) {
+	    fprintf(stderr, "error: invalid SCHED_FIFO priority\n");
+	    return -1;
+	}
+
+	break;
+
+    case 'S':
+	if (strcmp(arg, "headers") == 0) {
+	    args->snaplen = SNAPLEN_HEADERS;
+	    break;
+	}
+
+	args->snaplen = strtol(arg, &ep, 10);
+
+	if (*ep != '\0' || args->snaplen < 1 || args->snaplen > SNAPLEN_MAX) {
+	    fprintf(stderr, "error: invalid snaplen\n");
+	    return -1;
+	}
+
+	break;
+
 #define EQ(p,s) (strcmp((p),(s)) == 0)	// TODO: useless
 
     case 'p':
@@ -182,6 +642,10 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	    args->tcp = 1, args->filter = 1;
 	else if (EQ(arg, "udp"))
 	    args->udp = 1, args->filter = 1;
+	else if (EQ(arg, "ip6"))
+	    args->ip6 = 1, args->filter = 1;
+	else if (EQ(arg, "icmp6"))
+	    args->icmp6 = 1, args->filter = 1;
 	else {
 	    fprintf(stderr, "error: %s is not a valid protocol\n", arg);
 	    return -1;
@@ -201,6 +665,53 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
 	args->filter = 1;
 	break;
 
+    case OPT_VXLAN:
+	if (parse_tuple(arg, &args->inner))
+	    return -1;
+
+	args->vxlan = 1;
+	break;
+
+    case OPT_SAMPLE:
+	args->sample = strtol(arg, &ep, 10);
+
+	if (*ep != '\0' || args->sample < 1) {
+	    fprintf(stderr, "error: invalid sampling rate\n");
+	    return -1;
+	}
+
+	args->sample = 1 / args->sample;
+	break;
+
+    case OPT_SAMPLE_PROB:
+	args->sample = strtod(arg, &ep);
+
+	if (*ep != '\0' || !(args->sample > 0 && args->sample <= 1)) {
+	    fprintf(stderr, "error: invalid sampling probability\n");
+	    return -1;
+	}
+
+	break;
+
+    case OPT_CHECKSUM:
+	if (arg && strcmp(arg, "print") != 0) {
+	    fprintf(stderr, "error: invalid checksum mode %s\n", arg);
+	    return -1;
+	}
+
+	args->checksum = arg ? 2 : 1;
+	break;
+
+    case OPT_VLAN:
+	args->vlan = strtol(arg, &ep, 10);
+
+	if (*ep != '\0' || args->vlan < 0 || args->vlan > 0xFFF) {
+	    fprintf(stderr, "error: invalid VLAN id\n");
+	    return -1;
+	}
+
+	break;
+
     default:
 	return ARGP_ERR_UNKNOWN;
     }
@@ -225,6 +736,17 @@ int main(int argc, char **argv)
 
     /* defaults */
     args.iface = NULL;
+    args.follow = NULL;
+    args.any = 0;
+    args.nnetns = 0;
+    args.xdp = 0;
+    args.xdp_queue = 0;
+    args.publish = NULL;
+    args.subscribe = NULL;
+    args.replay = NULL;
+    args.speed = 1;
+    args.loops = 1;
+    args.inbound = 0;
     args.filter = 0;
     args.arp = 0;
     args.rarp = 0;
@@ -232,13 +754,27 @@ int main(int argc, char **argv)
     args.icmp = 0;
     args.tcp = 0;
     args.udp = 0;
+    args.ip6 = 0;
+    args.icmp6 = 0;
+    args.host6 = 0;
     args.promisc = 1;
+    args.snaplen = SNAPLEN_MAX;
     args.count = 0;
     args.list = 0;
     args.mac = 0;
     args.port = 0;
+    args.vlan = -1;
+    args.vxlan = 0;
     args.raw = 0;
     args.dns = 1;
+    args.dfilter = NULL;
+    args.dfilter_dump = 0;
+    args.format = OUT_TEXT;
+    args.ring = 0;
+    args.cpu = -1;
+    args.spin = 0;
+    args.fifo = 0;
+    args.profile = 0;
 
     if (argp_parse
 	(&argp, argc, argv, ARGP_PARSE_ARGV0 | ARGP_NO_EXIT, 0, &args) != 0) {
@@ -249,46 +785,164 @@ int main(int argc, char **argv)
 	return if_list();
     }
 
-    if (!args.iface) {
+    /* compiled once, before touching the interface */
+    if (args.dfilter) {
+	if (dfilter_compile(&dfilter, args.dfilter))
+	    cleanup(EXIT_FAILURE);
+
+	if (args.dfilter_dump) {
+	    dfilter_dump(&dfilter);
+	    return 0;
+	}
+    }
+
+    if (args.match)
+	if (matcher_build(&matcher, args.icase))
+	    cleanup(EXIT_FAILURE);
+
+    if (!args.iface && !args.follow && !args.subscribe) {
 	argp_help(&argp, stderr, ARGP_HELP_USAGE, argv[0]);
 	cleanup(EXIT_FAILURE);
     }
 
-    fd = if_open(args.iface);
+    /* a ring per interface would pin megabytes for each of thousands */
+    if (args.follow && (args.iface || args.ring)) {
+	fprintf(stderr, "error: --follow cannot be used with -i or --ring\n");
+	cleanup(EXIT_FAILURE);
+    }
+
+    if (args.nnetns && args.ring) {
+	fprintf(stderr, "error: --netns cannot be used with --ring\n");
+	cleanup(EXIT_FAILURE);
+    }
 
-    if (fd < 0) {
+    /* the XDP program knows protocols, nothing else */
+    if (args.xdp && (!args.iface || args.follow || args.nnetns || args.ring
+		     || args.host || args.host6 || args.port || args.vlan >= 0
+		     || args.vxlan || args.sample > 0
+		     || args.snaplen == SNAPLEN_HEADERS)) {
+	fprintf(stderr, "error: --xdp takes -i and -p only, "
+		"-f filters the rest\n");
 	cleanup(EXIT_FAILURE);
     }
 
-    if (args.promisc)
-	if (if_promisc(fd, args.iface, 1))
+    /* the publisher did the capturing */
+    if (args.subscribe && (args.iface || args.follow || args.publish
+			   || args.arp || args.rarp || args.ip || args.icmp
+			   || args.tcp || args.udp || args.ip6 || args.icmp6
+			   || args.host || args.host6 || args.port
+			   || args.vlan >= 0 || args.vxlan || args.sample > 0
+			   || args.ring || args.xdp)) {
+	fprintf(stderr, "error: --subscribe takes no capture option, "
+		"-f filters what it reads\n");
+	cleanup(EXIT_FAILURE);
+    }
+
+    /* transmits, nothing to capture or filter */
+    if (args.replay && (!args.iface || strcmp(args.iface, IF_ANY) == 0
+			|| args.follow || args.nnetns || args.filter
+			|| args.vlan >= 0 || args.vxlan || args.sample > 0
+			|| args.ring || args.xdp || args.publish
+			|| args.subscribe || args.cpu >= 0)) {
+	fprintf(stderr, "error: --replay takes a single interface, "
+		"and no capture option\n");
+	cleanup(EXIT_FAILURE);
+    }
+
+    if (args.replay) {
+	if (pcap_open(&pcap, args.replay))
+	    cleanup(EXIT_FAILURE);
+
+	if (pcap.linktype != 1) {
+	    fprintf(stderr, "error: %s: link type %u, not ethernet\n",
+		    args.replay, pcap.linktype);
+	    cleanup(EXIT_FAILURE);
+	}
+
+	if (replay_open(&replay, args.iface))
+	    cleanup(EXIT_FAILURE);
+
+	if (args.fifo)
+	    if (sched_fifo(args.fifo))
+		cleanup(EXIT_FAILURE);
+
+	cleanup(replay_run(&replay, &pcap, args.speed, args.loops) ?
+		EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+    /* no device to switch to promiscuous mode */
+    if (args.iface && strcmp(args.iface, IF_ANY) == 0) {
+	args.any = 1;
+	args.promisc = 0;
+    }
+
+    /* pods talking to each other are seen in both namespaces */
+    args.dedup = args.any || args.nnetns > 1;
+
+    /* before the socket, so that its memory comes from the local node */
+    if (args.cpu >= 0)
+	if (cpu_pin(args.cpu))
 	    cleanup(EXIT_FAILURE);
 
+    if (!args.follow && !args.nnetns && !args.xdp && !args.subscribe) {
+	fd = if_open(args.iface, NULL);
+
+	if (fd < 0) {
+	    cleanup(EXIT_FAILURE);
+	}
+
+	if (args.cpu >= 0)
+	    if_busy_poll(fd, 50);
+
+	if (args.promisc)
+	    if (if_promisc(fd, args.iface, 1))
+		cleanup(EXIT_FAILURE);
+
+	/* on lo every packet sent comes back in */
+	if (args.inbound || strcmp(args.iface, "lo") == 0)
+	    if_ignore_outgoing(fd);
+    }
+
+    struct filter filter;
+    filter_init(&filter);
+
+    /* first, the interfaces not picked by name may have no MAC header */
+    if (args.any || args.follow)
+	filter_append(&filter, HATYPE_code, 5);
+
     if (args.arp)
-	if_filter(fd, ARP_code, 4);
+	filter_append(&filter, ARP_code, 4);
 
     if (args.rarp)
-	if_filter(fd, RARP_code, 4);
+	filter_append(&filter, RARP_code, 4);
 
     if (args.ip)
-	if_filter(fd, IP_code, 4);
+	filter_append(&filter, IP_code, 4);
 
     if (args.icmp)
-	if_filter(fd, ICMP_code, 6);
+	filter_append(&filter, ICMP_code, 6);
 
     if (args.tcp)
-	if_filter(fd, TCP_code, 6);
+	filter_append(&filter, TCP_code, 9);
 
     if (args.udp)
-	if_filter(fd, UDP_code, 6);
+	filter_append(&filter, UDP_code, 9);
+
+    if (args.ip6)
+	filter_append(&filter, IP6_code, 4);
+
+    if (args.icmp6)
+	filter_append(&filter, ICMP6_code, 6);
 
     if (args.port) {
 	U16 port;
 
 	port = args.port & 0xFFFF;
-	PORT_code[10].k = port;
-	PORT_code[12].k = port;
-	if_filter(fd, PORT_code, 15);
+	PORT_code[7].k = port;
+	PORT_code[9].k = port;
+	PORT_code[19].k = port;
+	PORT_code[21].k = port;
+	filter_append(&filter, PORT_code, 24);
     }
 
     if (args.host) {
@@ -296,20 +950,165 @@ int main(int argc, char **argv)
 	HOST_code[5].k = args.host;
 	HOST_code[9].k = args.host;
 	HOST_code[11].k = args.host;
-	if_filter(fd, HOST_code, 14);
+	filter_append(&filter, HOST_code, 14);
     }
 
-    int loindex = if_index(fd, "lo");
+    if (args.host6) {
+	const U8 *a = args.addr6.s6_addr;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+	    HOST6_code[3 + 2 * i].k = GET32(a + 4 * i);
+	    HOST6_code[11 + 2 * i].k = GET32(a + 4 * i);
+	}
+
+	filter_append(&filter, HOST6_code, 20);
+    }
+
+    if (args.vlan >= 0) {
+	VLAN_code[9].k = args.vlan;
+	filter_append(&filter, VLAN_code, 12);
+    }
+
+    if (args.vxlan)
+	if (filter_vxlan(&filter, &args.inner))
+	    cleanup(EXIT_FAILURE);
+
+    /* last, so that only the packets matching the others are counted */
+    if (args.sample > 0 && args.sample < 1) {
+	SAMPLE_code[1].k = args.sample * SAMPLE_SCALE;
+	filter_append(&filter, SAMPLE_code, 4);
+    }
+
+    /* a single program, so that the kernel truncates at snaplen too */
+    if (filter.len > 0 || args.snaplen != SNAPLEN_MAX) {
+	if (filter_finish(&filter, args.snaplen))
+	    cleanup(EXIT_FAILURE);
+
+	if (fd != -1)
+	    if_filter(fd, filter.code, filter.len);
+    }
+
+    if (args.ring)
+	if (if_ring(fd, &ring, args.snaplen == SNAPLEN_HEADERS ?
+		    256 : args.snaplen))
+	    cleanup(EXIT_FAILURE);
+
+    if (args.fifo)
+	if (sched_fifo(args.fifo))
+	    cleanup(EXIT_FAILURE);
+
+    int loindex = fd != -1 ? if_index(fd, "lo") :
+	(int)if_nametoindex("lo");
+
+    /* every socket gets the same filter */
+    if (args.follow)
+	if (follow_open(&follow, args.follow, &filter, loindex))
+	    cleanup(EXIT_FAILURE);
+
+    if (args.xdp)
+	if (xdp_open(&xsk, args.iface, args.xdp_queue, args.xdp,
+		     (args.arp ? XSK_ARP : 0) | (args.rarp ? XSK_RARP : 0) |
+		     (args.ip ? XSK_IP : 0) | (args.icmp ? XSK_ICMP : 0) |
+		     (args.tcp ? XSK_TCP : 0) | (args.udp ? XSK_UDP : 0) |
+		     (args.ip6 ? XSK_IP6 : 0) | (args.icmp6 ? XSK_ICMP6 : 0)))
+	    cleanup(EXIT_FAILURE);
+
+    if (args.publish)
+	if (fanout_create(&fanout, args.publish,
+			  args.snaplen == SNAPLEN_HEADERS ? 256 :
+			  args.snaplen == SNAPLEN_MAX ?
+			  PUBLISH_SLOT - sizeof(struct fanout_slot) :
+			  args.snaplen))
+	    cleanup(EXIT_FAILURE);
+
+    if (args.subscribe)
+	if (fanout_attach(&fanout, args.subscribe))
+	    cleanup(EXIT_FAILURE);
+
+    if (args.nnetns) {
+	int i;
+
+	if (netns_init(&netns))
+	    cleanup(EXIT_FAILURE);
+
+	for (i = 0; i < args.nnetns; i++)
+	    if (netns_add(&netns, args.netns[i], args.iface, &filter))
+		cleanup(EXIT_FAILURE);
+    }
     struct context context;
     context.print_mac_addr = args.mac;
     context.resolve_dns = args.dns;
     context.out = out_to_stdout;
     context.dump_raw_packet = args.raw;
+    context.depth = args.raw || args.publish ? DEPTH_L2 : DEPTH_L7;
+    context.output = NULL;
+    context.neigh = args.arp_watch ? &neigh : NULL;
+    context.print_ifname = args.any || args.follow;
+    context.netns = args.nnetns ? &netns : NULL;
+    context.prof = args.profile ? &prof : NULL;
+
+    if (args.format != OUT_TEXT) {
+	output_open(&output, args.format, STDOUT_FILENO, args.snaplen,
+		    args.sample > 0 && args.sample < 1 ? SAMPLE_code[1].k : 0);
+	context.output = &output;
+	output.prof = context.prof;
+    }
+
+    /* flushed as a stage of its own, see below */
+    if (args.profile) {
+	setvbuf(stdout, NULL, _IOFBF, PROF_STDOUT_LEN);
+	signal(SIGUSR1, sigusr1_handler);
+	prof_init(&prof);
+    }
+
+    if (args.dfilter && dfilter.depth > context.depth)
+	context.depth = dfilter.depth;
+
+    if (args.arp_watch && context.depth < DEPTH_L3)
+	context.depth = DEPTH_L3;
+
+    if ((args.checksum || args.match) && context.depth < DEPTH_L4)
+	context.depth = DEPTH_L4;
+
+    if (args.http_stats || args.tls_stats || args.leases)
+	context.depth = DEPTH_L7;
+
     struct packet packet;
+    size_t copylen;
     int c = 0;
-    
+
+    /* in headers mode the filter decides how much to copy */
+    copylen = args.snaplen == SNAPLEN_HEADERS ? PKT_DATA_LEN : args.snaplen;
+
     for (;;) {
-	switch (capture(&packet, fd, loindex)) {
+	int sts, bad, events;
+	U32 found = 0;
+
+	if (args.profile) {
+	    prof_packet(&prof);
+
+	    if (prof_dump) {
+		prof_report(&prof);
+		fflush(stdout);
+		prof_dump = 0;
+	    }
+	}
+
+	if (args.follow)
+	    sts = follow_capture(&follow, &packet, copylen);
+	else if (args.nnetns)
+	    sts = netns_capture(&netns, &packet, copylen);
+	else if (args.xdp)
+	    sts = xdp_capture(&xsk, &packet, copylen);
+	else if (args.subscribe)
+	    sts = capture_fanout(&packet, &fanout, copylen);
+	else if (args.ring)
+	    sts = capture_ring(&packet, fd, &ring, loindex, args.spin);
+	else
+	    sts = capture(&packet, fd, loindex, copylen, args.spin);
+
+	switch (sts) {
 	case 0: /* ignore duplicated packet from lo */
 	    if (!errno)
 		continue;
@@ -319,12 +1118,106 @@ int main(int argc, char **argv)
 	    goto out;
 
 	default:
-	    if (args.count > 0)
-		if (++c > args.count)
-		    goto out;
+	    if (args.cpu >= 0)
+		latency_record(&latency, &packet.time);
+
+	    if (PROBE_ENABLED(capture))
+		probe_capture(&packet);
+	}
+
+	/* before decoding, that is the whole point */
+	if (args.dedup) {
+	    PROF(context.prof, PROF_DEDUP);
+
+	    if (dedup_check(&dedup, &packet))
+		continue;
+	}
+
+	PROF(context.prof, PROF_DISSECT);
+	dissect(&packet, context.depth);
+
+	if (args.profile)
+	    prof_key(&prof, &packet);
+
+	if (args.dfilter || args.match)
+	    PROF(context.prof, PROF_FILTER);
+
+	/* before any formatting */
+	if (args.dfilter && !dfilter_match(&dfilter, &packet)) {
+	    PROBE1(filter_reject, packet.len);
+	    continue;
 	}
 
-	eth_dump(&packet, &context);
+	if (args.match && (found = matcher_packet(&matcher, &packet)) == 0) {
+	    PROBE1(filter_reject, packet.len);
+	    continue;
+	}
+
+	if (args.dfilter || args.match)
+	    PROBE1(filter_accept, packet.len);
+
+	if (args.count > 0)
+	    if (++c > args.count)
+		goto out;
+
+	if (args.publish) {
+	    struct fanout_desc d;
+
+	    PROF(context.prof, PROF_WRITE);
+	    d.time = (U64) packet.time.tv_sec * 1000000000 +
+		packet.time.tv_nsec;
+	    d.caplen = packet.caplen;
+	    d.len = packet.len;
+	    d.ifindex = packet.ifindex;
+	    d.status = packet.status;
+	    d.vlan_tpid = packet.vlan_tpid;
+	    d.vlan_tci = packet.vlan_tci;
+	    d.pad = 0;
+	    fanout_publish(&fanout, &d, packet.base);
+	    continue;
+	}
+
+	if (args.http_stats || args.tls_stats || args.leases || args.arp_watch
+	    || args.checksum)
+	    PROF(context.prof, PROF_STATS);
+
+	if (args.http_stats && packet.layers.l7_proto == PROTO_HTTP)
+	    http_record(&http_stats, &packet);
+
+	if (args.tls_stats && packet.layers.l7_proto == PROTO_TLS)
+	    tls_record(&tls_stats, &packet);
+
+	if (args.leases && packet.layers.l7_proto == PROTO_BOOTP)
+	    lease_update(&leases, &packet);
+
+	events = args.arp_watch ? neigh_update(&neigh, &packet) : 0;
+
+	bad = args.checksum ? checksum_verify(&checksum, &packet) : 0;
+
+	PROF(context.prof, PROF_FORMAT);
+
+	if (context.output)
+	    output_packet(context.output, &packet);
+	else
+	    eth_dump(&packet, &context);
+
+	if (events && !context.output)
+	    neigh_print(&neigh, &packet, events);
+
+	if (found && !context.output)
+	    fprintf(stdout, "  match: %s\n", matcher.patterns[found - 1].text);
+
+	if (bad && args.checksum > 1 && !context.output)
+	    fprintf(stdout, "  bad checksum:%s%s%s\n",
+		    bad & CSUM_BAD_IP ? " ip" : "",
+		    bad & CSUM_BAD_TCP ? " tcp" : "",
+		    bad & CSUM_BAD_UDP ? " udp" : "");
+
+	/* before stdio fills its buffer and writes on its own */
+	if (args.profile && __fpending(stdout) > PROF_STDOUT_LEN / 2) {
+	    PROF(context.prof, PROF_WRITE);
+	    fflush(stdout);
+	}
     }
 
  out:
@@ -0,0 +1,338 @@
+/*
+ * match.c -- payload matching of many patterns at once (Aho-Corasick)
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "pangolin.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+/*
+ * The patterns are compiled to a deterministic automaton: every state
+ * has a transition for every byte class, so scanning a payload is one
+ * table lookup per byte whatever the number of patterns. Bytes that no
+ * pattern contains share class 0, which keeps the table small.
+ */
+
+/* "0x" followed by an even number of hex digits */
+static int is_hex(const char *s)
+{
+    size_t n;
+
+    if (s[0] != '0' || s[1] != 'x' || s[2] == '\0')
+	return 0;
+
+    for (n = 2; s[n]; n++)
+	if (!isxdigit((unsigned char)s[n]))
+	    return 0;
+
+    return n % 2 == 0;
+}
+
+static int hex_value(char c)
+{
+    return isdigit((unsigned char)c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+int matcher_add(struct matcher *m, const char *pattern)
+{
+    struct pattern *p;
+    size_t i, len = strlen(pattern);
+
+    if (len == 0) {
+	fprintf(stderr, "error: empty pattern\n");
+	return -1;
+    }
+
+    if (m->npatterns % 64 == 0) {
+	p = realloc(m->patterns, (m->npatterns + 64) * sizeof(*p));
+
+	if (p == NULL) {
+	    fprintf(stderr, "error: realloc()\n");
+	    return -1;
+	}
+
+	m->patterns = p;
+    }
+
+    p = &m->patterns[m->npatterns];
+    p->text = strdup(pattern);
+    p->bytes = malloc(len);
+
+    if (p->text == NULL || p->bytes == NULL) {
+	fprintf(stderr, "error: malloc()\n");
+	free(p->text);
+	free(p->bytes);
+	return -1;
+    }
+
+    if (is_hex(pattern)) {
+	p->len = (len - 2) / 2;
+
+	for (i = 0; i < p->len; i++)
+	    p->bytes[i] = hex_value(pattern[2 + 2 * i]) << 4 |
+		hex_value(pattern[3 + 2 * i]);
+    } else {
+	p->len = len;
+	memcpy(p->bytes, pattern, len);
+    }
+
+    m->npatterns++;
+    return 0;
+}
+
+/* one pattern per line, empty lines and lines starting with '#' skipped */
+int matcher_load(struct matcher *m, const char *file)
+{
+    char line[1024];
+    FILE *f;
+    int sts = 0;
+
+    if ((f = fopen(file, "r")) == NULL) {
+	fprintf(stderr, "error: cannot open %s: %s\n", file, strerror(errno));
+	return -1;
+    }
+
+    while (sts == 0 && fgets(line, sizeof(line), f)) {
+	line[strcspn(line, "\r\n")] = '\0';
+
+	if (line[0] != '\0' && line[0] != '#')
+	    sts = matcher_add(m, line);
+    }
+
+    fclose(f);
+    return sts;
+}
+
+/* a new state without transitions, -1 if out of memory */
+static I32 new_state(struct matcher *m, U32 *size)
+{
+    if (m->states == *size) {
+	U32 *delta, *out;
+
+	*size = *size ? *size * 2 : 256;
+	delta = realloc(m->delta, (size_t)*size * m->nclass * sizeof(U32));
+	out = realloc(m->out, *size * sizeof(U32));
+
+	if (delta)
+	    m->delta = delta;
+
+	if (out)
+	    m->out = out;
+
+	if (delta == NULL || out == NULL) {
+	    fprintf(stderr, "error: too many patterns, out of memory\n");
+	    return -1;
+	}
+    }
+
+    memset(m->delta + (size_t)m->states * m->nclass, 0,
+	   m->nclass * sizeof(U32));
+    m->out[m->states] = 0;
+    return m->states++;
+}
+
+int matcher_build(struct matcher *m, int icase)
+{
+    U32 i, j, c, size = 0, head, tail, *fail, *queue;
+    int b;
+
+    /* byte classes */
+    memset(m->cls, 0, sizeof(m->cls));
+    m->nclass = 1;
+
+    for (i = 0; i < m->npatterns; i++)
+	for (j = 0; j < m->patterns[i].len; j++) {
+	    b = m->patterns[i].bytes[j];
+
+	    if (icase)
+		b = tolower(b);
+
+	    if (m->cls[b] == 0)
+		m->cls[b] = m->nclass++;
+	}
+
+    if (icase)
+	for (b = 'A'; b <= 'Z'; b++)
+	    m->cls[b] = m->cls[tolower(b)];
+
+    /* the trie, out[] holds the index + 1 of the pattern ending there */
+    m->states = 0;
+
+    if (new_state(m, &size) < 0)
+	return -1;
+
+    for (i = 0; i < m->npatterns; i++) {
+	U32 s = 0;
+
+	for (j = 0; j < m->patterns[i].len; j++) {
+	    U32 *t = &m->delta[(size_t)s * m->nclass +
+			       m->cls[m->patterns[i].bytes[j]]];
+
+	    if (*t == 0) {
+		I32 n = new_state(m, &size);
+
+		if (n < 0)
+		    return -1;
+
+		/* new_state() may have moved the table */
+		t = &m->delta[(size_t)s * m->nclass +
+			      m->cls[m->patterns[i].bytes[j]]];
+		*t = n;
+	    }
+
+	    s = *t;
+	}
+
+	if (m->out[s] == 0)
+	    m->out[s] = i + 1;
+    }
+
+    /*
+     * Breadth first, so that the failure state of a state is complete
+     * before its missing transitions are copied from it.
+     */
+    fail = calloc(m->states, sizeof(U32));
+    queue = malloc(m->states * sizeof(U32));
+
+    if (fail == NULL || queue == NULL) {
+	fprintf(stderr, "error: malloc()\n");
+	free(fail);
+	free(queue);
+	return -1;
+    }
+
+    head = tail = 0;
+
+    for (c = 0; c < m->nclass; c++)
+	if (m->delta[c])
+	    queue[tail++] = m->delta[c];
+
+    while (head < tail) {
+	U32 s = queue[head++];
+	U32 *row = m->delta + (size_t)s * m->nclass;
+	const U32 *frow = m->delta + (size_t)fail[s] * m->nclass;
+
+	if (m->out[s] == 0)
+	    m->out[s] = m->out[fail[s]];
+
+	for (c = 0; c < m->nclass; c++) {
+	    if (row[c]) {
+		fail[row[c]] = frow[c];
+		queue[tail++] = row[c];
+	    } else
+		row[c] = frow[c];
+	}
+    }
+
+    free(fail);
+    free(queue);
+
+    /* few possible first bytes: skip to them instead of walking the root */
+    m->nfirst = 0;
+
+    for (b = 0; b < 256; b++) {
+	if (m->cls[b] == 0 || m->delta[m->cls[b]] == 0)
+	    continue;
+
+	if (m->nfirst == MATCH_FIRST_MAX) {
+	    m->nfirst = 0;
+	    break;
+	}
+
+	m->first[m->nfirst++] = b;
+    }
+
+    return 0;
+}
+
+/* offset of the first byte that can start a match, len if none */
+static U32 skip(const struct matcher *m, const U8 *p, U32 i, U32 len)
+{
+    int k;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+	__m128i hit = _mm_setzero_si128();
+	int mask;
+
+	for (k = 0; k < m->nfirst; k++)
+	    hit = _mm_or_si128(hit,
+			       _mm_cmpeq_epi8(v, _mm_set1_epi8(m->first[k])));
+
+	if ((mask = _mm_movemask_epi8(hit)))
+	    return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; i++)
+	for (k = 0; k < m->nfirst; k++)
+	    if (p[i] == m->first[k])
+		return i;
+
+    return len;
+}
+
+/* index + 1 of a pattern found in p, 0 if none */
+U32 matcher_scan(const struct matcher *m, const U8 *p, U32 len)
+{
+    U32 i, s = 0;
+
+    for (i = 0; i < len; i++) {
+	if (s == 0 && m->nfirst) {
+	    if ((i = skip(m, p, i, len)) == len)
+		break;
+	}
+
+	s = m->delta[(size_t)s * m->nclass + m->cls[p[i]]];
+
+	if (m->out[s])
+	    return m->out[s];
+    }
+
+    return 0;
+}
+
+/* matches the TCP or UDP payload, without the ethernet padding */
+U32 matcher_packet(const struct matcher *m, const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+    const U8 *h = packet->base + l->l3;
+    U32 end = packet->caplen;
+
+    if (l->l4_proto != PROTO_TCP && l->l4_proto != PROTO_UDP)
+	return 0;
+
+    if (l->l3_proto == PROTO_IP && (U32) l->l3 + GET16(h + 2) < end)
+	end = l->l3 + GET16(h + 2);
+    else if (l->l3_proto == PROTO_IP6 && (U32) l->l3 + 40 + GET16(h + 4) < end)
+	end = l->l3 + 40 + GET16(h + 4);
+
+    if (l->l7 >= end)
+	return 0;
+
+    return matcher_scan(m, packet->base + l->l7, end - l->l7);
+}
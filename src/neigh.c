@@ -0,0 +1,292 @@
+/*
+ * neigh.c -- ARP binding tracker: conflicts, flapping, gratuitous storms
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pangolin.h"
+
+/*
+ * IPv4 to MAC bindings learnt from the sender fields of ARP packets, in
+ * two fixed open addressing tables (by IP and by MAC) so that floods
+ * cost a couple of probes and no allocation. Entries not refreshed for
+ * NEIGH_AGE seconds are stale: they no longer raise conflicts and their
+ * slots are reused.
+ *
+ * IPv4 frames refresh the binding of their source address when their
+ * Ethernet source is its MAC, but never create or change one: routed
+ * traffic carries the MAC of the router.
+ */
+
+#define NEIGH_AGE 300
+#define NEIGH_FLAP_WINDOW 60	/* seconds to come back to the old MAC */
+#define NEIGH_GARP_MAX 10	/* gratuitous ARPs per second and address */
+
+#define ARP_OP 6
+#define ARP_SHA 8
+#define ARP_SPA 14
+#define ARP_TPA 24
+
+#define ETH_SHOST 6
+
+static U32 ip_hash(U32 ip)
+{
+    return (ip * 2654435761U) % NEIGHS;
+}
+
+static U32 mac_hash(const U8 *mac)
+{
+    return counter_hash(mac, 6, COUNTER_SEED) % NEIGHS;
+}
+
+/*
+ * The entry of ip, else a stale or free one reset for it, NULL if the
+ * table is full. The probe goes on past stale entries: ip may follow.
+ */
+static struct neigh_ip *ip_entry(struct neigh_table *t, U32 ip, U64 now)
+{
+    struct neigh_ip *stale = NULL;
+    U32 i, n;
+
+    for (i = ip_hash(ip), n = 0; n < NEIGHS; i = (i + 1) % NEIGHS, n++) {
+	struct neigh_ip *e = &t->ip[i];
+
+	if (e->used && e->ip == ip)
+	    return e;
+
+	if (!e->used) {
+	    if (stale == NULL) {
+		if (t->ips >= NEIGHS / 4 * 3)
+		    break;
+
+		stale = e;
+		t->ips++;
+	    }
+
+	    break;
+	}
+
+	if (stale == NULL && now - e->seen >= NEIGH_AGE)
+	    stale = e;
+    }
+
+    if (stale == NULL) {
+	t->dropped++;
+	return NULL;
+    }
+
+    memset(stale, 0, sizeof(*stale));
+    stale->used = 1;
+    stale->ip = ip;
+    return stale;
+}
+
+static struct neigh_mac *mac_entry(struct neigh_table *t, const U8 *mac,
+				   U64 now, int add)
+{
+    struct neigh_mac *stale = NULL;
+    U32 i, n;
+
+    for (i = mac_hash(mac), n = 0; n < NEIGHS; i = (i + 1) % NEIGHS, n++) {
+	struct neigh_mac *e = &t->mac[i];
+
+	if (e->used && memcmp(e->mac, mac, 6) == 0)
+	    return e;
+
+	if (!e->used) {
+	    if (add && stale == NULL && t->macs < NEIGHS / 4 * 3) {
+		stale = e;
+		t->macs++;
+	    }
+
+	    break;
+	}
+
+	if (add && stale == NULL && now - e->seen >= NEIGH_AGE)
+	    stale = e;
+    }
+
+    if (stale == NULL)
+	return NULL;
+
+    memcpy(stale->mac, mac, 6);
+    stale->used = 1;
+    return stale;
+}
+
+/* an IPv4 frame from the MAC bound to its source keeps both entries */
+static void neigh_refresh(struct neigh_table *t, const struct packet *packet)
+{
+    const U8 *mac = packet->base + ETH_SHOST;
+    U32 ip = packet->layers.saddr, i, n;
+    U64 now = packet->time.tv_sec;
+    struct neigh_mac *m;
+
+    for (i = ip_hash(ip), n = 0; n < NEIGHS; i = (i + 1) % NEIGHS, n++) {
+	struct neigh_ip *e = &t->ip[i];
+
+	if (!e->used)
+	    return;
+
+	if (e->ip != ip)
+	    continue;
+
+	if (memcmp(e->mac, mac, 6) != 0)
+	    return;
+
+	e->seen = now;
+
+	if ((m = mac_entry(t, mac, now, 0)) && m->ip == ip)
+	    m->seen = now;
+	return;
+    }
+}
+
+/* returns the NEIGH_* events raised by an ARP packet */
+int neigh_update(struct neigh_table *t, const struct packet *packet)
+{
+    const U8 *h = packet->base + packet->layers.l3;
+    const U8 *sha = h + ARP_SHA;
+    struct neigh_ip *e;
+    struct neigh_mac *m;
+    U64 now = packet->time.tv_sec;
+    U32 spa;
+    int events = 0;
+
+    /* the outer frame only, the inner one of a tunnel is not kept */
+    if (packet->layers.l3_proto == PROTO_IP && !packet->layers.tunnel) {
+	neigh_refresh(t, packet);
+	return 0;
+    }
+
+    /* Ethernet and IPv4 only */
+    if (packet->layers.l3_proto != PROTO_ARP || GET16(h) != 1
+	|| GET16(h + 2) != 0x0800 || h[4] != 6 || h[5] != 4)
+	return 0;
+
+    memcpy(&spa, h + ARP_SPA, 4);
+
+    /* probes (RFC 5227) have no sender address yet */
+    if (spa == 0)
+	return 0;
+
+    /* the outer frame only, the inner one of a tunnel is not kept */
+    if (!packet->layers.tunnel && memcmp(sha, packet->base + ETH_SHOST, 6)) {
+	t->spoofed++;
+	events |= NEIGH_SPOOF;
+    }
+
+    if ((e = ip_entry(t, spa, now)) == NULL)
+	return events;
+
+    if (e->seen == 0) {
+	memcpy(e->mac, sha, 6);
+	e->changed = now;
+	t->bindings++;
+    } else if (memcmp(e->mac, sha, 6) != 0) {
+	memcpy(t->old, e->mac, 6);
+
+	if (now - e->seen < NEIGH_AGE) {
+	    if (memcmp(e->prev, sha, 6) == 0
+		&& now - e->changed < NEIGH_FLAP_WINDOW) {
+		t->flaps++;
+		events |= NEIGH_FLAP;
+	    } else {
+		t->conflicts++;
+		events |= NEIGH_CONFLICT;
+	    }
+	}
+
+	memcpy(e->prev, e->mac, 6);
+	memcpy(e->mac, sha, 6);
+	e->changed = now;
+    }
+
+    e->seen = now;
+
+    /* gratuitous: announces its own address */
+    if (memcmp(h + ARP_SPA, h + ARP_TPA, 4) == 0) {
+	if (e->garp_sec != now) {
+	    e->garp_sec = now;
+	    e->garp = 0;
+	}
+
+	if (++e->garp == NEIGH_GARP_MAX + 1) {
+	    t->storms++;
+	    events |= NEIGH_STORM;
+	}
+    }
+
+    if ((m = mac_entry(t, sha, now, 1))) {
+	m->ip = spa;
+	m->seen = now;
+    }
+
+    return events;
+}
+
+/* the address last claimed by mac, 0 if none or stale */
+U32 neigh_ip(struct neigh_table *t, const U8 *mac, U64 now)
+{
+    struct neigh_mac *m = mac_entry(t, mac, now, 0);
+
+    return m && now - m->seen < NEIGH_AGE ? m->ip : 0;
+}
+
+void neigh_print(const struct neigh_table *t, const struct packet *packet,
+		 int events)
+{
+    const U8 *h = packet->base + packet->layers.l3;
+    char old[18], new[18];
+    struct in_addr in;
+
+    memcpy(&in, h + ARP_SPA, 4);
+    eth_mac_addr(t->old, old, sizeof old);
+    eth_mac_addr(h + ARP_SHA, new, sizeof new);
+
+    if (events & NEIGH_CONFLICT)
+	fprintf(stdout, "  arp: %s conflict, was %s now %s\n", inet_ntoa(in),
+		old, new);
+
+    if (events & NEIGH_FLAP)
+	fprintf(stdout, "  arp: %s flapping, back to %s from %s\n",
+		inet_ntoa(in), new, old);
+
+    if (events & NEIGH_STORM)
+	fprintf(stdout, "  arp: %s gratuitous storm, over %d/s\n",
+		inet_ntoa(in), NEIGH_GARP_MAX);
+
+    if (events & NEIGH_SPOOF)
+	fprintf(stdout, "  arp: %s sender %s differs from ethernet source\n",
+		inet_ntoa(in), new);
+}
+
+void neigh_report(const struct neigh_table *t)
+{
+    fprintf(stdout, "\nARP\n---\n");
+    fprintf(stdout, "\n%llu bindings learnt, %llu conflicts, %llu flapping, "
+	    "%llu gratuitous storms, %llu spoofed senders\n",
+	    (unsigned long long)t->bindings, (unsigned long long)t->conflicts,
+	    (unsigned long long)t->flaps, (unsigned long long)t->storms,
+	    (unsigned long long)t->spoofed);
+
+    if (t->dropped)
+	fprintf(stdout, "%llu packets not tracked, table full\n",
+		(unsigned long long)t->dropped);
+}
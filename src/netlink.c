@@ -0,0 +1,293 @@
+/*
+ * netlink.c -- interfaces and addresses through rtnetlink dumps
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "pangolin.h"
+
+/*
+ * One NETLINK_ROUTE socket, one dump request per table: the kernel
+ * streams every link (with its counters) or every address back in a
+ * few large messages, whatever the number of interfaces.
+ */
+
+#define RTNL_BUF_LEN 65536
+
+int rtnl_open(U32 groups)
+{
+    struct sockaddr_nl snl;
+    int fd;
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    if (fd < 0) {
+	fprintf(stderr, "error: cannot create netlink socket: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    memset(&snl, 0, sizeof(snl));
+    snl.nl_family = AF_NETLINK;
+    snl.nl_groups = groups;
+
+    if (bind(fd, (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+	fprintf(stderr, "error: cannot bind netlink socket: %s\n",
+		strerror(errno));
+	close(fd);
+	return -1;
+    }
+
+    return fd;
+}
+
+/* the attributes of a link message, NULL for the missing ones */
+static void rtnl_attrs(struct rtattr **tb, int max, struct rtattr *rta,
+		       int len)
+{
+    memset(tb, 0, (max + 1) * sizeof(*tb));
+
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+	if (rta->rta_type <= max)
+	    tb[rta->rta_type] = rta;
+}
+
+/* fills l from a RTM_NEWLINK message, -1 if it is not one */
+int rtnl_link(const struct nlmsghdr *nh, struct if_link *l)
+{
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    struct rtattr *tb[IFLA_MAX + 1];
+
+    if ((nh->nlmsg_type != RTM_NEWLINK && nh->nlmsg_type != RTM_DELLINK)
+	|| nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+	return -1;
+
+    rtnl_attrs(tb, IFLA_MAX, IFLA_RTA(ifi), IFLA_PAYLOAD(nh));
+    memset(l, 0, sizeof(*l));
+    l->index = ifi->ifi_index;
+    l->flags = ifi->ifi_flags;
+
+    if (tb[IFLA_IFNAME])
+	snprintf(l->name, sizeof(l->name), "%s",
+		 (const char *)RTA_DATA(tb[IFLA_IFNAME]));
+
+    if (tb[IFLA_MTU] && RTA_PAYLOAD(tb[IFLA_MTU]) >= 4)
+	memcpy(&l->mtu, RTA_DATA(tb[IFLA_MTU]), 4);
+
+    if (tb[IFLA_ADDRESS] && RTA_PAYLOAD(tb[IFLA_ADDRESS]) == 6) {
+	memcpy(l->mac, RTA_DATA(tb[IFLA_ADDRESS]), 6);
+	l->has_mac = 1;
+    }
+
+    if (tb[IFLA_STATS64]
+	&& RTA_PAYLOAD(tb[IFLA_STATS64]) >= sizeof(struct rtnl_link_stats64)) {
+	struct rtnl_link_stats64 st;
+
+	memcpy(&st, RTA_DATA(tb[IFLA_STATS64]), sizeof(st));
+	l->rx_packets = st.rx_packets;
+	l->tx_packets = st.tx_packets;
+	l->rx_bytes = st.rx_bytes;
+	l->tx_bytes = st.tx_bytes;
+	l->rx_errors = st.rx_errors;
+	l->tx_errors = st.tx_errors;
+	l->rx_dropped = st.rx_dropped;
+	l->tx_dropped = st.tx_dropped;
+	l->has_stats = 1;
+    }
+
+    return 0;
+}
+
+/* a growing array filled by the dump callbacks */
+struct vec {
+    void *v;
+    int n;
+    int size;
+    size_t elem;
+};
+
+static void *vec_push(struct vec *v)
+{
+    if (v->n == v->size) {
+	void *p = realloc(v->v, (v->size ? 2 * v->size : 64) * v->elem);
+
+	if (p == NULL) {
+	    fprintf(stderr, "error: realloc()\n");
+	    return NULL;
+	}
+
+	v->v = p;
+	v->size = v->size ? 2 * v->size : 64;
+    }
+
+    return (U8 *) v->v + v->n++ * v->elem;
+}
+
+static int link_cb(const struct nlmsghdr *nh, struct vec *v)
+{
+    struct if_link l;
+    void *p;
+
+    if (rtnl_link(nh, &l))
+	return 0;
+
+    if ((p = vec_push(v)) == NULL)
+	return -1;
+
+    memcpy(p, &l, sizeof(l));
+    return 0;
+}
+
+static int addr_cb(const struct nlmsghdr *nh, struct vec *v)
+{
+    struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+    struct rtattr *tb[IFA_MAX + 1], *rta;
+    struct if_addr *a;
+
+    if (nh->nlmsg_type != RTM_NEWADDR
+	|| nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+	return 0;
+
+    /* an AF_UNSPEC dump has the other families too, AF_MCTP for one */
+    if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+	return 0;
+
+    rtnl_attrs(tb, IFA_MAX, IFA_RTA(ifa), IFA_PAYLOAD(nh));
+
+    /* the local address of point to point links, else the address */
+    if ((rta = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS]) == NULL
+	|| RTA_PAYLOAD(rta) > 16)
+	return 0;
+
+    if ((a = vec_push(v)) == NULL)
+	return -1;
+
+    memset(a, 0, sizeof(*a));
+    a->index = ifa->ifa_index;
+    a->family = ifa->ifa_family;
+    a->prefix = ifa->ifa_prefixlen;
+    memcpy(a->addr, RTA_DATA(rta), RTA_PAYLOAD(rta));
+    return 0;
+}
+
+/* sends a dump request of type and passes every answer to cb */
+static int rtnl_dump(int fd, U16 type, size_t hdrlen,
+		     int (*cb) (const struct nlmsghdr *, struct vec *),
+		     struct vec *v)
+{
+    static U32 seq;
+    struct {
+	struct nlmsghdr nh;
+	struct ifinfomsg body;	/* the largest of the request headers */
+    } req;
+    U8 *buf;
+    int sts = -1;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(hdrlen);
+    req.nh.nlmsg_type = type;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = ++seq;
+
+    if (send(fd, &req, req.nh.nlmsg_len, 0) < 0) {
+	fprintf(stderr, "error: netlink request: %s\n", strerror(errno));
+	return -1;
+    }
+
+    if ((buf = malloc(RTNL_BUF_LEN)) == NULL) {
+	fprintf(stderr, "error: malloc()\n");
+	return -1;
+    }
+
+    for (;;) {
+	struct nlmsghdr *nh;
+	ssize_t n = recv(fd, buf, RTNL_BUF_LEN, 0);
+
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+
+	    fprintf(stderr, "error: netlink dump: %s\n", strerror(errno));
+	    goto out;
+	}
+
+	for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (U32) n);
+	     nh = NLMSG_NEXT(nh, n)) {
+	    if (nh->nlmsg_seq != seq)
+		continue;
+
+	    if (nh->nlmsg_type == NLMSG_DONE) {
+		sts = 0;
+		goto out;
+	    }
+
+	    if (nh->nlmsg_type == NLMSG_ERROR) {
+		struct nlmsgerr *err = NLMSG_DATA(nh);
+
+		fprintf(stderr, "error: netlink dump: %s\n",
+			strerror(-err->error));
+		goto out;
+	    }
+
+	    if (cb(nh, v))
+		goto out;
+	}
+    }
+
+ out:
+    free(buf);
+    return sts;
+}
+
+/* every link through fd from rtnl_open(), their number or -1 */
+int if_links(int fd, struct if_link **links)
+{
+    struct vec v = { NULL, 0, 0, sizeof(struct if_link) };
+
+    if (rtnl_dump(fd, RTM_GETLINK, sizeof(struct ifinfomsg), link_cb, &v)) {
+	free(v.v);
+	v.v = NULL;
+	v.n = -1;
+    }
+
+    *links = v.v;
+    return v.n;
+}
+
+/* every IPv4 and IPv6 address, as if_links(); the caller frees both */
+int if_addrs(int fd, struct if_addr **addrs)
+{
+    struct vec v = { NULL, 0, 0, sizeof(struct if_addr) };
+
+    if (rtnl_dump(fd, RTM_GETADDR, sizeof(struct ifaddrmsg), addr_cb, &v)) {
+	free(v.v);
+	v.v = NULL;
+	v.n = -1;
+    }
+
+    *addrs = v.v;
+    return v.n;
+}
@@ -0,0 +1,221 @@
+/*
+ * netns.c -- capture in other network namespaces from one process
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <linux/if_packet.h>
+
+#include "pangolin.h"
+
+/*
+ * A packet socket belongs to the namespace it was created in, whatever
+ * the thread does next: if_open() steps into the namespace only for the
+ * socket() call and the interface lookup, then back. From there on the
+ * sockets of every namespace are plain descriptors in one epoll set,
+ * feeding the same decoders and output.
+ */
+
+/* the loopback has index 1 in every namespace */
+#define NETNS_LOINDEX 1
+
+/* a namespace by path, or by the PID of a process living in it */
+static int netns_fd(const char *spec)
+{
+    char path[64];
+    const char *p = spec;
+    int fd;
+
+    if (strspn(spec, "0123456789") == strlen(spec)) {
+	snprintf(path, sizeof(path), "/proc/%s/ns/net", spec);
+	p = path;
+    }
+
+    if ((fd = open(p, O_RDONLY | O_CLOEXEC)) < 0)
+	fprintf(stderr, "error: network namespace %s: %s\n", spec,
+		strerror(errno));
+
+    return fd;
+}
+
+/* runs in the namespace of spec, the caller's one restored after */
+int netns_enter(const char *spec, int *self)
+{
+    int fd;
+
+    if ((*self = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC)) < 0) {
+	fprintf(stderr, "error: cannot open own network namespace: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    if ((fd = netns_fd(spec)) < 0) {
+	close(*self);
+	return -1;
+    }
+
+    if (setns(fd, CLONE_NEWNET) < 0) {
+	fprintf(stderr, "error: setns(%s): %s\n", spec, strerror(errno));
+	close(fd);
+	close(*self);
+	return -1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* a thread left in a foreign namespace would open the wrong sockets */
+void netns_leave(int self)
+{
+    if (setns(self, CLONE_NEWNET) < 0) {
+	fprintf(stderr, "error: cannot return to own network namespace: %s\n",
+		strerror(errno));
+	abort();
+    }
+
+    close(self);
+}
+
+int netns_init(struct netns_set *set)
+{
+    memset(set, 0, sizeof(*set));
+
+    if ((set->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+	fprintf(stderr, "error: epoll_create1(): %s\n", strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+/* captures on iface inside the namespace spec */
+int netns_add(struct netns_set *set, const char *spec, const char *iface,
+	      const struct filter *filter)
+{
+    struct netns_sock *s;
+    struct epoll_event ev;
+
+    if (set->n == NETNS_MAX) {
+	fprintf(stderr, "error: more than %d network namespaces\n",
+		NETNS_MAX);
+	return -1;
+    }
+
+    s = &set->socks[set->n];
+    memset(s, 0, sizeof(*s));
+    s->spec = spec;
+    s->iface = iface;
+
+    if ((s->fd = if_open(iface, spec)) < 0)
+	return -1;
+
+    if (filter->len > 0)
+	if_filter(s->fd, (struct sock_filter *)filter->code, filter->len);
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = set->n;
+
+    if (epoll_ctl(set->epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0) {
+	fprintf(stderr, "error: epoll_ctl(): %s\n", strerror(errno));
+	close(s->fd);
+	return -1;
+    }
+
+    set->n++;
+    return 0;
+}
+
+/* as capture(), from whichever namespace has a packet */
+int netns_capture(struct netns_set *set, struct packet *packet,
+		  size_t snaplen)
+{
+    struct netns_sock *s;
+    int sts;
+
+    while (set->cur == set->nready) {
+	struct epoll_event events[NETNS_EVENTS];
+	int i, n;
+
+	n = epoll_wait(set->epfd, events, NETNS_EVENTS, -1);
+
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+
+	    fprintf(stderr, "error: epoll_wait(): %s\n", strerror(errno));
+	    return -1;
+	}
+
+	/* one packet per socket and round, so that none starves */
+	for (i = 0; i < n; i++)
+	    set->ready[i] = events[i].data.u32;
+
+	set->nready = n;
+	set->cur = 0;
+    }
+
+    s = &set->socks[set->ready[set->cur++]];
+
+    if ((sts = capture(packet, s->fd, NETNS_LOINDEX, snaplen, 0)) > 0) {
+	packet->netns = s - set->socks + 1;
+	s->packets++;
+	s->bytes += packet->len;
+    }
+
+    return sts;
+}
+
+void netns_report(const struct netns_set *set)
+{
+    int i;
+
+    fprintf(stdout, "\nNetwork namespaces\n------------------\n");
+
+    for (i = 0; i < set->n; i++) {
+	const struct netns_sock *s = &set->socks[i];
+	struct tpacket_stats stats;
+	socklen_t len = sizeof(stats);
+
+	if (getsockopt(s->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len))
+	    stats.tp_drops = 0;
+
+	fprintf(stdout, "  %-24s %-8s %10llu packets %12llu bytes %8u dropped\n",
+		s->spec, s->iface, (unsigned long long)s->packets,
+		(unsigned long long)s->bytes, stats.tp_drops);
+    }
+}
+
+void netns_close(struct netns_set *set)
+{
+    int i;
+
+    for (i = 0; i < set->n; i++)
+	if_close(set->socks[i].fd);
+
+    close(set->epfd);
+    set->n = 0;
+}
@@ -0,0 +1,403 @@
+/*
+ * output.c -- structured output: JSON Lines, CSV and binary records
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+/*
+ * Binary format: a 16 bytes header followed by fixed 64 bytes records,
+ * all integers little endian, addresses in network byte order (IPv4 as
+ * IPv4-mapped IPv6), so that a reader can mmap the file and index it.
+ *
+ * header:  0 magic "PNGL"       record:  0 u64 timestamp (ns)
+ *          4 u16 version                 8 u32 captured length
+ *          6 u16 record length          12 u32 wire length
+ *          8 u32 snaplen                16 u16 ethertype
+ *         12 u32 sampling probability   18 u8  IP protocol
+ *                                       19 u8  TCP flags
+ *                                       20 u8  l3, l4, l7 protocol ids
+ *                                       23 u8  TTL or hop limit
+ *                                       24 u8  source address [16]
+ *                                       40 u8  destination address [16]
+ *                                       56 u16 source port
+ *                                       58 u16 destination port
+ *                                       60 u16 outer VLAN TCI
+ *                                       62 u16 inner VLAN TCI
+ *
+ * The sampling probability is in parts per 2^32, the kernel threshold
+ * itself, and 0 when every packet was captured: each record stands for
+ * 2^32 / probability packets. VLAN TCIs are 0 for untagged frames.
+ *
+ * JSON output starts with a {"snaplen":N,"sample":p} record and CSV
+ * output ends each row with p, so that counts can be scaled as well.
+ */
+
+static const char *proto_names[] = {
+    "", "eth", "arp", "ip", "icmp", "tcp", "udp", "bootp", "ip6", "icmp6",
+    "gre", "vxlan", "geneve", "ipip", "http", "tls"
+};
+
+/* flush before a record could overflow the buffer */
+#define OUT_RECORD_MAX 512
+
+static void out_flush(struct output *o)
+{
+    size_t done = 0;
+    int prev = PROF(o->prof, PROF_WRITE);
+
+    PROBE2(output_flush, o->fd, o->len);
+
+    while (done < o->len) {
+	ssize_t n = write(o->fd, o->buf + done, o->len - done);
+
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+
+	    fprintf(stderr, "error: write(): %s\n", strerror(errno));
+	    break;
+	}
+
+	done += n;
+    }
+
+    o->len = 0;
+    PROF(o->prof, prev);
+}
+
+static void put_c(struct output *o, char c)
+{
+    o->buf[o->len++] = c;
+}
+
+static void put_s(struct output *o, const char *s)
+{
+    while (*s)
+	o->buf[o->len++] = *s++;
+}
+
+/* decimal, at least width digits */
+static void put_u(struct output *o, U64 v, int width)
+{
+    char tmp[20];
+    int n = 0;
+
+    do {
+	tmp[n++] = '0' + v % 10;
+	v /= 10;
+    } while (v);
+
+    while (n < width)
+	tmp[n++] = '0';
+
+    while (n)
+	o->buf[o->len++] = tmp[--n];
+}
+
+static void put_ip(struct output *o, const U32 * addr)
+{
+    const U8 *a = (const U8 *)addr;
+
+    put_u(o, a[0], 1);
+    put_c(o, '.');
+    put_u(o, a[1], 1);
+    put_c(o, '.');
+    put_u(o, a[2], 1);
+    put_c(o, '.');
+    put_u(o, a[3], 1);
+}
+
+/* source (0) or destination (1) address of an IPv4 or IPv6 packet */
+static void put_host(struct output *o, const struct packet *packet, int dst)
+{
+    const struct layers *l = &packet->layers;
+    char buf[INET6_ADDRSTRLEN];
+
+    if (l->l3_proto == PROTO_IP) {
+	put_ip(o, dst ? &l->daddr : &l->saddr);
+	return;
+    }
+
+    inet_ntop(AF_INET6, packet->base + l->l3 + (dst ? 24 : 8), buf,
+	      sizeof buf);
+    put_s(o, buf);
+}
+
+static void put_le(struct output *o, U64 v, int bytes)
+{
+    while (bytes--) {
+	o->buf[o->len++] = v & 0xFF;
+	v >>= 8;
+    }
+}
+
+static U8 tcp_flags(const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+
+    return l->l4_proto == PROTO_TCP ? packet->base[l->l4 + 13] & 0x3F : 0;
+}
+
+static void put_flags(struct output *o, U8 flags)
+{
+    static const char names[] = "FSRPAU";
+    int i;
+
+    for (i = 0; i < 6; i++)
+	if (flags & (1 << i))
+	    put_c(o, names[i]);
+}
+
+static void out_json(struct output *o, const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+
+    put_s(o, "{\"ts\":");
+    put_u(o, packet->time.tv_sec, 1);
+    put_c(o, '.');
+    put_u(o, packet->time.tv_nsec, 9);
+    put_s(o, ",\"caplen\":");
+    put_u(o, packet->caplen, 1);
+    put_s(o, ",\"len\":");
+    put_u(o, packet->len, 1);
+    put_s(o, ",\"ethertype\":");
+    put_u(o, l->ethertype, 1);
+
+    if (packet->ifindex > 0) {
+	put_s(o, ",\"ifindex\":");
+	put_u(o, packet->ifindex, 1);
+    }
+
+    if (packet->netns > 0) {
+	put_s(o, ",\"netns\":");
+	put_u(o, packet->netns, 1);
+    }
+
+    if (l->vlans) {
+	int i;
+
+	put_s(o, ",\"vlan\":[");
+
+	for (i = 0; i < l->vlans; i++) {
+	    if (i)
+		put_c(o, ',');
+
+	    put_u(o, GET16(l->vlan + i * 4 + 2) & 0x0FFF, 1);
+	}
+
+	put_c(o, ']');
+    }
+
+    if (l->tunnel) {
+	put_s(o, ",\"tunnel\":\"");
+	put_s(o, proto_names[l->tunnel]);
+	put_s(o, "\",\"vni\":");
+	put_u(o, l->vni, 1);
+    }
+
+    if (l->l3_proto == PROTO_IP || l->l3_proto == PROTO_IP6) {
+	put_s(o, ",\"src\":\"");
+	put_host(o, packet, 0);
+	put_s(o, "\",\"dst\":\"");
+	put_host(o, packet, 1);
+	put_s(o, "\",\"ip_proto\":");
+	put_u(o, l->ip_proto, 1);
+    }
+
+    if (l->l4_proto) {
+	put_s(o, ",\"proto\":\"");
+	put_s(o, proto_names[l->l7_proto ? l->l7_proto : l->l4_proto]);
+	put_c(o, '"');
+    } else if (l->l3_proto) {
+	put_s(o, ",\"proto\":\"");
+	put_s(o, proto_names[l->l3_proto]);
+	put_c(o, '"');
+    }
+
+    if (l->l4_proto == PROTO_TCP || l->l4_proto == PROTO_UDP) {
+	put_s(o, ",\"sport\":");
+	put_u(o, l->sport, 1);
+	put_s(o, ",\"dport\":");
+	put_u(o, l->dport, 1);
+    }
+
+    if (l->l4_proto == PROTO_TCP) {
+	put_s(o, ",\"flags\":\"");
+	put_flags(o, tcp_flags(packet));
+	put_c(o, '"');
+    }
+
+    put_s(o, "}\n");
+}
+
+static void out_csv(struct output *o, const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+    U8 proto = l->l7_proto ? l->l7_proto : l->l4_proto ? l->l4_proto :
+	l->l3_proto;
+
+    put_u(o, packet->time.tv_sec, 1);
+    put_c(o, '.');
+    put_u(o, packet->time.tv_nsec, 9);
+    put_c(o, ',');
+    put_u(o, packet->caplen, 1);
+    put_c(o, ',');
+    put_u(o, packet->len, 1);
+    put_c(o, ',');
+    put_u(o, l->ethertype, 1);
+    put_c(o, ',');
+    put_s(o, proto_names[proto]);
+    put_c(o, ',');
+
+    if (l->l3_proto == PROTO_IP || l->l3_proto == PROTO_IP6) {
+	put_host(o, packet, 0);
+	put_c(o, ',');
+	put_host(o, packet, 1);
+    } else {
+	put_c(o, ',');
+    }
+
+    put_c(o, ',');
+
+    if (l->l4_proto == PROTO_TCP || l->l4_proto == PROTO_UDP) {
+	put_u(o, l->sport, 1);
+	put_c(o, ',');
+	put_u(o, l->dport, 1);
+    } else {
+	put_c(o, ',');
+    }
+
+    put_c(o, ',');
+    put_flags(o, tcp_flags(packet));
+    put_c(o, ',');
+    put_s(o, o->sample);
+    put_c(o, '\n');
+}
+
+static void put_addr16(struct output *o, const U32 * addr)
+{
+    static const U8 mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+    memcpy(o->buf + o->len, mapped, 12);
+    memcpy(o->buf + o->len + 12, addr, 4);
+    o->len += 16;
+}
+
+static void out_binary(struct output *o, const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+
+    put_le(o, (U64) packet->time.tv_sec * 1000000000 + packet->time.tv_nsec,
+	   8);
+    put_le(o, packet->caplen, 4);
+    put_le(o, packet->len, 4);
+    put_le(o, l->ethertype, 2);
+    put_le(o, l->ip_proto, 1);
+    put_le(o, tcp_flags(packet), 1);
+    put_le(o, l->l3_proto, 1);
+    put_le(o, l->l4_proto, 1);
+    put_le(o, l->l7_proto, 1);
+
+    if (l->l3_proto == PROTO_IP) {
+	put_le(o, packet->base[l->l3 + 8], 1);
+	put_addr16(o, &l->saddr);
+	put_addr16(o, &l->daddr);
+    } else if (l->l3_proto == PROTO_IP6) {
+	put_le(o, packet->base[l->l3 + 7], 1);
+	memcpy(o->buf + o->len, packet->base + l->l3 + 8, 32);
+	o->len += 32;
+    } else {
+	put_le(o, 0, 1);
+	memset(o->buf + o->len, 0, 32);
+	o->len += 32;
+    }
+
+    put_le(o, l->sport, 2);
+    put_le(o, l->dport, 2);
+    put_le(o, l->vlans > 0 ? GET16(l->vlan + 2) : 0, 2);
+    put_le(o, l->vlans > 1 ? GET16(l->vlan + 6) : 0, 2);
+}
+
+int output_open(struct output *o, int format, int fd, U32 snaplen, U32 sample)
+{
+    o->format = format;
+    o->fd = fd;
+    o->prof = NULL;
+    o->len = 0;
+
+    if (sample)
+	snprintf(o->sample, sizeof(o->sample), "%.9g", sample / SAMPLE_SCALE);
+    else
+	strcpy(o->sample, "1");
+
+    switch (format) {
+    case OUT_JSON:
+	put_s(o, "{\"snaplen\":");
+	put_u(o, snaplen, 1);
+	put_s(o, ",\"sample\":");
+	put_s(o, o->sample);
+	put_s(o, "}\n");
+	break;
+
+    case OUT_CSV:
+	put_s(o, "ts,caplen,len,ethertype,proto,src,dst,sport,dport,flags,"
+	      "sample\n");
+	break;
+
+    case OUT_BINARY:
+	put_s(o, "PNGL");
+	put_le(o, OUT_VERSION, 2);
+	put_le(o, OUT_RECORD_LEN, 2);
+	put_le(o, snaplen, 4);
+	put_le(o, sample, 4);
+	break;
+    }
+
+    return 0;
+}
+
+void output_packet(struct output *o, const struct packet *packet)
+{
+    switch (o->format) {
+    case OUT_JSON:
+	out_json(o, packet);
+	break;
+
+    case OUT_CSV:
+	out_csv(o, packet);
+	break;
+
+    case OUT_BINARY:
+	out_binary(o, packet);
+	break;
+    }
+
+    if (o->len > OUT_BUF_LEN - OUT_RECORD_MAX)
+	out_flush(o);
+}
+
+void output_close(struct output *o)
+{
+    out_flush(o);
+}
@@ -23,24 +23,17 @@
 /* for arp_hrd2str() */
 #include <net/if_arp.h>
 
+#include "config.h"
 #include "pangolin.h"
 
 #define ARP_HDR_LEN 8
 
-struct arp_hdr {
-    U16 arp_hrd;		/* format of hardware address. */
-    U16 arp_pro;		/* format of protocol address. */
-    U8 arp_hln;			/* hardware length address. */
-    U8 arp_pln;			/* protocol length address. */
-    U16 arp_op;			/* Opcode. */
-
-#ifdef VARIABLE
-    U8 arp_sha[];		/* Sender Hardware Address. */
-    U8 arp_spa[];		/* Sender Protocol Address. */
-    U8 arp_tha[];		/* Target Hardware Address. */
-    U8 arp_tpa[];		/* Target Protocol Address. */
-#endif
-};
+/* field offsets, followed by sha, spa, tha and tpa */
+#define ARP_HRD 0		/* format of hardware address. */
+#define ARP_PRO 2		/* format of protocol address. */
+#define ARP_HLN 4		/* hardware length address. */
+#define ARP_PLN 5		/* protocol length address. */
+#define ARP_OP 6		/* Opcode. */
 
 static const char *arp_hrd2str(U16 hrd)
 {
@@ -172,58 +165,65 @@ static const char *arp_op2str(U16 op)
     }
 }
 
-extern void eth_mac_addr(U8 *, char *, size_t);	// TODO: declare in pangolin.h 
+int arp_dissect(struct packet *packet, U16 off)
+{
+    const U8 *h = packet->base + off;
+
+    if ((U32) off + ARP_HDR_LEN > packet->caplen)
+	return -1;
+
+    /* addresses are variable length */
+    if ((U32) off + ARP_HDR_LEN + 2 * (h[ARP_HLN] + h[ARP_PLN]) >
+	packet->caplen)
+	return -1;
+
+    packet->layers.l3 = off;
+    packet->layers.l3_proto = PROTO_ARP;
+    return 0;
+}
 
 void arp_dump(struct packet *packet, struct context *ctx)
 {
-    struct arp_hdr hdr;
+    const U8 *h = packet->base + packet->layers.l3;
+    const U8 *sha = h + ARP_HDR_LEN;
+    const U8 *spa = sha + h[ARP_HLN];
+    const U8 *tha = spa + h[ARP_PLN];
+    const U8 *tpa = tha + h[ARP_HLN];
+    U16 op = GET16(h + ARP_OP);
 
-    memset(&hdr, 0, ARP_HDR_LEN);
-    memcpy(&hdr, packet->data, ARP_HDR_LEN);
-    packet->data += ARP_HDR_LEN;
+    PROBE2(decode_entry, PROTO_ARP, packet->len);
 
-    if (TOHOST16(hdr.arp_pro) == 0x0800) {
-	switch (TOHOST16(hdr.arp_op)) {
+    if (GET16(h + ARP_PRO) == 0x0800 && h[ARP_PLN] == 4 && h[ARP_HLN] == 6) {
+	switch (op) {
 	case ARPOP_REQUEST:
 	    {
-		struct in_addr tpa;
-		struct in_addr spa;
+		struct in_addr in;
 		U8 src[16], dst[16];
 
-		memcpy(&tpa,
-		       packet->data + (2 * hdr.arp_hln) +
-		       hdr.arp_pln, sizeof(struct in_addr));
-		memcpy(&spa, packet->data + hdr.arp_hln,
-		       sizeof(struct in_addr));
-		memcpy(dst, inet_ntoa(tpa), 16);
-		memcpy(src, inet_ntoa(spa), 16);
+		memcpy(&in, tpa, sizeof(struct in_addr));
+		memcpy(dst, inet_ntoa(in), 16);
+		memcpy(&in, spa, sizeof(struct in_addr));
+		memcpy(src, inet_ntoa(in), 16);
 		ctx->out("arp request %s tell %s ", dst, src);
 		break;
 	    }
 
 	case ARPOP_REPLY:
 	    {
-		struct in_addr spa;
-		U8 sha[6];
+		struct in_addr in;
 		char src[20];
-		eth_mac_addr(sha, src, sizeof src);
 
-		memcpy(sha, packet->data, 6);
-		memcpy(&spa, packet->data + hdr.arp_hln,
-		       sizeof(struct in_addr));
-		ctx->out("arp reply %s is %s", inet_ntoa(spa), src);
+		eth_mac_addr(sha, src, sizeof src);
+		memcpy(&in, spa, sizeof(struct in_addr));
+		ctx->out("arp reply %s is %s", inet_ntoa(in), src);
 		break;
 	    }
 
 	case ARPOP_RREQUEST:
 	    {
-		U8 sha[6];
-		U8 tha[6];
 		char src[20];
 		char dst[20];
 
-		memcpy(sha, packet->data, 6);
-		memcpy(tha, packet->data + hdr.arp_hln + hdr.arp_pln, 6);
 		eth_mac_addr(sha, src, sizeof src);
 		eth_mac_addr(tha, dst, sizeof dst);
 		ctx->out("rarp request %s tell %s", src, dst);
@@ -232,26 +232,23 @@ void arp_dump(struct packet *packet, struct context *ctx)
 
 	case ARPOP_RREPLY:
 	    {
-		U8 tha[6];
+		struct in_addr in;
 		char src[20];
-		struct in_addr tpa;
 
-		memcpy(tha, packet->data + hdr.arp_hln + hdr.arp_pln, 6);
-		memcpy(&tpa,
-		       packet->data + (2 * hdr.arp_hln) +
-		       hdr.arp_pln, sizeof(struct in_addr));
 		eth_mac_addr(tha, src, sizeof src);
-		ctx->out("rarp reply %s is %s", src, inet_ntoa(tpa));
+		memcpy(&in, tpa, sizeof(struct in_addr));
+		ctx->out("rarp reply %s is %s", src, inet_ntoa(in));
 		break;
 	    }
 
 	default:
-	    ctx->out("op=%d", TOHOST16(hdr.arp_pro) & 0xFFFF);
+	    ctx->out("op=%d", op);
 	}
     } else {
 	ctx->out("%s hardware: %s (#%d) (skip)",
-		 arp_op2str(TOHOST16(hdr.arp_op)),
-		 arp_hrd2str(TOHOST16(hdr.arp_hrd)),
-		 TOHOST16(hdr.arp_hrd) & 0xFFFF);
+		 arp_op2str(op), arp_hrd2str(GET16(h + ARP_HRD)),
+		 GET16(h + ARP_HRD));
     }
+
+    PROBE2(decode_return, PROTO_ARP, packet->len);
 }
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "config.h"
 #include "pangolin.h"
 
 /*
@@ -50,23 +51,34 @@
  * +---------------------------------------------------------------+
  */
 
-struct bootp_hdr {
-    U8 bootp_op;
-    U8 bootp_htype;
-    U8 bootp_hlen;
-    U8 bootp_hops;
-    U32 bootp_id;
-    U16 bootp_secs;
-    U16 bootp_unused;
-    U32 bootp_ca;
-    U32 bootp_ya;
-    U32 bootp_sa;
-    U32 bootp_ga;
-    U8 bootp_cha[16];
-    U8 bootp_sname[64];
-    U8 bootp_file[128];
-    U8 bootp_vendor[64];
-};
+#define BOOTP_HDR_LEN 236	/* up to the options */
+
+/* field offsets */
+#define BOOTP_OP 0
+#define BOOTP_HTYPE 1
+#define BOOTP_HLEN 2
+#define BOOTP_HOPS 3
+#define BOOTP_ID 4
+#define BOOTP_SECS 8
+#define BOOTP_FLAGS 10
+#define BOOTP_CA 12
+#define BOOTP_YA 16
+#define BOOTP_SA 20
+#define BOOTP_GA 24
+#define BOOTP_CHA 28
+#define BOOTP_SNAME 44
+#define BOOTP_FILE 108
+#define BOOTP_COOKIE 236	/* 99.130.83.99 for DHCP */
+#define BOOTP_OPTIONS 240
+
+/* DHCP options (RFC 2132) */
+#define DHCP_PAD 0
+#define DHCP_HOSTNAME 12
+#define DHCP_REQUESTED 50
+#define DHCP_LEASE 51
+#define DHCP_TYPE 53
+#define DHCP_SERVER 54
+#define DHCP_END 255
 
 static const char *bootp_op2str(U8 op)
 {
@@ -84,7 +96,12 @@ static const char *bootp_op2str(U8 op)
     }
 }
 
-static void bootp_ip(U8 * addr, U32 * raw)
+static const char *dhcp_types[] = {
+    "BOOTP", "DISCOVER", "OFFER", "REQUEST", "DECLINE", "ACK", "NAK",
+    "RELEASE", "INFORM"
+};
+
+static void bootp_ip(U8 * addr, const U8 * raw)
 {
     struct in_addr in;
 
@@ -92,17 +109,125 @@ static void bootp_ip(U8 * addr, U32 * raw)
     memcpy(addr, inet_ntoa(in), 16);
 }
 
-void bootp_dump(struct packet *packet, struct context *ctx)
+/*
+ * Walks the DHCP options of the BOOTP message at off: every option is
+ * checked against the captured bytes before it is read, so truncated
+ * or malformed lists stop the walk instead of overrunning. Options in
+ * the sname and file fields (overload) are not followed.
+ */
+int dhcp_parse(const struct packet *packet, U16 off, struct dhcp *dhcp)
+{
+    const U8 *h = packet->base + off;
+    U32 end = packet->caplen - off, i;
+
+    memset(dhcp, 0, sizeof(*dhcp));
+
+    if ((U32) off + BOOTP_HDR_LEN > packet->caplen)
+	return -1;
+
+    memcpy(dhcp->chaddr, h + BOOTP_CHA, 6);
+    memcpy(&dhcp->ciaddr, h + BOOTP_CA, 4);
+    memcpy(&dhcp->yiaddr, h + BOOTP_YA, 4);
+
+    /* plain BOOTP */
+    if (end < BOOTP_OPTIONS || GET32(h + BOOTP_COOKIE) != 0x63825363)
+	return 0;
+
+    for (i = BOOTP_OPTIONS; i < end && h[i] != DHCP_END;) {
+	U8 code = h[i], len;
+	const U8 *v;
+
+	if (code == DHCP_PAD) {
+	    i++;
+	    continue;
+	}
+
+	if (i + 2 > end || i + 2 + h[i + 1] > end)
+	    break;
+
+	len = h[i + 1];
+	v = h + i + 2;
+
+	switch (code) {
+	case DHCP_TYPE:
+	    if (len == 1)
+		dhcp->type = v[0];
+	    break;
+
+	case DHCP_REQUESTED:
+	    if (len == 4)
+		memcpy(&dhcp->requested, v, 4);
+	    break;
+
+	case DHCP_SERVER:
+	    if (len == 4)
+		memcpy(&dhcp->server, v, 4);
+	    break;
+
+	case DHCP_LEASE:
+	    if (len == 4)
+		dhcp->lease = GET32(v);
+	    break;
+
+	case DHCP_HOSTNAME:
+	    dhcp->hostname = off + i + 2;
+	    dhcp->hostname_len = len;
+	    break;
+	}
+
+	i += 2 + len;
+    }
+
+    return 0;
+}
+
+int bootp_dissect(struct packet *packet, U16 off)
+{
+    if ((U32) off + BOOTP_HDR_LEN > packet->caplen)
+	return -1;
+
+    packet->layers.l7_proto = PROTO_BOOTP;
+    return 0;
+}
+
+/* src and dst are the IP addresses, the BOOTP ones are fields */
+void bootp_dump(struct packet *packet, U8 * src, U8 * dst,
+		struct context *ctx)
 {
-    struct bootp_hdr hdr;
-    U8 sa[16], ca[16], ya[16], ga[16];
-
-    memset(&hdr, 0, sizeof(struct bootp_hdr));
-    memcpy(&hdr, packet->data, sizeof(struct bootp_hdr));
-    bootp_ip(sa, &hdr.bootp_sa);
-    bootp_ip(ca, &hdr.bootp_ca);
-    bootp_ip(ya, &hdr.bootp_ya);
-    bootp_ip(ga, &hdr.bootp_ga);
-    ctx->out("BOOTP/DHCP %s: %s > %s ip %s gw %s",
-	     bootp_op2str(hdr.bootp_op), sa, ca, ya, ga);
+    const U8 *h = packet->base + packet->layers.l7;
+    U8 ya[16], ga[16];
+    char mac[18], name[256];
+    struct dhcp dhcp;
+
+    PROBE2(decode_entry, PROTO_BOOTP, packet->len);
+
+    dhcp_parse(packet, packet->layers.l7, &dhcp);
+    eth_mac_addr(dhcp.chaddr, mac, sizeof mac);
+    bootp_ip(ya, h + BOOTP_YA);
+    bootp_ip(ga, h + BOOTP_GA);
+    ctx->out("BOOTP/DHCP %s %s: %s > %s chaddr %s xid 0x%08x ip %s gw %s",
+	     bootp_op2str(h[BOOTP_OP]),
+	     dhcp.type < sizeof(dhcp_types) / sizeof(*dhcp_types) ?
+	     dhcp_types[dhcp.type] : "unknown", src, dst, mac,
+	     GET32(h + BOOTP_ID), ya, ga);
+
+    if (dhcp.requested) {
+	bootp_ip(ya, (const U8 *)&dhcp.requested);
+	ctx->out(" requested %s", ya);
+    }
+
+    if (dhcp.server) {
+	bootp_ip(ya, (const U8 *)&dhcp.server);
+	ctx->out(" server %s", ya);
+    }
+
+    if (dhcp.lease)
+	ctx->out(" lease %us", dhcp.lease);
+
+    if (dhcp.hostname_len) {
+	printable(name, packet->base + dhcp.hostname, dhcp.hostname_len);
+	ctx->out(" hostname %s", name);
+    }
+
+    PROBE2(decode_return, PROTO_BOOTP, packet->len);
 }
@@ -21,22 +21,33 @@
 #include <string.h>
 #include <time.h>
 
+#include <net/if.h>
+
+#include "config.h"
 #include "pangolin.h"
 
 /* Ethernet header length as defined by 802.3 standard */
 #define ETH_ADDR_LEN 6
 #define ETH_HDR_LEN 14
 
-struct eth_hdr {
-    U8 eth_dhost[ETH_ADDR_LEN];
-    U8 eth_shost[ETH_ADDR_LEN];
-    U16 eth_type;
-};
+/* field offsets */
+#define ETH_DHOST 0
+#define ETH_SHOST 6
+#define ETH_TYPE 12
 
 /* supported values for eth_type */
 #define ETH_TYPE_IP   0x0800	/* IPv4  */
 #define ETH_TYPE_ARP  0x0806	/* ARP   */
 #define ETH_TYPE_RARP 0x8035	/* RARP  */
+#define ETH_TYPE_IP6  0x86DD	/* IPv6  */
+#define ETH_TYPE_VLAN 0x8100	/* 802.1Q */
+#define ETH_TYPE_QINQ 0x88A8	/* 802.1ad */
+#define ETH_TYPE_QINQ_OLD 0x9100	/* pre-standard QinQ */
+
+#define VLAN_TAG_LEN 4
+
+#define IS_VLAN(t) ((t) == ETH_TYPE_VLAN || (t) == ETH_TYPE_QINQ || \
+		    (t) == ETH_TYPE_QINQ_OLD)
 
 static struct eth_type {
     U16 begin;
@@ -202,7 +213,7 @@ static const char *eth_type2str(short n)
     return res;
 }
 
-static const char *timestamp(struct timeval *tv, char *buf, size_t bufsize)
+static const char *timestamp(struct timespec *tv, char *buf, size_t bufsize)
 {
     size_t c;
     struct tm *h;
@@ -213,7 +224,51 @@ static const char *timestamp(struct timeval *tv, char *buf, size_t bufsize)
     return buf;
 }
 
-void eth_mac_addr(U8 * mac, char *buf, size_t bufsize)
+/* names of the last interfaces seen, by index */
+#define IFNAMES 64
+
+static struct {
+    int index;
+    char name[IF_NAMESIZE];
+} ifnames[IFNAMES];
+
+static const char *eth_ifname(int index)
+{
+    int i = index % IFNAMES;
+
+    if (ifnames[i].index != index) {
+	if (if_indextoname(index, ifnames[i].name) == NULL)
+	    snprintf(ifnames[i].name, sizeof(ifnames[i].name), "#%d", index);
+
+	ifnames[i].index = index;
+    }
+
+    return ifnames[i].name;
+}
+
+/* index was renamed: looked up again next time */
+void eth_ifname_forget(int index)
+{
+    if (ifnames[index % IFNAMES].index == index)
+	ifnames[index % IFNAMES].index = 0;
+}
+
+/* appends the address last claimed through ARP by mac to buf */
+static void eth_neigh(struct neigh_table *t, const U8 * mac,
+		      const struct packet *packet, char *buf, size_t bufsize)
+{
+    U32 ip = neigh_ip(t, mac, packet->time.tv_sec);
+    struct in_addr in;
+    size_t len = strlen(buf);
+
+    if (ip == 0)
+	return;
+
+    in.s_addr = ip;
+    snprintf(buf + len, bufsize - len, " (%s)", inet_ntoa(in));
+}
+
+void eth_mac_addr(const U8 * mac, char *buf, size_t bufsize)
 {
     if (!(mac[5] ^ 0xFF) && !(mac[0] ^ 0xFF)) {
 	int x = mac[1] ^ mac[2] ^ mac[3] ^ mac[4];
@@ -231,67 +286,177 @@ void eth_mac_addr(U8 * mac, char *buf, size_t bufsize)
 
 static void eth_dump_raw(struct packet *packet, struct context *ctx)
 {
-    int i;
+    U32 i, n;
+
+    n = packet->caplen < 200 ? packet->caplen : 200;
 
-    for (i = 0; i < 200; i++) {
-	ctx->out("%02x ", packet->data[i]);
+    for (i = 0; i < n; i++) {
+	ctx->out("%02x ", packet->base[i]);
     }
 
     ctx->out("\n");
 }
 
+/*
+ * Dissects the ethernet frame at off: the outer one, or one carried
+ * by a tunnel.
+ */
+int eth_dissect(struct packet *packet, U16 off, int depth)
+{
+    struct layers *l = &packet->layers;
+    U8 *tag;
+
+    if ((U32) off + ETH_HDR_LEN > packet->caplen)
+	return -1;
+
+    if (off == 0 && packet->type)
+	l->ethertype = packet->type;
+    else
+	l->ethertype = GET16(packet->base + off + ETH_TYPE);
+
+    off += ETH_HDR_LEN;
+
+    /* then the 802.1Q/802.1ad stack still in the frame */
+    while (IS_VLAN(l->ethertype)) {
+	if (l->vlans == VLAN_MAX || (U32) off + VLAN_TAG_LEN > packet->caplen)
+	    return -1;
+
+	tag = l->vlan + l->vlans * VLAN_TAG_LEN;
+	memcpy(tag, packet->base + off - 2, 2);
+	memcpy(tag + 2, packet->base + off, 2);
+	l->vlans++;
+	l->ethertype = GET16(packet->base + off + 2);
+	off += VLAN_TAG_LEN;
+    }
+
+    if (depth < DEPTH_L3)
+	return 0;
+
+    switch (l->ethertype) {
+    case ETH_TYPE_IP:
+	ip_dissect(packet, off, depth);
+	break;
+
+    case ETH_TYPE_IP6:
+	ip6_dissect(packet, off, depth);
+	break;
+
+    case ETH_TYPE_ARP:
+    case ETH_TYPE_RARP:
+	arp_dissect(packet, off);
+	break;
+    }
+
+    return 0;
+}
+
+/*
+ * Fills packet->layers in a single pass over the headers, without
+ * copying them, and stops at depth.
+ */
+void dissect(struct packet *packet, int depth)
+{
+    struct layers *l = &packet->layers;
+
+    memset(l, 0, sizeof(struct layers));
+
+    /* the tag stripped by the kernel was the outermost one */
+    if (packet->vlan_tpid) {
+	l->vlan[0] = packet->vlan_tpid >> 8;
+	l->vlan[1] = packet->vlan_tpid & 0xFF;
+	l->vlan[2] = packet->vlan_tci >> 8;
+	l->vlan[3] = packet->vlan_tci & 0xFF;
+	l->vlans = 1;
+    }
+
+    eth_dissect(packet, 0, depth);
+}
+
 void eth_dump(struct packet *packet, struct context *ctx)
 {
+    PROBE2(decode_entry, PROTO_ETH, packet->len);
+
     if (ctx->dump_raw_packet) {
 	eth_dump_raw(packet, ctx);
+	PROBE2(decode_return, PROTO_ETH, packet->len);
 	return;
     }
     
-    struct eth_hdr hdr;
-    U16 type;
-    U8 s;
+    struct layers *l = &packet->layers;
+    U16 type = l->ethertype;
+    U8 s, i;
     char buffer[9];
 
-    if (!packet->type) {
-	memset(&hdr, 0, ETH_HDR_LEN);
-	memcpy(&hdr, packet->data, ETH_HDR_LEN);
-	type = TOHOST16(hdr.eth_type);
-    } else {
-	type = TOHOST16(packet->type);
-    }
-
     s = packet->time.tv_sec % 60;
     ctx->out("%s:%c%2.6f ", timestamp(&packet->time, buffer, sizeof buffer),
-	     s < 10 ? '0' : '\0', s + (float)packet->time.tv_usec / 1000000);
+	     s < 10 ? '0' : '\0', s + (float)packet->time.tv_nsec / 1000000000);
+
+    /* names in other namespaces are not ours to look up */
+    if (ctx->netns && packet->netns > 0) {
+	const struct netns_sock *s = &ctx->netns->socks[packet->netns - 1];
+
+	if (strcmp(s->iface, IF_ANY) == 0)
+	    ctx->out("%s:#%d ", s->spec, packet->ifindex);
+	else
+	    ctx->out("%s:%s ", s->spec, s->iface);
+    } else if (ctx->print_ifname && packet->ifindex > 0)
+	ctx->out("%s ", eth_ifname(packet->ifindex));
 
     if (ctx->print_mac_addr) {
-	char src[20];
-	char dst[20];
-	eth_mac_addr(hdr.eth_shost, src, sizeof src);
-	eth_mac_addr(hdr.eth_dhost, dst, sizeof dst);
+	char src[40];
+	char dst[40];
+	eth_mac_addr(packet->base + ETH_SHOST, src, sizeof src);
+	eth_mac_addr(packet->base + ETH_DHOST, dst, sizeof dst);
+
+	if (ctx->neigh) {
+	    eth_neigh(ctx->neigh, packet->base + ETH_SHOST, packet, src,
+		      sizeof src);
+	    eth_neigh(ctx->neigh, packet->base + ETH_DHOST, packet, dst,
+		      sizeof dst);
+	}
+
 	ctx->out("%s > %s: ", src, dst);
     }
 
+    for (i = 0; i < l->vlans; i++) {
+	U8 *tag = l->vlan + i * VLAN_TAG_LEN;
+
+	ctx->out("%s vlan %d p %d, ",
+		 GET16(tag) == ETH_TYPE_VLAN ? "802.1Q" : "802.1ad",
+		 GET16(tag + 2) & 0x0FFF, tag[2] >> 5);
+    }
+
+    if (l->tunnel)
+	tunnel_dump(packet, ctx);
+
     if (type <= 0x05DC) {
 	ctx->out("IEEE 802.3 Length len=%d", type & 0xFFFF);
     } else {
-	packet->data += ETH_HDR_LEN;
-
-	switch (type) {
-	case ETH_TYPE_IP:
+	switch (l->l3_proto) {
+	case PROTO_IP:
 	    ip_dump(packet, ctx);
 	    break;
 
-	case ETH_TYPE_ARP:
-	case ETH_TYPE_RARP:
+	case PROTO_IP6:
+	    ip6_dump(packet, ctx);
+	    break;
+
+	case PROTO_ARP:
 	    arp_dump(packet, ctx);
 	    break;
 
 	default:
-	    ctx->out("%s (skip)", eth_type2str(type));
+	    if (type == ETH_TYPE_IP || type == ETH_TYPE_IP6
+		|| type == ETH_TYPE_ARP || type == ETH_TYPE_RARP)
+		ctx->out("%s (truncated)", type == ETH_TYPE_IP ? "ip" :
+			 type == ETH_TYPE_IP6 ? "ip6" : "arp");
+	    else
+		ctx->out("%s (skip)", eth_type2str(type));
 	    break;
 	}
     }
 
     ctx->out("\n");
+
+    PROBE2(decode_return, PROTO_ETH, packet->len);
 }
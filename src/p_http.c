@@ -0,0 +1,273 @@
+/*
+ * p_http.c -- HTTP/1.x request and status lines, Host and Content-Length
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+/*
+ * Only the first segment of a message is looked at: the request or
+ * status line and the headers it holds. Fields are offsets into the
+ * packet, nothing is copied or allocated.
+ */
+
+#define HTTP_PRINT_MAX 80	/* bytes of a field shown by http_dump() */
+
+/* offset of the first c in p[i, end), end if none */
+static U32 http_find(const U8 *p, U32 i, U32 end, U8 c)
+{
+#if defined(__SSE2__)
+    __m128i needle = _mm_set1_epi8(c);
+
+    for (; i + 16 <= end; i += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+	int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+
+	if (mask)
+	    return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < end; i++)
+	if (p[i] == c)
+	    break;
+
+    return i;
+}
+
+static int is_method(const U8 *p, U32 len)
+{
+    U32 i;
+
+    if (len == 0 || len > 16)
+	return 0;
+
+    for (i = 0; i < len; i++)
+	if (p[i] < 'A' || p[i] > 'Z')
+	    return 0;
+
+    return 1;
+}
+
+/* "HTTP/1.0 200" or "GET / HTTP/1.1": enough to tell a message start */
+int http_dissect(struct packet *packet, U16 off)
+{
+    const U8 *p = packet->base + off;
+    U32 len, sp;
+
+    if (off >= packet->caplen)
+	return -1;
+
+    len = packet->caplen - off;
+
+    if (len >= 12 && memcmp(p, "HTTP/1.", 7) == 0 && p[8] == ' ') {
+	packet->layers.l7_proto = PROTO_HTTP;
+	return 0;
+    }
+
+    sp = http_find(p, 0, len < 17 ? len : 17, ' ');
+
+    if (sp < len && is_method(p, sp)) {
+	packet->layers.l7_proto = PROTO_HTTP;
+	return 0;
+    }
+
+    return -1;
+}
+
+static int header_is(const U8 *p, U32 len, const char *name)
+{
+    return len == strlen(name) && strncasecmp((const char *)p, name, len) == 0;
+}
+
+static U32 trim(const U8 *p, U32 i, U32 end)
+{
+    while (end > i && (p[end - 1] == ' ' || p[end - 1] == '\t'
+		       || p[end - 1] == '\r'))
+	end--;
+
+    return end;
+}
+
+/* offsets are from the start of the packet */
+int http_parse(const struct packet *packet, struct http *http)
+{
+    const U8 *p = packet->base;
+    U32 i = packet->layers.l7, end = packet->caplen, eol, sp, sp2;
+
+    memset(http, 0, sizeof(*http));
+    http->length = HTTP_LENGTH_NONE;
+
+    if (packet->layers.l7_proto != PROTO_HTTP)
+	return -1;
+
+    eol = http_find(p, i, end, '\n');
+    sp = http_find(p, i, eol, ' ');
+
+    if (sp == eol)
+	return -1;
+
+    if (memcmp(p + i, "HTTP/1.", 7) == 0) {
+	http->response = 1;
+
+	if (sp + 4 > eol)
+	    return -1;
+
+	for (sp2 = sp + 1; sp2 < sp + 4; sp2++) {
+	    if (p[sp2] < '0' || p[sp2] > '9')
+		return -1;
+
+	    http->status = http->status * 10 + p[sp2] - '0';
+	}
+    } else {
+	sp2 = http_find(p, sp + 1, eol, ' ');
+	http->method = i;
+	http->method_len = sp - i;
+	http->uri = sp + 1;
+	http->uri_len = sp2 - sp - 1;
+    }
+
+    /* header lines, up to the empty one or the end of the segment */
+    for (i = eol + 1; i < end; i = eol + 1) {
+	U32 colon, v;
+
+	eol = http_find(p, i, end, '\n');
+
+	if (trim(p, i, eol) == i)
+	    break;
+
+	colon = http_find(p, i, eol, ':');
+
+	if (colon == eol)
+	    continue;
+
+	for (v = colon + 1; v < eol && (p[v] == ' ' || p[v] == '\t'); v++) ;
+
+	if (header_is(p + i, colon - i, "host")) {
+	    http->host = v;
+	    http->host_len = trim(p, v, eol) - v;
+	} else if (header_is(p + i, colon - i, "content-length")) {
+	    http->length = 0;
+
+	    for (; v < eol && p[v] >= '0' && p[v] <= '9'; v++)
+		http->length = http->length * 10 + p[v] - '0';
+	}
+    }
+
+    return 0;
+}
+
+/* at most HTTP_PRINT_MAX bytes of a field */
+static const char *http_field(const U8 *p, U16 len, char *buf)
+{
+    printable(buf, p, len < HTTP_PRINT_MAX ? len : HTTP_PRINT_MAX);
+    return buf;
+}
+
+void http_dump(struct packet *packet, struct context *ctx)
+{
+    const U8 *p = packet->base;
+    char m[HTTP_PRINT_MAX + 1], h[HTTP_PRINT_MAX + 1], u[HTTP_PRINT_MAX + 1];
+    struct http http;
+
+    PROBE2(decode_entry, PROTO_HTTP, packet->len);
+
+    if (http_parse(packet, &http)) {
+	ctx->out("http (malformed)");
+	PROBE2(decode_return, PROTO_HTTP, packet->len);
+	return;
+    }
+
+    if (http.response)
+	ctx->out("http %u", http.status);
+    else
+	ctx->out("http %s %s%s", http_field(p + http.method, http.method_len, m),
+		 http_field(p + http.host, http.host_len, h),
+		 http_field(p + http.uri, http.uri_len, u));
+
+    if (http.length != HTTP_LENGTH_NONE)
+	ctx->out(" len %u", http.length);
+
+    PROBE2(decode_return, PROTO_HTTP, packet->len);
+}
+
+/* requests per Host and path, without the query */
+void http_record(struct http_stats *st, const struct packet *packet)
+{
+    const U8 *p = packet->base;
+    struct http http;
+    struct counter *c;
+    U32 h, host, path;
+
+    if (http_parse(packet, &http))
+	return;
+
+    if (http.response) {
+	st->responses++;
+	st->status[http.status < 600 ? http.status : 0]++;
+	return;
+    }
+
+    st->requests++;
+    path = http_find(p, http.uri, http.uri + http.uri_len, '?') - http.uri;
+    h = counter_hash(p + http.host, http.host_len, COUNTER_SEED);
+    h = counter_hash(p + http.uri, path, h);
+
+    if ((c = counter_get(&st->endpoints, h)) == NULL)
+	return;
+
+    if (c->count++ == 0) {
+	host = http.host_len < COUNTER_NAME_MAX ? http.host_len :
+	    COUNTER_NAME_MAX;
+
+	if (host + path > COUNTER_NAME_MAX)
+	    path = COUNTER_NAME_MAX - host;
+
+	printable(c->name, p + http.host, host);
+	printable(c->name + host, p + http.uri, path);
+    }
+}
+
+void http_report(const struct http_stats *st)
+{
+    U32 i;
+
+    fprintf(stdout, "\nHTTP\n----\n");
+    fprintf(stdout, "\n%llu requests, %llu responses\n",
+	    (unsigned long long)st->requests,
+	    (unsigned long long)st->responses);
+
+    for (i = 1; i < 600; i++)
+	if (st->status[i])
+	    fprintf(stdout, "  status %3u: %llu\n", i,
+		    (unsigned long long)st->status[i]);
+
+    if (st->status[0])
+	fprintf(stdout, "  invalid status: %llu\n",
+		(unsigned long long)st->status[0]);
+
+    counter_report(&st->endpoints, "endpoints");
+}
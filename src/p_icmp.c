@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "config.h"
 #include "pangolin.h"
 
 /* 
@@ -38,28 +39,12 @@
 
 #define ICMP_HDR_LEN 8
 
-struct icmp_hdr {
-    U8 icmp_type;
-    U8 icmp_code;
-    U16 icmp_cksum;
-    union {
-	U32 gateway;
-#define icmp_gateway data.gateway
-
-	struct {
-	    U16 echo_id;
-	    U16 echo_seq;
-	} echo;
-#define icmp_echo_id data.echo.echo_id
-#define icmp_echo_seq data.echo.echo_seq
-
-	struct {
-	    U16 frag_unused;
-	    U16 frag_mtu;
-	} frag;
-#define icmp_frag_mtu data.frag.frag_mtu
-    } data;
-};
+/* field offsets */
+#define ICMP_TYPE 0
+#define ICMP_CODE 1
+#define ICMP_CKSUM 2
+#define ICMP_ECHO_ID 4
+#define ICMP_ECHO_SEQ 6
 
 #define ICMP_ECHO_REPLY   0
 #define ICMP_UNREACH            3	/* dest unreachable, codes: */
@@ -75,23 +60,31 @@ struct icmp_hdr {
 #define ICMP_ADDRESS            17	/* address mask request */
 #define ICMP_ADDRESS_REPLY         18	/* address mask reply */
 
+int icmp_dissect(struct packet *packet, U16 off)
+{
+    if ((U32) off + ICMP_HDR_LEN > packet->caplen)
+	return -1;
+
+    packet->layers.l4 = off;
+    packet->layers.l4_proto = PROTO_ICMP;
+    packet->layers.l7 = off + ICMP_HDR_LEN;
+    return 0;
+}
+
 void icmp_dump(struct packet *packet, U8 * src, U8 * dst, struct context *ctx)
 {
-    struct icmp_hdr hdr;
+    const U8 *h = packet->base + packet->layers.l4;
 
-    memset(&hdr, 0, sizeof(struct icmp_hdr));
-    memcpy(&hdr, packet->data, sizeof(struct icmp_hdr));
+    PROBE2(decode_entry, PROTO_ICMP, packet->len);
 
     ctx->out("icmp %s > %s ", src, dst);
 
-    switch (hdr.icmp_type) {
+    switch (h[ICMP_TYPE]) {
     case ICMP_ECHO_REQUEST:
     case ICMP_ECHO_REPLY:
 	ctx->out("echo-%s id=%d seq=%d ",
-		 hdr.icmp_type ==
-		 ICMP_ECHO_REQUEST ? "request" : "reply",
-		 TOHOST16(hdr.icmp_echo_id) & 0xFFFF,
-		 TOHOST16(hdr.icmp_echo_seq) & 0xFFFF);
+		 h[ICMP_TYPE] == ICMP_ECHO_REQUEST ? "request" : "reply",
+		 GET16(h + ICMP_ECHO_ID), GET16(h + ICMP_ECHO_SEQ));
 	break;
 
     case ICMP_UNREACH:
@@ -141,4 +134,6 @@ void icmp_dump(struct packet *packet, U8 * src, U8 * dst, struct context *ctx)
     default:
 	ctx->out("unknown");
     }
+
+    PROBE2(decode_return, PROTO_ICMP, packet->len);
 }
@@ -0,0 +1,210 @@
+/*
+ * p_icmp6.c -- decodes ICMPv6 and neighbor discovery
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+/*
+ * ICMPv6 packet, the body depends on the type: echo carries identifier
+ * and sequence number, neighbor discovery a target address and options.
+ *
+ * 0                   1                   2                   3
+ * 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |     Type      |     Code      |          Checksum             |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                         Message Body                          |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+
+#define ICMP6_HDR_LEN 8
+
+/* field offsets */
+#define ICMP6_TYPE 0
+#define ICMP6_CODE 1
+#define ICMP6_CKSUM 2
+#define ICMP6_ECHO_ID 4
+#define ICMP6_ECHO_SEQ 6
+#define ICMP6_MTU 4
+#define ICMP6_ND_FLAGS 4
+#define ICMP6_ND_TARGET 8
+#define ICMP6_RA_HLIM 4
+#define ICMP6_RA_LIFETIME 6
+
+#define ICMP6_UNREACH 1
+#define ICMP6_TOO_BIG 2
+#define ICMP6_TIME_EXCEEDED 3
+#define ICMP6_PARAMETER_PROB 4
+#define ICMP6_ECHO_REQUEST 128
+#define ICMP6_ECHO_REPLY 129
+#define ICMP6_MLD_QUERY 130
+#define ICMP6_MLD_REPORT 131
+#define ICMP6_MLD_DONE 132
+#define ICMP6_ROUTER_SOLICIT 133
+#define ICMP6_ROUTER_ADVERT 134
+#define ICMP6_NEIGHBOR_SOLICIT 135
+#define ICMP6_NEIGHBOR_ADVERT 136
+#define ICMP6_REDIRECT 137
+#define ICMP6_MLD2_REPORT 143
+
+/* neighbor discovery options */
+#define ND_OPT_SOURCE_LLADDR 1
+#define ND_OPT_TARGET_LLADDR 2
+
+#define ND_RS_LEN 8
+#define ND_RA_LEN 16
+#define ND_NS_LEN 24
+
+int icmp6_dissect(struct packet *packet, U16 off)
+{
+    if ((U32) off + ICMP6_HDR_LEN > packet->caplen)
+	return -1;
+
+    packet->layers.l4 = off;
+    packet->layers.l4_proto = PROTO_ICMP6;
+    packet->layers.l7 = off + ICMP6_HDR_LEN;
+    return 0;
+}
+
+/* prints the link layer address options, at most one of each kind */
+static void nd_options(struct packet *packet, U32 off, struct context *ctx)
+{
+    const U8 *o;
+    char mac[20];
+
+    while (off + 8 <= packet->caplen) {
+	o = packet->base + off;
+
+	if (o[1] == 0)
+	    return;
+
+	if ((o[0] == ND_OPT_SOURCE_LLADDR || o[0] == ND_OPT_TARGET_LLADDR)
+	    && o[1] == 1) {
+	    eth_mac_addr(o + 2, mac, sizeof mac);
+	    ctx->out("%s %s ", o[0] == ND_OPT_SOURCE_LLADDR ? "from" : "is-at",
+		     mac);
+	}
+
+	off += o[1] * 8;
+    }
+}
+
+static void nd_target(struct packet *packet, const U8 * h, struct context *ctx)
+{
+    char target[INET6_ADDRSTRLEN];
+
+    if ((U32) (h - packet->base) + ND_NS_LEN > packet->caplen) {
+	ctx->out("(truncated)");
+	return;
+    }
+
+    inet_ntop(AF_INET6, h + ICMP6_ND_TARGET, target, sizeof target);
+    ctx->out("%s ", target);
+}
+
+void icmp6_dump(struct packet *packet, U8 * src, U8 * dst, struct context *ctx)
+{
+    const U8 *h = packet->base + packet->layers.l4;
+    U32 l4 = packet->layers.l4;
+
+    PROBE2(decode_entry, PROTO_ICMP6, packet->len);
+
+    ctx->out("icmp6 %s > %s ", src, dst);
+
+    switch (h[ICMP6_TYPE]) {
+    case ICMP6_ECHO_REQUEST:
+    case ICMP6_ECHO_REPLY:
+	ctx->out("echo-%s id=%d seq=%d ",
+		 h[ICMP6_TYPE] == ICMP6_ECHO_REQUEST ? "request" : "reply",
+		 GET16(h + ICMP6_ECHO_ID), GET16(h + ICMP6_ECHO_SEQ));
+	break;
+
+    case ICMP6_UNREACH:
+	ctx->out("destination unreachable");
+	break;
+
+    case ICMP6_TOO_BIG:
+	ctx->out("packet too big mtu=%u", GET32(h + ICMP6_MTU));
+	break;
+
+    case ICMP6_TIME_EXCEEDED:
+	ctx->out("time exceeded");
+	break;
+
+    case ICMP6_PARAMETER_PROB:
+	ctx->out("parameter problem");
+	break;
+
+    case ICMP6_MLD_QUERY:
+	ctx->out("multicast listener query");
+	break;
+
+    case ICMP6_MLD_REPORT:
+    case ICMP6_MLD2_REPORT:
+	ctx->out("multicast listener report");
+	break;
+
+    case ICMP6_MLD_DONE:
+	ctx->out("multicast listener done");
+	break;
+
+    case ICMP6_ROUTER_SOLICIT:
+	ctx->out("router solicitation ");
+	nd_options(packet, l4 + ND_RS_LEN, ctx);
+	break;
+
+    case ICMP6_ROUTER_ADVERT:
+	if (l4 + ND_RA_LEN > packet->caplen) {
+	    ctx->out("router advertisement (truncated)");
+	    break;
+	}
+
+	ctx->out("router advertisement hlim=%d lifetime=%d ",
+		 h[ICMP6_RA_HLIM], GET16(h + ICMP6_RA_LIFETIME));
+	nd_options(packet, l4 + ND_RA_LEN, ctx);
+	break;
+
+    case ICMP6_NEIGHBOR_SOLICIT:
+	ctx->out("neighbor solicitation who-has ");
+	nd_target(packet, h, ctx);
+	nd_options(packet, l4 + ND_NS_LEN, ctx);
+	break;
+
+    case ICMP6_NEIGHBOR_ADVERT:
+	ctx->out("neighbor advertisement%s%s%s ",
+		 h[ICMP6_ND_FLAGS] & 0x80 ? " router" : "",
+		 h[ICMP6_ND_FLAGS] & 0x40 ? " solicited" : "",
+		 h[ICMP6_ND_FLAGS] & 0x20 ? " override" : "");
+	nd_target(packet, h, ctx);
+	nd_options(packet, l4 + ND_NS_LEN, ctx);
+	break;
+
+    case ICMP6_REDIRECT:
+	ctx->out("redirect");
+	break;
+
+    default:
+	ctx->out("unknown");
+    }
+
+    PROBE2(decode_return, PROTO_ICMP6, packet->len);
+}
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <netdb.h>
 
+#include "config.h"
 #include "pangolin.h"
 
 /* 
@@ -43,18 +44,14 @@
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
 
-struct ip_hdr {
-    U8 ip_vh;
-    U8 ip_tos;
-    U16 ip_len;
-    U16 ip_id;
-    U16 ip_off;
-    U8 ip_ttl;
-    U8 ip_pro;
-    U16 ip_sum;
-    U32 ip_src;
-    U32 ip_dst;
-};
+#define IP_HDR_LEN 20
+
+/* field offsets */
+#define IP_VHL 0
+#define IP_OFF 6
+#define IP_PRO 9
+#define IP_SRC 12
+#define IP_DST 16
 
 void resolve(U8 * buf, U32 * raw)
 {
@@ -84,38 +81,88 @@ void resolve(U8 * buf, U32 * raw)
     buf[n] = 0;
 }
 
+int ip_dissect(struct packet *packet, U16 off, int depth)
+{
+    struct layers *l = &packet->layers;
+    const U8 *h = packet->base + off;
+    U16 hlen;
+
+    if ((U32) off + IP_HDR_LEN > packet->caplen)
+	return -1;
+
+    hlen = (h[IP_VHL] & 0xF) * 4;
+
+    if (hlen < IP_HDR_LEN || (U32) off + hlen > packet->caplen)
+	return -1;
+
+    l->l3 = off;
+    l->l3_proto = PROTO_IP;
+    l->ip_proto = h[IP_PRO];
+    memcpy(&l->saddr, h + IP_SRC, 4);
+    memcpy(&l->daddr, h + IP_DST, 4);
+
+    /* only the first fragment carries the transport header */
+    if (depth < DEPTH_L4 || (GET16(h + IP_OFF) & 0x1FFF))
+	return 0;
+
+    switch (l->ip_proto) {
+    case 0x01:
+	icmp_dissect(packet, off + hlen);
+	break;
+
+    case 0x06:
+	tcp_dissect(packet, off + hlen, depth);
+	break;
+
+    case 0x11:
+	udp_dissect(packet, off + hlen, depth);
+	break;
+
+    case 0x04:
+    case 0x29:
+	ipip_dissect(packet, off + hlen, depth, l->ip_proto == 0x29);
+	break;
+
+    case 0x2F:
+	gre_dissect(packet, off + hlen, depth);
+	break;
+    }
+
+    return 0;
+}
+
 void ip_dump(struct packet *packet, struct context *ctx)
 {
-    struct ip_hdr hdr;
+    struct layers *l = &packet->layers;
     U8 dst[64];
     U8 src[64];
-    U8 vhl;
 
-    memcpy(&vhl, packet->data, 1);
-    memcpy(&hdr, packet->data, (vhl & 0xF) * 4);
-    packet->data += (vhl & 0xF) * 4;
+    PROBE2(decode_entry, PROTO_IP, packet->len);
 
     if (ctx->resolve_dns) {
-	resolve(src, &hdr.ip_src);
-	resolve(dst, &hdr.ip_dst);
+	int prev = PROF(ctx->prof, PROF_RESOLVE);
+
+	resolve(src, &l->saddr);
+	resolve(dst, &l->daddr);
+	PROF(ctx->prof, prev);
     } else {
 	struct in_addr in;
-	memcpy(&in, &hdr.ip_src, 4);
+	memcpy(&in, &l->saddr, 4);
 	memcpy(src, inet_ntoa(in), 16);
-	memcpy(&in, &hdr.ip_dst, 4);
+	memcpy(&in, &l->daddr, 4);
 	memcpy(dst, inet_ntoa(in), 16);
     }
 
-    switch (hdr.ip_pro) {
-    case 0x01:
+    switch (l->l4_proto) {
+    case PROTO_ICMP:
 	icmp_dump(packet, src, dst, ctx);
 	break;
 
-    case 0x06:
+    case PROTO_TCP:
 	tcp_dump(packet, src, dst, ctx);
 	break;
 
-    case 0x11:
+    case PROTO_UDP:
 	udp_dump(packet, src, dst, ctx);
 	break;
 
@@ -123,4 +170,6 @@ void ip_dump(struct packet *packet, struct context *ctx)
 	ctx->out("unknown %s > %s ", src, dst);
 	break;
     }
+
+    PROBE2(decode_return, PROTO_IP, packet->len);
 }
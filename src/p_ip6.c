@@ -0,0 +1,206 @@
+/*
+ * p_ip6.c -- decodes the IPv6 protocol and its extension headers
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <netdb.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+/*
+ * IPv6 packet structure:
+ *
+ * 0                   1                   2                   3
+ * 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |Version| Traffic Class |           Flow Label                  |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |         Payload Length        |  Next Header  |   Hop Limit   |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                                                               |
+ * +                         Source Address                        +
+ * |                          (128 bits)                           |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * |                                                               |
+ * +                      Destination Address                      +
+ * |                          (128 bits)                           |
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+
+#define IP6_HDR_LEN 40
+
+/* field offsets */
+#define IP6_PLEN 4
+#define IP6_NXT 6
+#define IP6_HLIM 7
+#define IP6_SRC 8
+#define IP6_DST 24
+
+/* next header values */
+#define IP6_NXT_HOPOPTS 0
+#define IP6_NXT_IPIP 4
+#define IP6_NXT_TCP 6
+#define IP6_NXT_UDP 17
+#define IP6_NXT_IP6 41
+#define IP6_NXT_ROUTING 43
+#define IP6_NXT_FRAGMENT 44
+#define IP6_NXT_GRE 47
+#define IP6_NXT_ESP 50
+#define IP6_NXT_AH 51
+#define IP6_NXT_ICMP6 58
+#define IP6_NXT_NONE 59
+#define IP6_NXT_DSTOPTS 60
+#define IP6_NXT_MOBILITY 135
+
+#define IP6_EXT_MAX 8
+
+static void resolve6(char *buf, size_t bufsize, const U8 * raw, int dns)
+{
+    struct hostent *hp = NULL;
+
+    if (dns)
+	hp = gethostbyaddr(raw, 16, AF_INET6);
+
+    if (hp != NULL && strlen(hp->h_name) < bufsize)
+	strcpy(buf, hp->h_name);
+    else
+	inet_ntop(AF_INET6, raw, buf, bufsize);
+}
+
+static int ip6_ext(U8 nxt)
+{
+    return nxt == IP6_NXT_HOPOPTS || nxt == IP6_NXT_ROUTING ||
+	nxt == IP6_NXT_FRAGMENT || nxt == IP6_NXT_AH ||
+	nxt == IP6_NXT_DSTOPTS || nxt == IP6_NXT_MOBILITY;
+}
+
+/*
+ * Walks the extension headers, each one at least 8 bytes with the next
+ * header in its first byte and its length in the second one, up to the
+ * transport header.
+ */
+int ip6_dissect(struct packet *packet, U16 off, int depth)
+{
+    struct layers *l = &packet->layers;
+    const U8 *h = packet->base + off;
+    U32 next, end;
+    U8 nxt;
+    int n = 0;
+
+    if ((U32) off + IP6_HDR_LEN > packet->caplen || (h[0] >> 4) != 6)
+	return -1;
+
+    l->l3 = off;
+    l->l3_proto = PROTO_IP6;
+    nxt = h[IP6_NXT];
+    next = off + IP6_HDR_LEN;
+
+    while (ip6_ext(nxt)) {
+	const U8 *e = packet->base + next;
+
+	/* longer chains are almost certainly crafted */
+	if (++n > IP6_EXT_MAX || next + 8 > packet->caplen)
+	    return 0;
+
+	if (nxt == IP6_NXT_FRAGMENT) {
+	    /* only the first fragment carries the transport header */
+	    if (GET16(e + 2) & 0xFFF8) {
+		l->ip_proto = e[0];
+		return 0;
+	    }
+
+	    end = next + 8;
+	} else if (nxt == IP6_NXT_AH)
+	    end = next + (e[1] + 2) * 4;
+	else
+	    end = next + (e[1] + 1) * 8;
+
+	if (end > packet->caplen)
+	    return 0;
+
+	nxt = e[0];
+	next = end;
+    }
+
+    l->ip_proto = nxt;
+
+    if (depth < DEPTH_L4)
+	return 0;
+
+    switch (nxt) {
+    case IP6_NXT_ICMP6:
+	icmp6_dissect(packet, next);
+	break;
+
+    case IP6_NXT_TCP:
+	tcp_dissect(packet, next, depth);
+	break;
+
+    case IP6_NXT_UDP:
+	udp_dissect(packet, next, depth);
+	break;
+
+    case IP6_NXT_IPIP:
+    case IP6_NXT_IP6:
+	ipip_dissect(packet, next, depth, nxt == IP6_NXT_IP6);
+	break;
+
+    case IP6_NXT_GRE:
+	gre_dissect(packet, next, depth);
+	break;
+    }
+
+    return 0;
+}
+
+void ip6_dump(struct packet *packet, struct context *ctx)
+{
+    struct layers *l = &packet->layers;
+    const U8 *h = packet->base + l->l3;
+    char src[INET6_ADDRSTRLEN + 64];
+    char dst[INET6_ADDRSTRLEN + 64];
+    int prev = PROF(ctx->prof, PROF_RESOLVE);
+
+    PROBE2(decode_entry, PROTO_IP6, packet->len);
+
+    resolve6(src, sizeof src, h + IP6_SRC, ctx->resolve_dns);
+    resolve6(dst, sizeof dst, h + IP6_DST, ctx->resolve_dns);
+    PROF(ctx->prof, prev);
+
+    switch (l->l4_proto) {
+    case PROTO_ICMP6:
+	icmp6_dump(packet, (U8 *) src, (U8 *) dst, ctx);
+	break;
+
+    case PROTO_TCP:
+	tcp_dump(packet, (U8 *) src, (U8 *) dst, ctx);
+	break;
+
+    case PROTO_UDP:
+	udp_dump(packet, (U8 *) src, (U8 *) dst, ctx);
+	break;
+
+    default:
+	ctx->out("ip6 %s > %s next header %d ", src, dst, l->ip_proto);
+	break;
+    }
+
+    PROBE2(decode_return, PROTO_IP6, packet->len);
+}
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "config.h"
 #include "pangolin.h"
 
 #define TCP_HDR_LEN 20
@@ -49,17 +50,16 @@
  *
  */
 
-struct tcp_hdr {
-    U16 tcp_sport;		/* Source Port. */
-    U16 tcp_dport;		/* Destination Port. */
-    U32 tcp_seq;		/* Sequence Number. */
-    U32 tcp_ack;		/* Acknowledgment Number. */
-    U8 tcp_off;			/* Data Offset. */
-    U8 tcp_flags;		/* Flags. */
-    U16 tcp_win;		/* Window. */
-    U16 tcp_sum;		/* Checksum. */
-    U16 tcp_urp;		/* Urgent Pointer. */
-};
+/* field offsets */
+#define TCP_SPORT 0		/* Source Port. */
+#define TCP_DPORT 2		/* Destination Port. */
+#define TCP_SEQ 4		/* Sequence Number. */
+#define TCP_ACK 8		/* Acknowledgment Number. */
+#define TCP_OFF 12		/* Data Offset. */
+#define TCP_FLAGS 13		/* Flags. */
+#define TCP_WIN 14		/* Window. */
+#define TCP_SUM 16		/* Checksum. */
+#define TCP_URP 18		/* Urgent Pointer. */
 
 #define TCP_FLAG_FIN (1 << 0)	/* FIN (0x01). */
 #define TCP_FLAG_SYN (1 << 1)	/* SYN (0x02). */
@@ -68,54 +68,102 @@ struct tcp_hdr {
 #define TCP_FLAG_ACK (1 << 4)	/* ACK (0x10). */
 #define TCP_FLAG_URP (1 << 5)	/* URP (0x20). */
 
+#define IS_HTTP_PORT(p) ((p) == 80 || (p) == 8080)
+
+int tcp_dissect(struct packet *packet, U16 off, int depth)
+{
+    struct layers *l = &packet->layers;
+    const U8 *h = packet->base + off;
+    U16 hlen;
+
+    if ((U32) off + TCP_HDR_LEN > packet->caplen)
+	return -1;
+
+    hlen = (h[TCP_OFF] >> 4) * 4;
+
+    if (hlen < TCP_HDR_LEN)
+	return -1;
+
+    l->l4 = off;
+    l->l4_proto = PROTO_TCP;
+    l->sport = GET16(h + TCP_SPORT);
+    l->dport = GET16(h + TCP_DPORT);
+    l->l7 = (U32) off + hlen < packet->caplen ? off + hlen : packet->caplen;
+
+    if (depth < DEPTH_L7)
+	return 0;
+
+    if (IS_HTTP_PORT(l->sport) || IS_HTTP_PORT(l->dport))
+	http_dissect(packet, l->l7);
+    else if (tls_port(l->sport) || tls_port(l->dport))
+	tls_dissect(packet, l->l7);
+
+    return 0;
+}
+
 void tcp_dump(struct packet *packet, U8 * src, U8 * dst, struct context *ctx)
 {
-    struct tcp_hdr hdr;
+    const U8 *h = packet->base + packet->layers.l4;
+    U16 sport = packet->layers.sport;
+    U16 dport = packet->layers.dport;
+    U8 flags = h[TCP_FLAGS];
     struct protoent *pent;
+    int prev;
+
+    PROBE2(decode_entry, PROTO_TCP, packet->len);
 
-    memset(&hdr, 0, TCP_HDR_LEN);
-    memcpy(&hdr, packet->data, TCP_HDR_LEN);
     ctx->out("tcp %s:", src);
 
-    pent = getprotobynumber(TOHOST16(hdr.tcp_sport));
+    prev = PROF(ctx->prof, PROF_SERVICE);
+    pent = getprotobynumber(sport);
+    PROF(ctx->prof, prev);
 
     if (pent == NULL) {
-	ctx->out("%d", TOHOST16(hdr.tcp_sport) & 0xFFFF);
+	ctx->out("%d", sport);
     } else {
 	ctx->out("%s", pent->p_name);
     }
 
     ctx->out(" > %s:", dst);
-    pent = getprotobynumber(TOHOST16(hdr.tcp_dport));
+    prev = PROF(ctx->prof, PROF_SERVICE);
+    pent = getprotobynumber(dport);
+    PROF(ctx->prof, prev);
 
     if (pent == NULL) {
-	ctx->out("%d", TOHOST16(hdr.tcp_dport) & 0xFFFF);
+	ctx->out("%d", dport);
     } else {
 	ctx->out("%s", pent->p_name);
     }
 
-    if (hdr.tcp_flags & TCP_FLAG_PUSH)
-	hdr.tcp_flags &= ~TCP_FLAG_ACK;
+    if (flags & TCP_FLAG_PUSH)
+	flags &= ~TCP_FLAG_ACK;
 
-    if (hdr.tcp_flags & TCP_FLAG_FIN)
-	hdr.tcp_flags &= ~TCP_FLAG_ACK;
+    if (flags & TCP_FLAG_FIN)
+	flags &= ~TCP_FLAG_ACK;
 
     ctx->out(" %c%c%c%c%c%c ",
-	     hdr.tcp_flags & TCP_FLAG_FIN ? 'F' : '\0',
-	     hdr.tcp_flags & TCP_FLAG_SYN ? 'S' : '\0',
-	     hdr.tcp_flags & TCP_FLAG_RST ? 'R' : '\0',
-	     hdr.tcp_flags & TCP_FLAG_PUSH ? 'P' : '\0',
-	     hdr.
-	     tcp_flags & TCP_FLAG_ACK ? (hdr.tcp_flags & TCP_FLAG_SYN ? 'A' :
-					 '-') : '\0',
-	     hdr.tcp_flags & TCP_FLAG_URP ? 'U' : '\0');
-
-    if (hdr.tcp_flags & TCP_FLAG_SYN || hdr.tcp_flags & TCP_FLAG_FIN)
-	ctx->out("seq %u ", TOHOST32(hdr.tcp_seq));
-
-    if (hdr.tcp_flags & TCP_FLAG_ACK || hdr.tcp_flags & TCP_FLAG_PUSH
-	|| hdr.tcp_flags & TCP_FLAG_FIN)
-	ctx->out("ack %u ", TOHOST32(hdr.tcp_ack));
-
-    ctx->out("win %u", TOHOST16(hdr.tcp_win) & 0xFFFF);
+	     flags & TCP_FLAG_FIN ? 'F' : '\0',
+	     flags & TCP_FLAG_SYN ? 'S' : '\0',
+	     flags & TCP_FLAG_RST ? 'R' : '\0',
+	     flags & TCP_FLAG_PUSH ? 'P' : '\0',
+	     flags & TCP_FLAG_ACK ? (flags & TCP_FLAG_SYN ? 'A' : '-') : '\0',
+	     flags & TCP_FLAG_URP ? 'U' : '\0');
+
+    if (flags & TCP_FLAG_SYN || flags & TCP_FLAG_FIN)
+	ctx->out("seq %u ", GET32(h + TCP_SEQ));
+
+    if (flags & TCP_FLAG_ACK || flags & TCP_FLAG_PUSH || flags & TCP_FLAG_FIN)
+	ctx->out("ack %u ", GET32(h + TCP_ACK));
+
+    ctx->out("win %u", GET16(h + TCP_WIN));
+
+    if (packet->layers.l7_proto == PROTO_HTTP) {
+	ctx->out(" ");
+	http_dump(packet, ctx);
+    } else if (packet->layers.l7_proto == PROTO_TLS) {
+	ctx->out(" ");
+	tls_dump(packet, ctx);
+    }
+
+    PROBE2(decode_return, PROTO_TCP, packet->len);
 }
@@ -0,0 +1,435 @@
+/*
+ * p_tls.c -- TLS ClientHello and ServerHello: SNI, ALPN, version, JA3
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+/*
+ * Only handshake records starting with a ClientHello or a ServerHello
+ * are decoded, everything else (application data above all) is turned
+ * down by the first check of tls_dissect(). Hellos split across
+ * segments are decoded as far as the first segment goes.
+ */
+
+#define TLS_HANDSHAKE 22
+#define TLS_CLIENT_HELLO 1
+#define TLS_SERVER_HELLO 2
+
+#define TLS_EXT_SNI 0
+#define TLS_EXT_GROUPS 10
+#define TLS_EXT_POINT_FORMATS 11
+#define TLS_EXT_ALPN 16
+#define TLS_EXT_VERSIONS 43
+
+/* RFC 8701 reserved values, left out of fingerprints */
+#define IS_GREASE(v) (((v) & 0x0F0F) == 0x0A0A && ((v) >> 8) == ((v) & 0xFF))
+
+/* ports decoded as TLS, one bit each */
+static U8 tls_ports[65536 / 8] = {[443 / 8] = 1 << (443 % 8) };
+
+void tls_port_add(U16 port)
+{
+    tls_ports[port / 8] |= 1 << (port % 8);
+}
+
+int tls_port(U16 port)
+{
+    return tls_ports[port / 8] & (1 << (port % 8));
+}
+
+int tls_dissect(struct packet *packet, U16 off)
+{
+    const U8 *p = packet->base + off;
+
+    if ((U32) off + 6 > packet->caplen)
+	return -1;
+
+    if (p[0] != TLS_HANDSHAKE || p[1] != 3 || p[2] > 4
+	|| (p[5] != TLS_CLIENT_HELLO && p[5] != TLS_SERVER_HELLO))
+	return -1;
+
+    packet->layers.l7_proto = PROTO_TLS;
+    return 0;
+}
+
+/* MD5 (RFC 1321), all JA3 needs */
+static const U32 md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const U8 md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static void md5_block(U32 *h, const U8 *b)
+{
+    U32 w[16], a = h[0], bb = h[1], c = h[2], d = h[3], f, t;
+    int i, g;
+
+    for (i = 0; i < 16; i++)
+	w[i] = b[4 * i] | b[4 * i + 1] << 8 | b[4 * i + 2] << 16 |
+	    (U32) b[4 * i + 3] << 24;
+
+    for (i = 0; i < 64; i++) {
+	if (i < 16) {
+	    f = (bb & c) | (~bb & d);
+	    g = i;
+	} else if (i < 32) {
+	    f = (d & bb) | (~d & c);
+	    g = (5 * i + 1) % 16;
+	} else if (i < 48) {
+	    f = bb ^ c ^ d;
+	    g = (3 * i + 5) % 16;
+	} else {
+	    f = c ^ (bb | ~d);
+	    g = (7 * i) % 16;
+	}
+
+	t = d;
+	d = c;
+	c = bb;
+	f += a + md5_k[i] + w[g];
+	bb += f << md5_r[i] | f >> (32 - md5_r[i]);
+	a = t;
+    }
+
+    h[0] += a;
+    h[1] += bb;
+    h[2] += c;
+    h[3] += d;
+}
+
+static void md5(const U8 *msg, U32 len, U8 *digest)
+{
+    U32 h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    U8 tail[128];
+    U32 i, n;
+    U64 bits = (U64) len * 8;
+
+    for (i = 0; i + 64 <= len; i += 64)
+	md5_block(h, msg + i);
+
+    n = len - i;
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, msg + i, n);
+    tail[n] = 0x80;
+    n = n < 56 ? 64 : 128;
+
+    for (i = 0; i < 8; i++)
+	tail[n - 8 + i] = bits >> (8 * i);
+
+    md5_block(h, tail);
+
+    if (n == 128)
+	md5_block(h, tail + 64);
+
+    for (i = 0; i < 16; i++)
+	digest[i] = h[i / 4] >> (8 * (i % 4));
+}
+
+/* the JA3 string: decimal values, '-' within a field, ',' between */
+struct ja3 {
+    char s[TLS_JA3_MAX];
+    U32 len;
+    int first;
+};
+
+static void ja3_field(struct ja3 *j)
+{
+    if (j->len && j->len < sizeof(j->s) - 1)
+	j->s[j->len++] = ',';
+
+    j->first = 1;
+}
+
+static void ja3_value(struct ja3 *j, U16 v)
+{
+    int n;
+
+    if (IS_GREASE(v))
+	return;
+
+    n = snprintf(j->s + j->len, sizeof(j->s) - j->len, "%s%u",
+		 j->first ? "" : "-", v);
+
+    if (n > 0 && j->len + n < sizeof(j->s))
+	j->len += n;
+
+    j->first = 0;
+}
+
+/* values of width bytes in p[i, end) */
+static void ja3_list(struct ja3 *j, const U8 *p, U32 i, U32 end, int width)
+{
+    ja3_field(j);
+
+    for (; i + width <= end; i += width)
+	ja3_value(j, width == 2 ? GET16(p + i) : p[i]);
+}
+
+/* fp: also compute the JA3 (ClientHello) or JA3S (ServerHello) digest */
+int tls_parse(const struct packet *packet, struct tls *tls, int fp)
+{
+    const U8 *p = packet->base;
+    U32 off = packet->layers.l7, end, i, ext_end, groups = 0, formats = 0;
+    U32 glen = 0, flen = 0, hslen;
+    struct ja3 ja3;
+
+    memset(tls, 0, sizeof(*tls));
+
+    if (packet->layers.l7_proto != PROTO_TLS || off + 9 > packet->caplen)
+	return -1;
+
+    /* the end of the segment, the record or the hello, first reached */
+    end = packet->caplen;
+    hslen = p[off + 6] << 16 | p[off + 7] << 8 | p[off + 8];
+
+    if (off + 5 + GET16(p + off + 3) < end)
+	end = off + 5 + GET16(p + off + 3);
+
+    if (off + 9 + hslen < end)
+	end = off + 9 + hslen;
+
+    tls->type = p[off + 5];
+    i = off + 9;
+
+    if (i + 35 > end)
+	return -1;
+
+    tls->version = GET16(p + i);
+    ja3.len = 0;
+    ja3_field(&ja3);
+    ja3_value(&ja3, tls->version);
+    i += 34;
+    i += 1 + p[i];		/* session id */
+
+    if (tls->type == TLS_CLIENT_HELLO) {
+	if (i + 2 > end || i + 2 + GET16(p + i) > end)
+	    return -1;
+
+	ja3_list(&ja3, p, i + 2, i + 2 + GET16(p + i), 2);
+	i += 2 + GET16(p + i);
+
+	if (i + 1 > end)
+	    return -1;
+
+	i += 1 + p[i];		/* compression methods */
+    } else {
+	if (i + 3 > end)
+	    return -1;
+
+	ja3_field(&ja3);
+	ja3_value(&ja3, GET16(p + i));
+	i += 3;
+    }
+
+    ja3_field(&ja3);
+    ext_end = i + 2 <= end ? i + 2 + GET16(p + i) : i;
+
+    if (ext_end > end)
+	ext_end = end;
+
+    for (i += 2; i + 4 <= ext_end; i += 4 + GET16(p + i + 2)) {
+	U16 type = GET16(p + i), len = GET16(p + i + 2);
+	U32 d = i + 4;
+
+	ja3_value(&ja3, type);
+
+	if (d + len > ext_end)
+	    break;
+
+	switch (type) {
+	case TLS_EXT_SNI:
+	    /* list length, name type, name length */
+	    if (len >= 5 && p[d + 2] == 0 && d + 5 + GET16(p + d + 3) <= d + len) {
+		tls->sni = d + 5;
+		tls->sni_len = GET16(p + d + 3);
+	    }
+	    break;
+
+	case TLS_EXT_ALPN:
+	    if (len >= 3 && d + 3 + p[d + 2] <= d + len) {
+		tls->alpn = d + 3;
+		tls->alpn_len = p[d + 2];
+	    }
+	    break;
+
+	case TLS_EXT_VERSIONS:
+	    if (tls->type == TLS_SERVER_HELLO && len == 2)
+		tls->version = GET16(p + d);
+	    else if (tls->type == TLS_CLIENT_HELLO && len >= 1) {
+		U32 v;
+
+		for (v = d + 1; v + 2 <= d + 1 + p[d] && v + 2 <= d + len;
+		     v += 2)
+		    if (!IS_GREASE(GET16(p + v)) && GET16(p + v) > tls->version)
+			tls->version = GET16(p + v);
+	    }
+	    break;
+
+	case TLS_EXT_GROUPS:
+	    if (len >= 2) {
+		groups = d + 2;
+		glen = GET16(p + d) < len - 2 ? GET16(p + d) : len - 2;
+	    }
+	    break;
+
+	case TLS_EXT_POINT_FORMATS:
+	    if (len >= 1) {
+		formats = d + 1;
+		flen = p[d] < len - 1 ? p[d] : len - 1;
+	    }
+	    break;
+	}
+    }
+
+    if (!fp)
+	return 0;
+
+    if (tls->type == TLS_CLIENT_HELLO) {
+	ja3_list(&ja3, p, groups, groups + glen, 2);
+	ja3_list(&ja3, p, formats, formats + flen, 1);
+    }
+
+    md5((const U8 *)ja3.s, ja3.len, tls->ja3);
+    tls->has_ja3 = 1;
+    return 0;
+}
+
+static const char *tls_version(U16 v)
+{
+    switch (v) {
+    case 0x0300:
+	return "SSLv3";
+    case 0x0301:
+	return "TLSv1.0";
+    case 0x0302:
+	return "TLSv1.1";
+    case 0x0303:
+	return "TLSv1.2";
+    case 0x0304:
+	return "TLSv1.3";
+    default:
+	return "unknown";
+    }
+}
+
+void tls_dump(struct packet *packet, struct context *ctx)
+{
+    const U8 *p = packet->base;
+    char buf[COUNTER_NAME_MAX + 1];
+    struct tls tls;
+    int i;
+
+    PROBE2(decode_entry, PROTO_TLS, packet->len);
+
+    if (tls_parse(packet, &tls, 1)) {
+	ctx->out("tls (truncated)");
+	PROBE2(decode_return, PROTO_TLS, packet->len);
+	return;
+    }
+
+    ctx->out("tls %s %s", tls.type == TLS_CLIENT_HELLO ?
+	     "ClientHello" : "ServerHello", tls_version(tls.version));
+
+    if (tls.sni_len) {
+	printable(buf, p + tls.sni, tls.sni_len < COUNTER_NAME_MAX ?
+		  tls.sni_len : COUNTER_NAME_MAX);
+	ctx->out(" sni %s", buf);
+    }
+
+    if (tls.alpn_len) {
+	printable(buf, p + tls.alpn, tls.alpn_len);
+	ctx->out(" alpn %s", buf);
+    }
+
+    ctx->out(" %s ", tls.type == TLS_CLIENT_HELLO ? "ja3" : "ja3s");
+
+    for (i = 0; i < 16; i++)
+	ctx->out("%02x", tls.ja3[i]);
+
+    PROBE2(decode_return, PROTO_TLS, packet->len);
+}
+
+/* no fingerprint here: this runs for every new connection */
+void tls_record(struct tls_stats *st, const struct packet *packet)
+{
+    struct tls tls;
+    struct counter *c;
+    U32 len;
+
+    if (tls_parse(packet, &tls, 0))
+	return;
+
+    if (tls.type == TLS_SERVER_HELLO) {
+	st->server_hellos++;
+	st->version[(tls.version >> 8) == 3 && (tls.version & 0xFF) <= 4 ?
+		    (tls.version & 0xFF) + 1 : 0]++;
+	return;
+    }
+
+    st->client_hellos++;
+    c = counter_get(&st->sni, counter_hash(packet->base + tls.sni,
+					    tls.sni_len, COUNTER_SEED));
+
+    if (c && c->count++ == 0) {
+	len = tls.sni_len < COUNTER_NAME_MAX ? tls.sni_len : COUNTER_NAME_MAX;
+
+	if (len)
+	    printable(c->name, packet->base + tls.sni, len);
+	else
+	    strcpy(c->name, "(no sni)");
+    }
+}
+
+void tls_report(const struct tls_stats *st)
+{
+    int i;
+
+    fprintf(stdout, "\nTLS\n---\n");
+    fprintf(stdout, "\n%llu client hellos, %llu server hellos\n",
+	    (unsigned long long)st->client_hellos,
+	    (unsigned long long)st->server_hellos);
+
+    for (i = 1; i < 6; i++)
+	if (st->version[i])
+	    fprintf(stdout, "  %-8s %llu\n", tls_version(0x0300 + i - 1),
+		    (unsigned long long)st->version[i]);
+
+    if (st->version[0])
+	fprintf(stdout, "  unknown  %llu\n", (unsigned long long)st->version[0]);
+
+    counter_report(&st->sni, "server names");
+}
@@ -0,0 +1,216 @@
+/*
+ * p_tunnel.c -- decapsulates GRE, VXLAN, Geneve and IP-in-IP
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+/*
+ * The descriptor always describes the innermost packet: entering a
+ * tunnel remembers where its header and the IP header carrying it are,
+ * then the inner packet is dissected over the outer layers.
+ *
+ * GRE (RFC 2784, 2890)         VXLAN (RFC 7348)         Geneve (RFC 8926)
+ *  0 C|K|S|ver  2 protocol      0 flags (I = 0x08)       0 ver|opt len
+ *  4 [checksum] [key] [seq]     4 VNI, 24 bits           1 O|C
+ *                                                        2 protocol
+ *                                                        4 VNI, 24 bits
+ */
+
+#define GRE_HDR_LEN 4
+#define GRE_FLAGS 0
+#define GRE_PROTO 2
+#define GRE_C 0x8000
+#define GRE_K 0x2000
+#define GRE_S 0x1000
+#define GRE_VERSION 0x0007
+
+#define VXLAN_HDR_LEN 8
+#define VXLAN_FLAGS 0
+#define VXLAN_VNI 4
+#define VXLAN_I 0x08
+
+#define GENEVE_HDR_LEN 8
+#define GENEVE_OPTLEN 0
+#define GENEVE_PROTO 2
+#define GENEVE_VNI 4
+
+/* payload types */
+#define TUNNEL_ETH 0x6558		/* transparent ethernet bridging */
+#define TUNNEL_IP 0x0800
+#define TUNNEL_IP6 0x86DD
+
+static int tunnel_enter(struct packet *packet, U8 proto, U16 off, U32 vni)
+{
+    struct layers *l = &packet->layers;
+
+    if (l->tunnels == TUNNEL_MAX)
+	return -1;
+
+    l->tunnel = proto;
+    l->tunnels++;
+    l->tun = off;
+    l->tun_l3 = l->l3;
+    l->tun_l3_proto = l->l3_proto;
+    l->vni = vni;
+
+    /* the inner packet starts from scratch */
+    l->l3 = l->l4 = l->l7 = 0;
+    l->l3_proto = l->l4_proto = l->l7_proto = l->ip_proto = PROTO_NONE;
+    l->saddr = l->daddr = 0;
+    l->sport = l->dport = 0;
+    return 0;
+}
+
+/* inner payload by its ethertype */
+static void tunnel_payload(struct packet *packet, U16 type, U16 off,
+			   int depth)
+{
+    switch (type) {
+    case TUNNEL_ETH:
+	eth_dissect(packet, off, depth);
+	break;
+
+    case TUNNEL_IP:
+	packet->layers.ethertype = type;
+	ip_dissect(packet, off, depth);
+	break;
+
+    case TUNNEL_IP6:
+	packet->layers.ethertype = type;
+	ip6_dissect(packet, off, depth);
+	break;
+    }
+}
+
+int gre_dissect(struct packet *packet, U16 off, int depth)
+{
+    const U8 *h = packet->base + off;
+    U16 flags, len = GRE_HDR_LEN;
+    U32 key = 0;
+
+    if ((U32) off + GRE_HDR_LEN > packet->caplen)
+	return -1;
+
+    flags = GET16(h + GRE_FLAGS);
+
+    /* version 1 is PPTP, not a tunnel */
+    if (flags & GRE_VERSION)
+	return -1;
+
+    if (flags & GRE_C)
+	len += 4;
+
+    if (flags & GRE_K) {
+	if ((U32) off + len + 4 > packet->caplen)
+	    return -1;
+
+	key = GET32(h + len);
+	len += 4;
+    }
+
+    if (flags & GRE_S)
+	len += 4;
+
+    if ((U32) off + len > packet->caplen)
+	return -1;
+
+    if (tunnel_enter(packet, PROTO_GRE, off, key))
+	return -1;
+
+    tunnel_payload(packet, GET16(h + GRE_PROTO), off + len, depth);
+    return 0;
+}
+
+int vxlan_dissect(struct packet *packet, U16 off, int depth)
+{
+    const U8 *h = packet->base + off;
+
+    if ((U32) off + VXLAN_HDR_LEN > packet->caplen
+	|| !(h[VXLAN_FLAGS] & VXLAN_I))
+	return -1;
+
+    if (tunnel_enter(packet, PROTO_VXLAN, off, GET32(h + VXLAN_VNI) >> 8))
+	return -1;
+
+    eth_dissect(packet, off + VXLAN_HDR_LEN, depth);
+    return 0;
+}
+
+int geneve_dissect(struct packet *packet, U16 off, int depth)
+{
+    const U8 *h = packet->base + off;
+    U16 len;
+
+    if ((U32) off + GENEVE_HDR_LEN > packet->caplen || (h[0] >> 6) != 0)
+	return -1;
+
+    len = GENEVE_HDR_LEN + (h[GENEVE_OPTLEN] & 0x3F) * 4;
+
+    if ((U32) off + len > packet->caplen)
+	return -1;
+
+    if (tunnel_enter(packet, PROTO_GENEVE, off, GET32(h + GENEVE_VNI) >> 8))
+	return -1;
+
+    tunnel_payload(packet, GET16(h + GENEVE_PROTO), off + len, depth);
+    return 0;
+}
+
+/* IP-in-IP and IPv6-in-IP: the inner header follows the outer one */
+int ipip_dissect(struct packet *packet, U16 off, int depth, int ip6)
+{
+    if (tunnel_enter(packet, PROTO_IPIP, off, 0))
+	return -1;
+
+    tunnel_payload(packet, ip6 ? TUNNEL_IP6 : TUNNEL_IP, off, depth);
+    return 0;
+}
+
+/* the innermost tunnel and its outer addresses */
+void tunnel_dump(struct packet *packet, struct context *ctx)
+{
+    static const char *names[] = { "gre", "vxlan", "geneve", "ipip" };
+    const struct layers *l = &packet->layers;
+    const U8 *h = packet->base + l->tun_l3;
+    char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+
+    PROBE2(decode_entry, l->tunnel, packet->len);
+
+    if (l->tun_l3_proto == PROTO_IP6) {
+	inet_ntop(AF_INET6, h + 8, src, sizeof src);
+	inet_ntop(AF_INET6, h + 24, dst, sizeof dst);
+    } else {
+	inet_ntop(AF_INET, h + 12, src, sizeof src);
+	inet_ntop(AF_INET, h + 16, dst, sizeof dst);
+    }
+
+    ctx->out("%s %s > %s", names[l->tunnel - PROTO_GRE], src, dst);
+
+    if (l->tunnel == PROTO_VXLAN || l->tunnel == PROTO_GENEVE)
+	ctx->out(" vni %u", l->vni);
+    else if (l->tunnel == PROTO_GRE && l->vni)
+	ctx->out(" key %u", l->vni);
+
+    ctx->out(": ");
+
+    PROBE2(decode_return, l->tunnel, packet->len);
+}
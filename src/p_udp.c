@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "config.h"
 #include "pangolin.h"
 
 /* 
@@ -37,31 +38,71 @@
  */
 #define UDP_HDR_LEN 8
 
-/* see RFC 768. */
-struct udp_hdr {
-    U16 udp_sport;
-    U16 udp_dport;
-    U16 udp_len;
-    U16 udp_cksum;
-};
+/* see RFC 768, field offsets */
+#define UDP_SPORT 0
+#define UDP_DPORT 2
+#define UDP_LEN 4
+#define UDP_CKSUM 6
+
+/* IANA assigned tunnel ports */
+#define UDP_PORT_VXLAN 4789
+#define UDP_PORT_GENEVE 6081
+
+int udp_dissect(struct packet *packet, U16 off, int depth)
+{
+    struct layers *l = &packet->layers;
+    const U8 *h = packet->base + off;
+    U16 s, d;
+
+    if ((U32) off + UDP_HDR_LEN > packet->caplen)
+	return -1;
+
+    s = GET16(h + UDP_SPORT);
+    d = GET16(h + UDP_DPORT);
+    l->l4 = off;
+    l->l4_proto = PROTO_UDP;
+    l->sport = s;
+    l->dport = d;
+    l->l7 = off + UDP_HDR_LEN;
+
+    /* the outer layers are kept if the tunnel header is not valid */
+    if (d == UDP_PORT_VXLAN) {
+	vxlan_dissect(packet, l->l7, depth);
+	return 0;
+    }
+
+    if (d == UDP_PORT_GENEVE) {
+	geneve_dissect(packet, l->l7, depth);
+	return 0;
+    }
+
+    if (depth < DEPTH_L7)
+	return 0;
+
+    if (s == 68 || d == 68 || s == 67 || d == 67)
+	bootp_dissect(packet, l->l7);
+
+    return 0;
+}
 
 void udp_dump(struct packet *packet, U8 * src, U8 * dst, struct context *ctx)
 {
-    struct udp_hdr hdr;
     U16 s, d;
     struct protoent *pent;
+    int prev;
 
-    memset(&hdr, 0, UDP_HDR_LEN);
-    memcpy(&hdr, packet->data, UDP_HDR_LEN);
-    s = TOHOST16(hdr.udp_sport);
-    d = TOHOST16(hdr.udp_dport);
-    packet->data += UDP_HDR_LEN;
+    PROBE2(decode_entry, PROTO_UDP, packet->len);
 
-    if (s == 68 || d == 68 || s == 67 || d == 67) {
-	bootp_dump(packet, ctx);
+    s = packet->layers.sport;
+    d = packet->layers.dport;
+
+    if (packet->layers.l7_proto == PROTO_BOOTP) {
+	bootp_dump(packet, src, dst, ctx);
     } else {
 	ctx->out("udp %s:", src);
+	prev = PROF(ctx->prof, PROF_SERVICE);
 	pent = getprotobynumber(s);
+	PROF(ctx->prof, prev);
 
 	if (pent == NULL)	// TODO: refactor with p_tcp.c
 	    ctx->out("%d", s & 0xFFFF);
@@ -69,11 +110,15 @@ void udp_dump(struct packet *packet, U8 * src, U8 * dst, struct context *ctx)
 	    ctx->out("%s", pent->p_name);
 
 	ctx->out(" %s:", dst);
+	prev = PROF(ctx->prof, PROF_SERVICE);
 	pent = getprotobynumber(d);
+	PROF(ctx->prof, prev);
 
 	if (pent == NULL)
 	    ctx->out("%d", d & 0xFFFF);
 	else
 	    ctx->out("%s", pent->p_name);
     }
+
+    PROBE2(decode_return, PROTO_UDP, packet->len);
 }
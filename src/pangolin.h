@@ -1,10 +1,16 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <time.h>
 #include <netdb.h>
 
 #include <stdint.h>
 
+#include "fanout.h"
+
+/* slot of a published packet, unless -S asks for more */
+#define PUBLISH_SLOT 4096
+
 typedef int8_t I8;
 typedef uint8_t U8;
 
@@ -14,6 +20,8 @@ typedef uint16_t U16;
 typedef int32_t I32;
 typedef uint32_t U32;
 
+typedef uint64_t U64;
+
 /* handy macros */
 #define TOHOST16(x) (U16) ntohs((U16)(x))
 #define TOHOST32(x) (U32) ntohl((U32)(x))
@@ -21,14 +29,92 @@ typedef uint32_t U32;
 #define TONET16(x) (U16) htons((U16)(x))
 #define TONET32(x) (U32) htonl((U32)(x))
 
+/* loads from packet data in network byte order, alignment free */
+#define GET16(p) ((U16)((p)[0] << 8 | (p)[1]))
+#define GET32(p) ((U32)(p)[0] << 24 | (U32)(p)[1] << 16 | \
+		  (U32)(p)[2] << 8 | (U32)(p)[3])
+
 /* (2^16) should be greater than any MTU */
 #define PKT_DATA_LEN (1024 * 64)
 
+/* bytes zeroed past the captured data, so decoders never see stale data */
+#define PKT_GUARD_LEN 512
+
+/* snap length: SNAPLEN_HEADERS sizes each packet to its L2-L4 headers */
+#define SNAPLEN_MAX PKT_DATA_LEN
+#define SNAPLEN_HEADERS 0
+
+/* protocol ids of the dissected layers */
+enum proto {
+    PROTO_NONE = 0,
+    PROTO_ETH,
+    PROTO_ARP,
+    PROTO_IP,
+    PROTO_ICMP,
+    PROTO_TCP,
+    PROTO_UDP,
+    PROTO_BOOTP,
+    PROTO_IP6,
+    PROTO_ICMP6,
+    PROTO_GRE,
+    PROTO_VXLAN,
+    PROTO_GENEVE,
+    PROTO_IPIP,
+    PROTO_HTTP,
+    PROTO_TLS
+};
+
+/* 802.1Q/802.1ad tags kept per packet, outermost first */
+#define VLAN_MAX 4
+
+/* nested tunnels decapsulated */
+#define TUNNEL_MAX 4
+
+/* how deep dissect() goes */
+#define DEPTH_L2 2
+#define DEPTH_L3 3
+#define DEPTH_L4 4
+#define DEPTH_L7 7
+
+/*
+ * Parsed packet descriptor, filled once by dissect(). Offsets are into
+ * packet->base; a layer is present only if its header was captured.
+ */
+struct layers {
+    U16 l3;
+    U16 l4;
+    U16 l7;
+    U16 ethertype;
+    U8 l3_proto;
+    U8 l4_proto;
+    U8 l7_proto;
+    U8 ip_proto;		/* IP protocol number */
+    U32 saddr;			/* IPv4 only, network byte order */
+    U32 daddr;
+    U16 sport;			/* host byte order */
+    U16 dport;
+    U8 vlans;			/* number of tags */
+    U8 vlan[VLAN_MAX * 4];	/* TPID, TCI pairs as on the wire */
+    U8 tunnel;			/* innermost tunnel, the layers are inside it */
+    U8 tunnels;			/* nesting level */
+    U8 tun_l3_proto;
+    U16 tun;			/* tunnel header */
+    U16 tun_l3;			/* IP header carrying it */
+    U32 vni;			/* VXLAN/Geneve VNI, GRE key */
+};
+
 struct packet {
-    struct timeval time;
+    struct timespec time;
     U8 base[PKT_DATA_LEN];
-    U8 *data;
     U8 type;
+    U32 caplen;			/* bytes copied into base */
+    U32 len;			/* length on the wire */
+    U32 status;			/* TP_STATUS_* flags from the kernel */
+    U16 vlan_tpid;		/* tag stripped by the kernel, 0 if none */
+    U16 vlan_tci;
+    int ifindex;		/* interface it was captured on */
+    int netns;			/* and its namespace, 0 for our own */
+    struct layers layers;
 };
 
 struct sock_filter {
@@ -43,44 +129,742 @@ struct sock_fprog {		/* Required for SO_ATTACH_FILTER. */
     struct sock_filter *filter;
 };
 
+/* a socket filter built by chaining the predefined programs */
+#define FILTER_MAX_LEN 256
+
+struct filter {
+    struct sock_filter code[FILTER_MAX_LEN];
+    U16 len;
+};
+
+/* inner 5-tuple of VXLAN traffic, host byte order, 0 matches anything */
+struct tuple {
+    U32 vni;
+    U8 proto;
+    U32 saddr;
+    U32 daddr;
+    U16 sport;
+    U16 dport;
+};
+
+/* PACKET_RX_RING mapped in user space (TPACKET_V2) */
+#define RING_BYTES (1 << 23)
+
+struct ring {
+    U8 *map;
+    size_t maplen;
+    U32 framesize;
+    U32 nframes;
+    U32 cur;
+};
+
+/* kernel to user space delivery latency, log2 buckets of nanoseconds */
+#define LATENCY_BUCKETS 40
+
+struct latency {
+    U64 count;
+    U64 sum;
+    U64 max;
+    U64 bucket[LATENCY_BUCKETS];
+};
+
+/* checksum verification counters, see checksum.c */
+#define CSUM_BAD_IP 0x01
+#define CSUM_BAD_TCP 0x02
+#define CSUM_BAD_UDP 0x04
+
+struct checksum {
+    U64 verified;
+    U64 offloaded;		/* left to the NIC or validated by it */
+    U64 truncated;		/* not captured in full */
+    U64 bad_ip;
+    U64 bad_tcp;
+    U64 bad_udp;
+};
+
+/* display filter code, see dfilter.c */
+#define DF_MAX_INSNS 512
+#define DF_ACCEPT 0xFFFF
+#define DF_REJECT 0xFFFE
+
+enum {
+    DF_PRESENT,
+    DF_EQ,
+    DF_NE,
+    DF_LT,
+    DF_LE,
+    DF_GT,
+    DF_GE
+};
+
+struct dinsn {
+    U8 layer;
+    U8 proto;
+    U8 size;
+    U8 op;
+    U16 off;
+    U16 jt;
+    U16 jf;
+    U32 mask;
+    U32 k;
+};
+
+struct dfilter {
+    struct dinsn code[DF_MAX_INSNS];
+    U16 len;
+    U16 start;
+    U16 entry;
+    int depth;			/* layers the filter reads */
+};
+
+/* HTTP/1.x message start, offsets from the start of the packet */
+#define HTTP_LENGTH_NONE 0xFFFFFFFF
+
+struct http {
+    U8 response;
+    U16 status;
+    U16 method;
+    U16 method_len;
+    U16 uri;
+    U16 uri_len;
+    U16 host;			/* Host header value, 0 if absent */
+    U16 host_len;
+    U32 length;			/* Content-Length, HTTP_LENGTH_NONE if absent */
+};
+
+/* per name counters, see counter.c */
+#define COUNTERS 4096
+#define COUNTER_NAME_MAX 95
+#define COUNTER_TOP 20
+#define COUNTER_SEED 2166136261U
+
+struct counter {
+    U32 hash;
+    U64 count;
+    char name[COUNTER_NAME_MAX + 1];
+};
+
+struct counters {
+    U32 used;
+    U64 other;			/* counts of names not in the table */
+    struct counter slot[COUNTERS];
+};
+
+struct http_stats {
+    U64 requests;
+    U64 responses;
+    U64 status[600];		/* by code, 0 for invalid ones */
+    struct counters endpoints;	/* requests per Host and path */
+};
+
+/* DHCP fields of a BOOTP message, addresses in network byte order */
+struct dhcp {
+    U8 type;			/* message type, 0 for plain BOOTP */
+    U8 chaddr[6];
+    U32 ciaddr;
+    U32 yiaddr;
+    U32 requested;		/* 0 if absent, as the ones below */
+    U32 server;
+    U32 lease;			/* seconds */
+    U16 hostname;		/* offset from the start of the packet */
+    U16 hostname_len;
+};
+
+/* DHCP lease table, see lease.c */
+#define LEASES 4096
+#define LEASE_HISTORY 4
+#define LEASE_FOREVER ((U64) -1)
+
+struct binding {
+    U8 mac[6];
+    U64 start;			/* seconds, end excluded */
+    U64 end;
+};
+
+struct lease_ip {
+    U32 ip;			/* 0 for a free slot */
+    U8 n;
+    U8 next;			/* ring of the last bindings */
+    struct binding h[LEASE_HISTORY];
+};
+
+struct lease_mac {
+    U8 mac[6];
+    U8 used;
+    U32 ip;			/* current address, 0 if none */
+};
+
+struct leases {
+    U32 ips;
+    U32 macs;
+    U64 dropped;
+    struct lease_ip ip[LEASES];
+    struct lease_mac mac[LEASES];
+};
+
+/* ARP bindings, see neigh.c */
+#define NEIGHS 16384
+
+#define NEIGH_CONFLICT 0x01	/* an address moved to another MAC */
+#define NEIGH_FLAP 0x02		/* and back again */
+#define NEIGH_STORM 0x04	/* too many gratuitous ARPs */
+#define NEIGH_SPOOF 0x08	/* sender MAC is not the ethernet source */
+
+struct neigh_ip {
+    U32 ip;
+    U8 used;
+    U8 mac[6];
+    U8 prev[6];			/* the MAC before the last change */
+    U64 seen;			/* seconds */
+    U64 changed;
+    U64 garp_sec;		/* gratuitous ARPs in this second */
+    U32 garp;
+};
+
+struct neigh_mac {
+    U8 mac[6];
+    U8 used;
+    U32 ip;			/* last address claimed */
+    U64 seen;
+};
+
+struct neigh_table {
+    U32 ips;
+    U32 macs;
+    U64 bindings;
+    U64 conflicts;
+    U64 flaps;
+    U64 storms;
+    U64 spoofed;
+    U64 dropped;
+    U8 old[6];			/* the MAC replaced by the last change */
+    struct neigh_ip ip[NEIGHS];
+    struct neigh_mac mac[NEIGHS];
+};
+
+/* TLS hello, offsets from the start of the packet */
+#define TLS_JA3_MAX 1024
+
+struct tls {
+    U8 type;			/* 1 ClientHello, 2 ServerHello */
+    U16 version;		/* highest offered, or negotiated */
+    U16 sni;			/* server name, 0 if absent */
+    U16 sni_len;
+    U16 alpn;			/* first protocol, 0 if absent */
+    U8 alpn_len;
+    U8 ja3[16];			/* MD5 of the JA3 or JA3S string */
+    int has_ja3;
+};
+
+struct tls_stats {
+    U64 client_hellos;
+    U64 server_hellos;
+    U64 version[6];		/* negotiated: SSLv3 to TLSv1.3, 0 unknown */
+    struct counters sni;	/* client hellos per server name */
+};
+
+/* payload patterns, see match.c */
+struct pattern {
+    char *text;			/* as given, for printing */
+    U8 *bytes;
+    U32 len;
+};
+
+#define MATCH_FIRST_MAX 8
+
+struct matcher {
+    struct pattern *patterns;
+    U32 npatterns;
+    U32 nclass;			/* byte classes, 0 for unused bytes */
+    U32 states;
+    U32 *delta;			/* states x nclass transitions */
+    U32 *out;			/* pattern index + 1 found in a state */
+    U8 cls[256];
+    U8 first[MATCH_FIRST_MAX];	/* bytes starting a pattern, if few */
+    int nfirst;
+};
+
+/* output formats */
+#define OUT_TEXT 0
+#define OUT_JSON 1
+#define OUT_CSV 2
+#define OUT_BINARY 3
+
+#define OUT_VERSION 2
+#define OUT_RECORD_LEN 64
+#define OUT_BUF_LEN (1 << 16)
+
+/* sampling probabilities go in parts per 2^32, as the kernel draws them */
+#define SAMPLE_SCALE 4294967296.0
+
+/* allocation free encoders write here, see output.c */
+struct output {
+    int format;
+    int fd;
+    struct prof *prof;		/* times the writes, NULL if not */
+    char sample[16];		/* sampling probability, "1" if every packet */
+    size_t len;
+    U8 buf[OUT_BUF_LEN];
+};
+
+/* an interface, from rtnetlink */
+#define IF_NAME_LEN 16
+#define IF_ANY "any"
+
+struct if_link {
+    int index;
+    char name[IF_NAME_LEN];
+    U32 flags;			/* IFF_* */
+    U32 mtu;
+    U8 mac[6];
+    int has_mac;
+    int has_stats;		/* kernel counters below */
+    U64 rx_packets;
+    U64 tx_packets;
+    U64 rx_bytes;
+    U64 tx_bytes;
+    U64 rx_errors;
+    U64 tx_errors;
+    U64 rx_dropped;
+    U64 tx_dropped;
+};
+
+struct if_addr {
+    int index;
+    U8 family;			/* AF_INET or AF_INET6 */
+    U8 prefix;
+    U8 addr[16];
+};
+
+/* interfaces followed by name as they come and go, see follow.c */
+#define FOLLOW_MAX 8192
+#define FOLLOW_EVENTS 64
+
+struct tap {
+    int index;			/* ifindex, 0 if the slot is free */
+    int fd;			/* -1 once closed */
+    char name[IF_NAME_LEN];	/* the latest one */
+    U32 renames;
+    U32 seen;			/* generation of the last dump */
+    U64 packets;
+    U64 bytes;
+    U64 drops;
+};
+
+struct follow {
+    const char *pattern;	/* fnmatch(3) */
+    const struct filter *filter;
+    int nl;			/* RTMGRP_LINK subscription */
+    int epfd;
+    int loindex;
+    U32 gen;
+    int used;
+    int open;
+    int nready;			/* epoll keys not yet served */
+    int cur;
+    U64 ready[FOLLOW_EVENTS];
+    int gone;			/* taps folded into the totals below */
+    U64 gone_packets;
+    U64 gone_bytes;
+    U64 gone_drops;
+    struct tap taps[FOLLOW_MAX];
+};
+
+/* copies of a packet on several interfaces, see dedup.c */
+#define DEDUP_SLOTS 4096
+#define DEDUP_WINDOW 10000000	/* ns */
+
+struct dedup_slot {
+    U32 hash;
+    U32 len;			/* from the network header on */
+    int ifindex;
+    int netns;
+    U64 time;			/* ns, 0 if the slot is free */
+};
+
+struct dedup {
+    struct dedup_slot slot[DEDUP_SLOTS];
+    U64 packets;
+    U64 duplicates;
+};
+
+/* sockets in other network namespaces, see netns.c */
+#define NETNS_MAX 1024
+#define NETNS_EVENTS 64
+
+struct netns_sock {
+    const char *spec;		/* path or PID */
+    const char *iface;
+    int fd;
+    U64 packets;
+    U64 bytes;
+};
+
+struct netns_set {
+    int epfd;
+    int n;
+    int nready;			/* sockets not yet served */
+    int cur;
+    int ready[NETNS_EVENTS];
+    struct netns_sock socks[NETNS_MAX];
+};
+
+/* AF_XDP socket and its UMEM, see xdp.c */
+#define XSK_FRAMES 4096
+#define XSK_FRAME_SIZE 2048
+#define XSK_BATCH 64
+
+#define XSK_SKB 1			/* generic mode, any driver */
+#define XSK_NATIVE 2
+
+/* protocols the XDP program redirects, 0 for all of them */
+#define XSK_ARP 0x01
+#define XSK_RARP 0x02
+#define XSK_IP 0x04
+#define XSK_ICMP 0x08
+#define XSK_TCP 0x10
+#define XSK_UDP 0x20
+#define XSK_IP6 0x40
+#define XSK_ICMP6 0x80
+
+struct xsk_ring {
+    U32 *producer;
+    U32 *consumer;
+    void *desc;
+    U32 mask;
+    U32 cached;			/* our producer of the fill ring */
+    void *map;
+    size_t maplen;
+};
+
+struct xsk {
+    int fd;
+    int map_fd;			/* XSKMAP */
+    int prog_fd;
+    int link_fd;
+    int ifindex;
+    U8 *umem;
+    struct xsk_ring rx;
+    struct xsk_ring fill;
+    U32 cur;			/* batch of RX descriptors being served */
+    U32 end;
+    U64 recycle[XSK_BATCH];	/* their frames */
+    U32 nrecycle;
+    U64 packets;
+};
+
+/* a pcap file mapped in memory, see pcap.c */
+struct pcap {
+    U8 *map;
+    size_t len;
+    size_t off;			/* of the next record */
+    int swapped;		/* written in the other byte order */
+    int nsec;			/* nanosecond timestamps */
+    U32 snaplen;
+    U32 linktype;		/* 1 for ethernet */
+};
+
+struct pcap_rec {
+    U64 time;			/* ns */
+    U32 caplen;
+    U32 len;
+    const U8 *data;		/* in the mapped file */
+};
+
+/* PACKET_TX_RING transmitter, see replay.c */
+struct replay {
+    int fd;
+    U32 mtu;
+    U8 *map;
+    size_t maplen;
+    U32 framesize;
+    U32 nframes;
+    U32 cur;
+    U32 pending;		/* requested, not handed over yet */
+    U32 loops;			/* done */
+    U64 packets;
+    U64 bytes;
+    U64 errors;
+    U64 skipped;		/* too short or over the MTU */
+    U64 start;			/* ns, CLOCK_MONOTONIC */
+    U64 end;
+};
+
+/* time per stage of the capture loop, see profile.c */
+enum {
+    PROF_CAPTURE,
+    PROF_DEDUP,
+    PROF_DISSECT,
+    PROF_FILTER,		/* display filter and payload patterns */
+    PROF_STATS,			/* every table and counter */
+    PROF_FORMAT,
+    PROF_RESOLVE,		/* DNS lookups while formatting */
+    PROF_SERVICE,		/* getprotobynumber() on the ports */
+    PROF_WRITE,
+    PROF_STAGES
+};
+
+#define PROF_BUCKETS 40		/* log2 of ticks */
+#define PROF_PATHS 64
+#define PROF_STDOUT_LEN (1 << 16)
+
+struct prof_path {
+    U32 key;			/* tunnel, l7, l4 and l3 protocol ids */
+    U64 packets;
+    U64 ticks[PROF_STAGES];
+    U64 bucket[PROF_BUCKETS];	/* whole packets */
+};
+
+struct prof {
+    U64 start;			/* stamp and clock at prof_init() */
+    U64 start_ns;
+    U64 last;			/* stamp of the last boundary */
+    int cur;			/* stage since then */
+    U32 key;			/* path of the packet being timed, 0 if none */
+    U64 pkt[PROF_STAGES];	/* its ticks so far */
+    U64 packets;
+    U64 ticks[PROF_STAGES];
+    U64 bucket[PROF_STAGES][PROF_BUCKETS];
+    U32 npaths;
+    U64 other;			/* packets of the paths not in the table */
+    struct prof_path path[PROF_PATHS];
+};
+
+/* a stage boundary, nothing unless profiling */
+#define PROF(p, s) ((p) ? prof_switch((p), (s)) : 0)
+
+/*
+ * USDT probes for bpftrace and perf, see contrib/. Each one is a nop and
+ * an ELF note until a tracer attaches; arguments that cost something are
+ * computed only while its semaphore is raised. Without sys/sdt.h, or in a
+ * file not including config.h first, they compile to nothing.
+ */
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PROBE1(n, a) STAP_PROBE1(pangolin, n, a)
+#define PROBE2(n, a, b) STAP_PROBE2(pangolin, n, a, b)
+#define PROBE4(n, a, b, c, d) STAP_PROBE4(pangolin, n, a, b, c, d)
+#define PROBE_ENABLED(n) __builtin_expect(pangolin_##n##_semaphore, 0)
+
+extern volatile unsigned short pangolin_capture_semaphore;
+extern volatile unsigned short pangolin_decode_entry_semaphore;
+extern volatile unsigned short pangolin_decode_return_semaphore;
+extern volatile unsigned short pangolin_filter_accept_semaphore;
+extern volatile unsigned short pangolin_filter_reject_semaphore;
+extern volatile unsigned short pangolin_output_flush_semaphore;
+#else
+#define PROBE1(n, a) ((void)(a))
+#define PROBE2(n, a, b) ((void)(a), (void)(b))
+#define PROBE4(n, a, b, c, d) ((void)(a), (void)(b), (void)(c), (void)(d))
+#define PROBE_ENABLED(n) 0
+#endif
+
 /* decoding context */
 struct context {
     int print_mac_addr;
     int resolve_dns;
     int dump_raw_packet;
+    int depth;			/* deepest layer a consumer needs */
+    struct output *output;	/* NULL for text */
+    struct neigh_table *neigh;	/* annotates -e MACs, NULL if off */
+    int print_ifname;		/* capturing on several interfaces */
+    const struct netns_set *netns;	/* names the namespace, NULL if off */
+    struct prof *prof;		/* NULL unless profiling */
     
     void (*out) (const char *fmt, ...);
     void (*err) (const char *fmt, ...);
 };
 
+/* dissectors */
+void dissect(struct packet *, int);
+int arp_dissect(struct packet *, U16);
+int eth_dissect(struct packet *, U16, int);
+int ip_dissect(struct packet *, U16, int);
+int icmp_dissect(struct packet *, U16);
+int ip6_dissect(struct packet *, U16, int);
+int icmp6_dissect(struct packet *, U16);
+int gre_dissect(struct packet *, U16, int);
+int vxlan_dissect(struct packet *, U16, int);
+int geneve_dissect(struct packet *, U16, int);
+int ipip_dissect(struct packet *, U16, int, int);
+int tcp_dissect(struct packet *, U16, int);
+int udp_dissect(struct packet *, U16, int);
+int bootp_dissect(struct packet *, U16);
+int dhcp_parse(const struct packet *, U16, struct dhcp *);
+int http_dissect(struct packet *, U16);
+int http_parse(const struct packet *, struct http *);
+int tls_dissect(struct packet *, U16);
+int tls_parse(const struct packet *, struct tls *, int);
+void tls_port_add(U16);
+int tls_port(U16);
+
 /* decoders TODO: this name sucks*/
+void eth_mac_addr(const U8 *, char *, size_t);
 void eth_dump(struct packet *, struct context *);
+void eth_ifname_forget(int);
 void arp_dump(struct packet *, struct context *);
 void ip_dump(struct packet *, struct context *);
 void icmp_dump(struct packet *, U8 *, U8 *, struct context *);
+void ip6_dump(struct packet *, struct context *);
+void icmp6_dump(struct packet *, U8 *, U8 *, struct context *);
+void tunnel_dump(struct packet *, struct context *);
 void tcp_dump(struct packet *, U8 *, U8 *, struct context *);
 void udp_dump(struct packet *, U8 *, U8 *, struct context *);
-void bootp_dump(struct packet *, struct context *);
+void bootp_dump(struct packet *, U8 *, U8 *, struct context *);
+void http_dump(struct packet *, struct context *);
+void http_record(struct http_stats *, const struct packet *);
+void http_report(const struct http_stats *);
+void tls_dump(struct packet *, struct context *);
+void tls_record(struct tls_stats *, const struct packet *);
+void tls_report(const struct tls_stats *);
+
+/* netlink.c */
+struct nlmsghdr;
+
+int rtnl_open(U32);
+int rtnl_link(const struct nlmsghdr *, struct if_link *);
+int if_links(int, struct if_link **);
+int if_addrs(int, struct if_addr **);
 
 /* if.c */
-int if_open(const char *);
+int if_open(const char *, const char *);
+int if_open_index(int, const char *);
 void if_close(int);
 int if_list(void);
 int if_index(int, const char *);
 int if_promisc(int, const char *, int);
-int if_stats(int);
+int if_counters(int, U32 *, U32 *);
+int if_stats(int, double);
 int if_filter(int, struct sock_filter *, U16);
+int if_busy_poll(int, int);
+int if_ignore_outgoing(int);
+int if_ring(int, struct ring *, U32);
+void if_ring_close(struct ring *);
+
+/* follow.c */
+int follow_open(struct follow *, const char *, const struct filter *, int);
+int follow_capture(struct follow *, struct packet *, size_t);
+void follow_report(struct follow *);
+void follow_close(struct follow *);
+
+/* netns.c */
+int netns_enter(const char *, int *);
+void netns_leave(int);
+int netns_init(struct netns_set *);
+int netns_add(struct netns_set *, const char *, const char *,
+	      const struct filter *);
+int netns_capture(struct netns_set *, struct packet *, size_t);
+void netns_report(const struct netns_set *);
+void netns_close(struct netns_set *);
+
+/* dedup.c */
+int dedup_check(struct dedup *, const struct packet *);
+void dedup_report(const struct dedup *);
+
+/* xdp.c */
+int xdp_open(struct xsk *, const char *, U32, int, U32);
+int xdp_capture(struct xsk *, struct packet *, size_t);
+int xdp_counters(const struct xsk *, U64 *);
+void xdp_stats(const struct xsk *);
+void xdp_close(struct xsk *);
+
+/* pcap.c */
+int pcap_open(struct pcap *, const char *);
+int pcap_next(struct pcap *, struct pcap_rec *);
+void pcap_rewind(struct pcap *);
+void pcap_close(struct pcap *);
+
+/* replay.c */
+int replay_open(struct replay *, const char *);
+int replay_run(struct replay *, struct pcap *, double, U32);
+void replay_report(struct replay *);
+void replay_close(struct replay *);
 
 /* capture.c */
-int capture(struct packet *, int, int);
+void capture_guard(struct packet *);
+int capture_fanout(struct packet *, struct fanout *, size_t);
+int capture(struct packet *, int, int, size_t, int);
+int capture_ring(struct packet *, int, struct ring *, int, int);
+
+/* dfilter.c */
+int dfilter_compile(struct dfilter *, const char *);
+int dfilter_match(const struct dfilter *, const struct packet *);
+void dfilter_dump(const struct dfilter *);
+
+/* checksum.c */
+U16 csum_partial(const U8 *, U32, U32);
+int checksum_verify(struct checksum *, const struct packet *);
+void checksum_report(const struct checksum *);
+
+/* counter.c */
+U32 counter_hash(const U8 *, U32, U32);
+void printable(char *, const U8 *, U32);
+struct counter *counter_get(struct counters *, U32);
+void counter_report(const struct counters *, const char *);
+
+/* lease.c */
+void lease_update(struct leases *, const struct packet *);
+const U8 *lease_lookup(struct leases *, U32, U64);
+void lease_report(const struct leases *);
+
+/* neigh.c */
+int neigh_update(struct neigh_table *, const struct packet *);
+U32 neigh_ip(struct neigh_table *, const U8 *, U64);
+void neigh_print(const struct neigh_table *, const struct packet *, int);
+void neigh_report(const struct neigh_table *);
+
+/* match.c */
+int matcher_add(struct matcher *, const char *);
+int matcher_load(struct matcher *, const char *);
+int matcher_build(struct matcher *, int);
+U32 matcher_scan(const struct matcher *, const U8 *, U32);
+U32 matcher_packet(const struct matcher *, const struct packet *);
+
+/* output.c */
+int output_open(struct output *, int, int, U32, U32);
+void output_packet(struct output *, const struct packet *);
+void output_close(struct output *);
+
+/* profile.c */
+void prof_init(struct prof *);
+int prof_switch(struct prof *, int);
+void prof_key(struct prof *, const struct packet *);
+void prof_packet(struct prof *);
+void prof_report(const struct prof *);
+
+/* probe.c */
+void probe_capture(const struct packet *);
+
+/* latency.c */
+int cpu_pin(int);
+int sched_fifo(int);
+int log2_bucket(U64, int);
+U64 log2_quantile(const U64 *, int, U64, double);
+void latency_record(struct latency *, const struct timespec *);
+void latency_report(const struct latency *);
 
 /* BPF */
 extern struct sock_filter ARP_code[];
 extern struct sock_filter RARP_code[];
 extern struct sock_filter IP_code[];
 extern struct sock_filter ICMP_code[];
+extern struct sock_filter IP6_code[];
+extern struct sock_filter ICMP6_code[];
 extern struct sock_filter TCP_code[];
 extern struct sock_filter UDP_code[];
 
 extern struct sock_filter PORT_code[];	// customizable
 extern struct sock_filter HOST_code[];	// customizable
+extern struct sock_filter HOST6_code[];	// customizable
+extern struct sock_filter HEADERS_code[];
+extern struct sock_filter HATYPE_code[];
+extern struct sock_filter VLAN_code[];	// customizable
+extern struct sock_filter SAMPLE_code[];	// customizable
+
+/* filters.c */
+void filter_init(struct filter *);
+int filter_append(struct filter *, const struct sock_filter *, U16);
+int filter_finish(struct filter *, U32);
+int filter_vxlan(struct filter *, const struct tuple *);
@@ -0,0 +1,151 @@
+/*
+ * pcap.c -- read pcap capture files, mapped in memory
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pangolin.h"
+
+/*
+ * The classic libpcap format: a 24 bytes file header, then a 16 bytes
+ * header before each packet, all in the byte order of the writer. The
+ * magic tells the order and whether the fraction is in micro or nano
+ * seconds. The whole file is mapped, so that records are read in place
+ * and --loop rewinds for free.
+ */
+
+#define PCAP_MAGIC 0xA1B2C3D4
+#define PCAP_MAGIC_NS 0xA1B23C4D
+#define PCAP_HDR_LEN 24
+#define PCAP_REC_LEN 16
+
+static U32 get32(const struct pcap *p, const U8 *b)
+{
+    if (p->swapped)
+	return (U32) b[3] << 24 | (U32) b[2] << 16 | (U32) b[1] << 8 | b[0];
+
+    return GET32(b);
+}
+
+int pcap_open(struct pcap *p, const char *path)
+{
+    struct stat st;
+    U32 magic;
+    int fd;
+
+    memset(p, 0, sizeof(*p));
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+	fprintf(stderr, "error: %s: %s\n", path, strerror(errno));
+	return -1;
+    }
+
+    if (fstat(fd, &st) < 0) {
+	fprintf(stderr, "error: %s: %s\n", path, strerror(errno));
+	close(fd);
+	return -1;
+    }
+
+    if (st.st_size < PCAP_HDR_LEN) {
+	fprintf(stderr, "error: %s: not a pcap file\n", path);
+	close(fd);
+	return -1;
+    }
+
+    p->len = st.st_size;
+    p->map = mmap(NULL, p->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (p->map == MAP_FAILED) {
+	fprintf(stderr, "error: mmap(): %s\n", strerror(errno));
+	p->map = NULL;
+	return -1;
+    }
+
+    /* read big endian: a little endian writer shows up swapped */
+    magic = GET32(p->map);
+
+    if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NS) {
+	p->nsec = magic == PCAP_MAGIC_NS;
+    } else {
+	p->swapped = 1;
+	magic = get32(p, p->map);
+
+	if (magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS) {
+	    fprintf(stderr, "error: %s: not a pcap file\n", path);
+	    pcap_close(p);
+	    return -1;
+	}
+
+	p->nsec = magic == PCAP_MAGIC_NS;
+    }
+
+    p->snaplen = get32(p, p->map + 16);
+    p->linktype = get32(p, p->map + 20) & 0xFFFF;
+    p->off = PCAP_HDR_LEN;
+
+    (void)madvise(p->map, p->len, MADV_SEQUENTIAL);
+    return 0;
+}
+
+/* 1 and the next record, 0 at the end of the file, -1 if cut short */
+int pcap_next(struct pcap *p, struct pcap_rec *rec)
+{
+    const U8 *h;
+    U32 frac;
+
+    if (p->off == p->len)
+	return 0;
+
+    if (p->len - p->off < PCAP_REC_LEN)
+	return -1;
+
+    h = p->map + p->off;
+    frac = get32(p, h + 4);
+    rec->time = (U64) get32(p, h) * 1000000000 +
+	(p->nsec ? frac : (U64) frac * 1000);
+    rec->caplen = get32(p, h + 8);
+    rec->len = get32(p, h + 12);
+
+    if (rec->caplen > p->len - p->off - PCAP_REC_LEN)
+	return -1;
+
+    rec->data = h + PCAP_REC_LEN;
+    p->off += PCAP_REC_LEN + rec->caplen;
+    return 1;
+}
+
+void pcap_rewind(struct pcap *p)
+{
+    p->off = PCAP_HDR_LEN;
+}
+
+void pcap_close(struct pcap *p)
+{
+    if (p->map != NULL)
+	(void)munmap(p->map, p->len);
+
+    p->map = NULL;
+}
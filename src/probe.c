@@ -0,0 +1,53 @@
+/*
+ * probe.c -- USDT probe semaphores and the capture probe
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <time.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+#ifdef HAVE_SYS_SDT_H
+/* raised by the tracer while attached, found through the .probes section */
+#define SEMAPHORE(n) \
+    volatile unsigned short pangolin_##n##_semaphore \
+	__attribute__ ((section(".probes")))
+
+SEMAPHORE(capture);
+SEMAPHORE(decode_entry);
+SEMAPHORE(decode_return);
+SEMAPHORE(filter_accept);
+SEMAPHORE(filter_reject);
+SEMAPHORE(output_flush);
+#endif
+
+/*
+ * Fired for every packet handed to the loop, whatever the capture path,
+ * with the time it spent queued since the kernel stamped it: negative if
+ * the clock stepped, close to 0 for paths stamping it themselves.
+ */
+void probe_capture(const struct packet *packet)
+{
+    struct timespec now;
+    int64_t ns;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ns = (int64_t) (now.tv_sec - packet->time.tv_sec) * 1000000000 +
+	now.tv_nsec - packet->time.tv_nsec;
+    PROBE4(capture, ns, packet->caplen, packet->len, packet->ifindex);
+}
@@ -0,0 +1,294 @@
+/*
+ * profile.c -- time spent per stage of the capture loop
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pangolin.h"
+
+/*
+ * The loop calls prof_switch() at each stage boundary: one stamp, and
+ * the ticks since the previous one go to the stage that just ended.
+ * Nested stages (a DNS lookup while formatting) switch back to their
+ * caller, so that every tick is charged to exactly one stage.
+ *
+ * prof_packet() closes a packet: from one capture to the next, its
+ * ticks per stage go to the stage histograms and to its protocol path.
+ * The capture stage includes waiting for the packet to arrive, and any
+ * capture that yields nothing.
+ *
+ * Ticks are TSC cycles on x86, nanoseconds from CLOCK_MONOTONIC
+ * elsewhere. The TSC is assumed constant rate (any x86 of the last
+ * decade); its frequency comes from both clocks read at prof_init()
+ * and at report time.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+# define PROF_TSC 1
+#else
+# define PROF_TSC 0
+#endif
+
+static const char *stage_names[PROF_STAGES] = {
+    "capture", "dedup", "dissect", "filter", "stats", "format",
+    "resolve", "service", "write"
+};
+
+static const char *proto_names[] = {
+    "", "eth", "arp", "ip", "icmp", "tcp", "udp", "bootp", "ip6", "icmp6",
+    "gre", "vxlan", "geneve", "ipip", "http", "tls"
+};
+
+static U64 clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static U64 stamp(void)
+{
+#if PROF_TSC
+    return __builtin_ia32_rdtsc();
+#else
+    return clock_ns();
+#endif
+}
+
+void prof_init(struct prof *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->start_ns = clock_ns();
+    p->start = stamp();
+    p->last = p->start;
+    p->cur = PROF_CAPTURE;
+}
+
+/* ends the current stage, returns it so that nested ones can go back */
+int prof_switch(struct prof *p, int stage)
+{
+    U64 now = stamp();
+    int prev = p->cur;
+
+    p->pkt[prev] += now - p->last;
+    p->last = now;
+    p->cur = stage;
+    return prev;
+}
+
+/* the path of the packet being timed, once dissected */
+void prof_key(struct prof *p, const struct packet *packet)
+{
+    const struct layers *l = &packet->layers;
+
+    p->key = 0x80000000 | l->tunnel << 24 | l->l7_proto << 16 |
+	l->l4_proto << 8 | l->l3_proto;
+}
+
+static struct prof_path *prof_path(struct prof *p, U32 key)
+{
+    U32 i = (key * 2654435761U) % PROF_PATHS, n;
+
+    for (n = 0; n < PROF_PATHS; n++, i = (i + 1) % PROF_PATHS) {
+	if (p->path[i].key == key && p->path[i].packets)
+	    return &p->path[i];
+
+	if (p->path[i].packets == 0) {
+	    p->path[i].key = key;
+	    p->npaths++;
+	    return &p->path[i];
+	}
+    }
+
+    return NULL;
+}
+
+/* closes the packet being timed and starts the capture of the next */
+void prof_packet(struct prof *p)
+{
+    struct prof_path *path;
+    U64 total = 0;
+    int s;
+
+    prof_switch(p, PROF_CAPTURE);
+
+    /* nothing came of the capture, say a looped back copy: go on */
+    for (s = PROF_CAPTURE + 1; s < PROF_STAGES && !p->pkt[s]; s++) ;
+
+    if (s == PROF_STAGES && p->key == 0)
+	return;
+
+    path = prof_path(p, p->key);
+
+    for (s = 0; s < PROF_STAGES; s++) {
+	if (p->pkt[s] == 0)
+	    continue;
+
+	p->ticks[s] += p->pkt[s];
+	p->bucket[s][log2_bucket(p->pkt[s], PROF_BUCKETS)]++;
+
+	if (path)
+	    path->ticks[s] += p->pkt[s];
+
+	total += p->pkt[s];
+    }
+
+    if (path) {
+	path->packets++;
+	path->bucket[log2_bucket(total, PROF_BUCKETS)]++;
+    } else
+	p->other++;
+
+    p->packets++;
+    p->key = 0;
+    memset(p->pkt, 0, sizeof(p->pkt));
+}
+
+static void path_name(U32 key, char *buf, size_t len)
+{
+    U8 l3 = key, l4 = key >> 8, l7 = key >> 16, tun = (key >> 24) & 0x7F;
+    size_t n = 0;
+
+    if (key == 0) {
+	snprintf(buf, len, "(not dissected)");
+	return;
+    }
+
+    if (tun)
+	n += snprintf(buf + n, len - n, "%s>", proto_names[tun]);
+
+    n += snprintf(buf + n, len - n, "%s", l3 ? proto_names[l3] : "eth");
+
+    if (l4 && n < len)
+	n += snprintf(buf + n, len - n, "/%s", proto_names[l4]);
+
+    if (l7 && n < len)
+	snprintf(buf + n, len - n, "/%s", proto_names[l7]);
+}
+
+static U64 quantile(const U64 *bucket, U64 count, double q)
+{
+    return log2_quantile(bucket, PROF_BUCKETS, count, q);
+}
+
+static int by_packets(const void *a, const void *b)
+{
+    const struct prof_path *x = *(const struct prof_path * const *)a;
+    const struct prof_path *y = *(const struct prof_path * const *)b;
+
+    return x->packets < y->packets ? 1 : x->packets > y->packets ? -1 : 0;
+}
+
+void prof_report(const struct prof *p)
+{
+    const struct prof_path *sorted[PROF_PATHS];
+    double ns;			/* per tick */
+    U64 elapsed, total = 0;
+    int s, i, n = 0;
+
+    if (p->packets == 0)
+	return;
+
+    elapsed = stamp() - p->start;
+    ns = elapsed ? (double)(clock_ns() - p->start_ns) / elapsed : 1;
+
+    fprintf(stdout, "\nProfile\n-------\n");
+
+    if (PROF_TSC)
+	fprintf(stdout, "\n%llu packets, TSC at %.2f GHz, capture "
+		"includes waiting for packets\n",
+		(unsigned long long)p->packets, 1 / ns);
+    else
+	fprintf(stdout, "\n%llu packets, no cycle counter, capture "
+		"includes waiting for packets\n",
+		(unsigned long long)p->packets);
+
+    fprintf(stdout, "\n%-8s %10s %10s %6s %10s %10s %10s\n", "stage",
+	    "ns/pkt", "cycles/pkt", "share", "p50 ns", "p99 ns", "p99.9 ns");
+
+    for (s = 0; s < PROF_STAGES; s++)
+	total += p->ticks[s];
+
+    for (s = 0; s < PROF_STAGES; s++) {
+	U64 count = 0;
+	int b;
+
+	for (b = 0; b < PROF_BUCKETS; b++)
+	    count += p->bucket[s][b];
+
+	if (count == 0)
+	    continue;
+
+	fprintf(stdout, "%-8s %10.0f ", stage_names[s],
+		p->ticks[s] * ns / p->packets);
+
+	if (PROF_TSC)
+	    fprintf(stdout, "%10.0f ", (double)p->ticks[s] / p->packets);
+	else
+	    fprintf(stdout, "%10s ", "-");
+
+	/* the quantiles are of the packets that went through the stage */
+	fprintf(stdout, "%5.1f%% %10.0f %10.0f %10.0f\n",
+		100.0 * p->ticks[s] / total,
+		quantile(p->bucket[s], count, 0.5) * ns,
+		quantile(p->bucket[s], count, 0.99) * ns,
+		quantile(p->bucket[s], count, 0.999) * ns);
+    }
+
+    for (i = 0; i < PROF_PATHS; i++)
+	if (p->path[i].packets)
+	    sorted[n++] = &p->path[i];
+
+    qsort(sorted, n, sizeof(*sorted), by_packets);
+    fprintf(stdout, "\nBy protocol path, per packet:\n");
+
+    for (i = 0; i < n; i++) {
+	const struct prof_path *path = sorted[i];
+	char name[64];
+
+	for (total = 0, s = 0; s < PROF_STAGES; s++)
+	    total += path->ticks[s];
+
+	path_name(path->key, name, sizeof name);
+	fprintf(stdout, "  %-20s %10llu packets %8.0f ns", name,
+		(unsigned long long)path->packets,
+		total * ns / path->packets);
+
+	if (PROF_TSC)
+	    fprintf(stdout, " %8.0f cycles",
+		    (double)total / path->packets);
+
+	fprintf(stdout, ", p99 %.0f ns\n   ",
+		quantile(path->bucket, path->packets, 0.99) * ns);
+
+	for (s = 0; s < PROF_STAGES; s++)
+	    if (path->ticks[s])
+		fprintf(stdout, " %s %.0f", stage_names[s],
+			path->ticks[s] * ns / path->packets);
+
+	fprintf(stdout, "\n");
+    }
+
+    if (p->other)
+	fprintf(stdout, "  %llu packets of other paths\n",
+		(unsigned long long)p->other);
+}
@@ -0,0 +1,383 @@
+/*
+ * replay.c -- transmit a pcap file through a PACKET_TX_RING
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <linux/if.h>
+#include <linux/if_packet.h>
+
+#include "pangolin.h"
+
+/*
+ * Frames are filled in ring order and handed to the kernel by setting
+ * their status to TP_STATUS_SEND_REQUEST; a send() with no data then
+ * transmits every frame requested so far, and the kernel gives each
+ * back as TP_STATUS_AVAILABLE once the driver is done with it.
+ *
+ * Flat out, a quarter of the ring goes per send(). At the recorded
+ * timing each frame goes on its own, once its time has come: the
+ * clock restarts on every loop, relative to the first packet.
+ *
+ * The socket is bound with protocol 0, so that it never receives, and
+ * with PACKET_QDISC_BYPASS frames go straight to the driver. Under
+ * PACKET_LOSS the kernel drops a malformed frame rather than stalling
+ * the ring behind it, so frames are checked against the MTU first.
+ */
+
+#ifndef SOL_PACKET
+# define SOL_PACKET 263
+#endif
+
+/* Linux 3.14 */
+#ifndef PACKET_QDISC_BYPASS
+# define PACKET_QDISC_BYPASS 20
+#endif
+
+/* where the kernel wants the frame data without PACKET_TX_HAS_OFF */
+#define TX_OFF (TPACKET2_HDRLEN - sizeof(struct sockaddr_ll))
+
+/* ethernet header and one tag on top of the MTU */
+#define TX_HDR_MAX 18
+
+static U64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until(U64 due)
+{
+    struct timespec ts;
+
+    ts.tv_sec = due / 1000000000;
+    ts.tv_nsec = due % 1000000000;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	   EINTR) ;
+}
+
+static struct tpacket2_hdr *frame(const struct replay *r, U32 n)
+{
+    return (struct tpacket2_hdr *)(r->map + (size_t)n * r->framesize);
+}
+
+int replay_open(struct replay *r, const char *iface)
+{
+    struct tpacket_req req;
+    struct sockaddr_ll sll;
+    struct ifreq ifreq;
+    int version = TPACKET_V2;
+    int one = 1;
+    U32 blocksize;
+    int index;
+
+    memset(r, 0, sizeof(*r));
+
+    if ((r->fd = socket(PF_PACKET, SOCK_RAW, 0)) < 0) {
+	fprintf(stderr, "error: socket(): %s\n", strerror(errno));
+	return -1;
+    }
+
+    if ((index = if_index(r->fd, iface)) < 0)
+	return -1;
+
+    memset(&ifreq, 0, sizeof(ifreq));
+    strncpy(ifreq.ifr_name, iface, IFNAMSIZ - 1);
+
+    if (ioctl(r->fd, SIOCGIFMTU, &ifreq) < 0) {
+	fprintf(stderr, "error: ioctl(SIOCGIFMTU): %s\n", strerror(errno));
+	return -1;
+    }
+
+    r->mtu = ifreq.ifr_mtu;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = PF_PACKET;
+    sll.sll_ifindex = index;
+
+    if (bind(r->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+	fprintf(stderr, "error: bind(): %s\n", strerror(errno));
+	return -1;
+    }
+
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version,
+		   sizeof(version)) < 0) {
+	fprintf(stderr, "error: setsockopt(PACKET_VERSION): %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one)) < 0) {
+	fprintf(stderr, "error: setsockopt(PACKET_LOSS): %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one,
+		   sizeof(one)) < 0)
+	fprintf(stderr, "warning: frames go through the qdisc: %s\n",
+		strerror(errno));
+
+    for (r->framesize = TPACKET_ALIGNMENT;
+	 r->framesize < TX_OFF + r->mtu + TX_HDR_MAX;)
+	r->framesize <<= 1;
+
+    blocksize = getpagesize();
+
+    while (blocksize < r->framesize)
+	blocksize <<= 1;
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = blocksize;
+    req.tp_block_nr = RING_BYTES / blocksize;
+
+    if (req.tp_block_nr < 8)
+	req.tp_block_nr = 8;
+
+    req.tp_frame_size = r->framesize;
+    req.tp_frame_nr = req.tp_block_nr * (blocksize / r->framesize);
+
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+	fprintf(stderr, "error: setsockopt(PACKET_TX_RING): %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    r->maplen = (size_t)req.tp_block_size * req.tp_block_nr;
+    r->map = mmap(NULL, r->maplen, PROT_READ | PROT_WRITE, MAP_SHARED,
+		  r->fd, 0);
+
+    if (r->map == MAP_FAILED) {
+	fprintf(stderr, "error: mmap(): %s\n", strerror(errno));
+	r->map = NULL;
+	return -1;
+    }
+
+    r->nframes = req.tp_frame_nr;
+    return 0;
+}
+
+/* transmits the frames requested so far, all of them if wait */
+static int replay_kick(struct replay *r, int wait)
+{
+    r->pending = 0;
+
+    if (send(r->fd, NULL, 0, wait ? 0 : MSG_DONTWAIT) >= 0)
+	return 0;
+
+    switch (errno) {
+    case EAGAIN:
+    case EINTR:
+	return 0;
+
+    case ENOBUFS:
+	/* the driver refused one, the next send() goes on */
+	r->errors++;
+	return 0;
+    }
+
+    fprintf(stderr, "error: send(): %s\n", strerror(errno));
+    return -1;
+}
+
+/* the next frame, once the kernel gave it back */
+static struct tpacket2_hdr *replay_frame(struct replay *r)
+{
+    struct tpacket2_hdr *hdr = frame(r, r->cur);
+
+    for (;;) {
+	U32 status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+	struct pollfd pfd;
+
+	if (status == TP_STATUS_AVAILABLE)
+	    return hdr;
+
+	if (status & TP_STATUS_WRONG_FORMAT) {
+	    r->errors++;
+	    return hdr;
+	}
+
+	/* still queued, or still with the driver */
+	if ((status & TP_STATUS_SEND_REQUEST) && replay_kick(r, 0))
+	    return NULL;
+
+	pfd.fd = r->fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+
+	if (poll(&pfd, 1, 1) < 0 && errno != EINTR) {
+	    fprintf(stderr, "error: poll(): %s\n", strerror(errno));
+	    return NULL;
+	}
+    }
+}
+
+static int replay_queue(struct replay *r, const U8 * data, U32 len)
+{
+    struct tpacket2_hdr *hdr;
+
+    if ((hdr = replay_frame(r)) == NULL)
+	return -1;
+
+    memcpy((U8 *) hdr + TX_OFF, data, len);
+    hdr->tp_len = len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+		     __ATOMIC_RELEASE);
+
+    r->cur = (r->cur + 1) % r->nframes;
+    r->pending++;
+    r->packets++;
+    r->bytes += len;
+    return 0;
+}
+
+/* waits for the whole ring, then collects what the kernel refused */
+static int replay_drain(struct replay *r)
+{
+    U32 i;
+
+    if (replay_kick(r, 1))
+	return -1;
+
+    for (i = 0; i < r->nframes; i++) {
+	struct tpacket2_hdr *hdr = frame(r, i);
+
+	if (hdr->tp_status & TP_STATUS_WRONG_FORMAT) {
+	    r->errors++;
+	    hdr->tp_status = TP_STATUS_AVAILABLE;
+	}
+    }
+
+    return 0;
+}
+
+/* speed 0 sends flat out, loops 0 for ever */
+int replay_run(struct replay *r, struct pcap *p, double speed, U32 loops)
+{
+    struct pcap_rec rec;
+    U32 batch = r->nframes / 4 ? r->nframes / 4 : 1;
+    U64 sent = 0;
+    int sts;
+
+    r->start = now_ns();
+
+    for (r->loops = 0; loops == 0 || r->loops < loops; r->loops++) {
+	U64 start = now_ns(), first = 0;
+	int timed = 0;
+
+	pcap_rewind(p);
+
+	while ((sts = pcap_next(p, &rec)) > 0) {
+	    U32 max = r->mtu + 14;
+
+	    if (rec.caplen >= 14 && GET16(rec.data + 12) == 0x8100)
+		max += 4;
+
+	    if (rec.caplen < 14 || rec.caplen > max) {
+		r->skipped++;
+		continue;
+	    }
+
+	    if (speed > 0) {
+		U64 due;
+
+		if (!timed)
+		    first = rec.time, timed = 1;
+
+		due = start + (rec.time > first ?
+			       (U64) ((rec.time - first) / speed) : 0);
+
+		if (due > now_ns()) {
+		    if (r->pending && replay_kick(r, 0))
+			return -1;
+
+		    sleep_until(due);
+		}
+	    }
+
+	    if (replay_queue(r, rec.data, rec.caplen))
+		return -1;
+
+	    if (speed > 0 || r->pending >= batch)
+		if (replay_kick(r, 0))
+		    return -1;
+	}
+
+	if (sts < 0)
+	    fprintf(stderr, "warning: the pcap file is cut short\n");
+
+	/* nothing to send, for ever */
+	if (r->packets == sent)
+	    break;
+
+	sent = r->packets;
+    }
+
+    if (replay_drain(r))
+	return -1;
+
+    r->end = now_ns();
+    return 0;
+}
+
+void replay_report(struct replay *r)
+{
+    double secs;
+
+    if (!r->end)
+	r->end = now_ns();
+
+    secs = (r->end - r->start) / 1e9;
+
+    fprintf(stdout, "\nReplay statistics\n-----------------\n");
+    fprintf(stdout, "\n%llu packets, %llu bytes sent in %.3f s, %u loop%s.\n",
+	    (unsigned long long)r->packets, (unsigned long long)r->bytes,
+	    secs, r->loops, r->loops != 1 ? "s" : "");
+
+    if (secs > 0)
+	fprintf(stdout, "%.0f packets/s, %.3f Mbit/s.\n", r->packets / secs,
+		r->bytes * 8 / secs / 1e6);
+
+    fprintf(stdout, "%llu transmit errors, %llu packets skipped "
+	    "(shorter than a header or longer than the MTU).\n",
+	    (unsigned long long)r->errors, (unsigned long long)r->skipped);
+}
+
+void replay_close(struct replay *r)
+{
+    if (r->map != NULL)
+	(void)munmap(r->map, r->maplen);
+
+    if (r->fd > 0)
+	close(r->fd);
+
+    r->map = NULL;
+    r->fd = -1;
+}
@@ -0,0 +1,541 @@
+/*
+ * xdp.c -- AF_XDP capture: an XDP program redirects into a UMEM
+ * Copyright (C) 2004-2011  Davide Angelocola <davide.angelocola@gmail.com>
+ *
+ * Pangolin is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Pangolin is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "config.h"
+#include "pangolin.h"
+
+/*
+ * No libbpf: the XDP program is assembled here and loaded, together
+ * with its XSKMAP, through bpf(2). It is attached with a BPF link, so
+ * the kernel detaches it whenever the process dies, however it dies.
+ *
+ * The program may pre-filter by protocol: whatever it does not redirect
+ * goes on to the network stack, as does everything arriving on another
+ * queue than the one bound. What it redirects does not.
+ *
+ * UMEM frames start on the fill ring. Receive descriptors are taken in
+ * batches of up to XSK_BATCH, copied out one per xdp_capture() call,
+ * and the frames of a whole batch go back on the fill ring at once.
+ */
+
+#ifdef HAVE_LINUX_IF_XDP_H
+
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#ifndef AF_XDP
+# define AF_XDP 44
+#endif
+
+#ifndef SOL_XDP
+# define SOL_XDP 283
+#endif
+
+/* the XSKMAP covers this many queues */
+#define XSK_QUEUES 64
+
+/* one eBPF instruction */
+#define INSN(c, d, s, o, i) \
+    ((struct bpf_insn) { (c), (d), (s), (o), (i) })
+
+#define MOV64_REG(d, s)	INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define MOV64_IMM(d, i)	INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define ADD64_IMM(d, i)	INSN(BPF_ALU64 | BPF_ADD | BPF_K, d, 0, 0, i)
+#define LDX(size, d, s, o) INSN(BPF_LDX | (size) | BPF_MEM, d, s, o, 0)
+#define JMP_REG(op, d, s) INSN(BPF_JMP | (op) | BPF_X, d, s, 0, 0)
+#define JMP_IMM(op, d, i) INSN(BPF_JMP | (op) | BPF_K, d, 0, 0, i)
+#define CALL(f)		INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define EXIT()		INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+/* the largest program: prologue, 8 tests, redirect and pass */
+#define XSK_PROG_MAX 32
+
+static long sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/* jumps to the redirect (1) or pass (0) tail, patched once it is known */
+struct prog {
+    struct bpf_insn insn[XSK_PROG_MAX];
+    int len;
+    int to[XSK_PROG_MAX];	/* tail of each jump, -1 if none */
+};
+
+static void emit(struct prog *p, struct bpf_insn insn, int to)
+{
+    p->to[p->len] = to;
+    p->insn[p->len++] = insn;
+}
+
+/*
+ * r6 = ctx, r2/r3 = data/data_end, r5 = ethertype, r0 = IP protocol.
+ * Loads are in host order, so the constants are swapped to match.
+ */
+static void xsk_filter(struct prog *p, U32 protos)
+{
+    static const struct {
+	U32 proto;
+	U16 type;
+    } types[] = {
+	{ XSK_ARP, 0x0806 }, { XSK_RARP, 0x8035 },
+	{ XSK_IP, 0x0800 }, { XSK_IP6, 0x86DD }
+    };
+    int i, skip;
+
+    emit(p, LDX(BPF_W, 2, 6, 0), -1);
+    emit(p, LDX(BPF_W, 3, 6, 4), -1);
+    emit(p, MOV64_REG(4, 2), -1);
+    emit(p, ADD64_IMM(4, 24), -1);
+    emit(p, JMP_REG(BPF_JGT, 4, 3), 0);
+    emit(p, LDX(BPF_H, 5, 2, 12), -1);
+
+    for (i = 0; i < 4; i++)
+	if (protos & types[i].proto)
+	    emit(p, JMP_IMM(BPF_JEQ, 5, TONET16(types[i].type)), 1);
+
+    if (protos & (XSK_ICMP | XSK_TCP | XSK_UDP)) {
+	skip = p->len;
+	emit(p, JMP_IMM(BPF_JNE, 5, TONET16(0x0800)), -1);
+	emit(p, LDX(BPF_B, 0, 2, 23), -1);
+
+	if (protos & XSK_ICMP)
+	    emit(p, JMP_IMM(BPF_JEQ, 0, 1), 1);
+
+	if (protos & XSK_TCP)
+	    emit(p, JMP_IMM(BPF_JEQ, 0, 6), 1);
+
+	if (protos & XSK_UDP)
+	    emit(p, JMP_IMM(BPF_JEQ, 0, 17), 1);
+
+	p->insn[skip].off = p->len - skip - 1;
+    }
+
+    if (protos & XSK_ICMP6) {
+	emit(p, JMP_IMM(BPF_JNE, 5, TONET16(0x86DD)), 0);
+	emit(p, LDX(BPF_B, 0, 2, 20), -1);
+	emit(p, JMP_IMM(BPF_JEQ, 0, 58), 1);
+    }
+
+    emit(p, INSN(BPF_JMP | BPF_JA, 0, 0, 0, 0), 0);
+}
+
+static int xsk_prog(struct xsk *x, U32 protos)
+{
+    union bpf_attr attr;
+    struct prog p;
+    int i, tail[2];
+    char log[4096];
+
+    p.len = 0;
+    emit(&p, MOV64_REG(6, 1), -1);
+
+    if (protos)
+	xsk_filter(&p, protos);
+
+    /* bpf_redirect_map(map, rx_queue_index, XDP_PASS if no socket) */
+    tail[1] = p.len;
+    emit(&p, LDX(BPF_W, 2, 6, 16), -1);
+    emit(&p, INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0,
+		  x->map_fd), -1);
+    emit(&p, INSN(0, 0, 0, 0, 0), -1);
+    emit(&p, MOV64_IMM(3, XDP_PASS), -1);
+    emit(&p, CALL(BPF_FUNC_redirect_map), -1);
+    emit(&p, EXIT(), -1);
+
+    /* the verifier rejects unreachable code */
+    if (protos) {
+	tail[0] = p.len;
+	emit(&p, MOV64_IMM(0, XDP_PASS), -1);
+	emit(&p, EXIT(), -1);
+    }
+
+    for (i = 0; i < p.len; i++)
+	if (p.to[i] >= 0)
+	    p.insn[i].off = tail[p.to[i]] - i - 1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (U64) (unsigned long)p.insn;
+    attr.insn_cnt = p.len;
+    attr.license = (U64) (unsigned long)"GPL";
+    attr.log_buf = (U64) (unsigned long)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    log[0] = '\0';
+
+    if ((x->prog_fd = sys_bpf(BPF_PROG_LOAD, &attr)) < 0) {
+	fprintf(stderr, "error: cannot load the XDP program: %s\n%s",
+		strerror(errno), log);
+	return -1;
+    }
+
+    return 0;
+}
+
+static void *xsk_map_ring(struct xsk *x, struct xsk_ring *r,
+			  const struct xdp_ring_offset *off, U32 n,
+			  size_t elem, off_t pgoff)
+{
+    r->maplen = off->desc + n * elem;
+    r->map = mmap(NULL, r->maplen, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, x->fd, pgoff);
+
+    if (r->map == MAP_FAILED) {
+	fprintf(stderr, "error: mmap(): %s\n", strerror(errno));
+	r->map = NULL;
+	return NULL;
+    }
+
+    r->producer = (U32 *) ((U8 *) r->map + off->producer);
+    r->consumer = (U32 *) ((U8 *) r->map + off->consumer);
+    r->desc = (U8 *) r->map + off->desc;
+    r->mask = n - 1;
+    return r->map;
+}
+
+static int xsk_socket(struct xsk *x, U32 queue, int mode)
+{
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t len = sizeof(off);
+    int n = XSK_FRAMES, small = 64;
+    U64 *fill;
+    U32 i;
+
+    if ((x->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0)) < 0) {
+	fprintf(stderr, "error: cannot create AF_XDP socket: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    x->umem = mmap(NULL, (size_t)XSK_FRAMES * XSK_FRAME_SIZE,
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (x->umem == MAP_FAILED) {
+	fprintf(stderr, "error: mmap(): %s\n", strerror(errno));
+	x->umem = NULL;
+	return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (U64) (unsigned long)x->umem;
+    reg.len = (U64) XSK_FRAMES * XSK_FRAME_SIZE;
+    reg.chunk_size = XSK_FRAME_SIZE;
+
+    /* a completion ring is required, even if nothing is ever sent */
+    if (setsockopt(x->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0
+	|| setsockopt(x->fd, SOL_XDP, XDP_UMEM_FILL_RING, &n, sizeof(n)) < 0
+	|| setsockopt(x->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &small,
+		      sizeof(small)) < 0
+	|| setsockopt(x->fd, SOL_XDP, XDP_RX_RING, &n, sizeof(n)) < 0) {
+	fprintf(stderr, "error: cannot set up the UMEM: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    if (getsockopt(x->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) < 0) {
+	fprintf(stderr, "error: getsockopt(XDP_MMAP_OFFSETS): %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    if (!xsk_map_ring(x, &x->rx, &off.rx, XSK_FRAMES,
+		      sizeof(struct xdp_desc), XDP_PGOFF_RX_RING)
+	|| !xsk_map_ring(x, &x->fill, &off.fr, XSK_FRAMES, sizeof(U64),
+			 XDP_UMEM_PGOFF_FILL_RING))
+	return -1;
+
+    /* every frame is the kernel's to start with */
+    for (fill = x->fill.desc, i = 0; i < XSK_FRAMES; i++)
+	fill[i] = (U64) i * XSK_FRAME_SIZE;
+
+    __atomic_store_n(x->fill.producer, XSK_FRAMES, __ATOMIC_RELEASE);
+    x->fill.cached = XSK_FRAMES;
+    x->rx.cached = __atomic_load_n(x->rx.consumer, __ATOMIC_ACQUIRE);
+    x->cur = x->end = x->rx.cached;
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = x->ifindex;
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags = mode == XSK_SKB ? XDP_COPY : 0;
+
+    if (bind(x->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+	fprintf(stderr, "error: cannot bind AF_XDP socket to queue %u: %s\n",
+		queue, strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+int xdp_open(struct xsk *x, const char *iface, U32 queue, int mode,
+	     U32 protos)
+{
+    union bpf_attr attr;
+    int fd;
+
+    memset(x, 0, sizeof(*x));
+    x->fd = x->map_fd = x->prog_fd = x->link_fd = -1;
+
+    if (queue >= XSK_QUEUES) {
+	fprintf(stderr, "error: queue %u, at most %d\n", queue,
+		XSK_QUEUES - 1);
+	return -1;
+    }
+
+    /* any socket does for the name lookup */
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	return -1;
+
+    x->ifindex = if_index(fd, iface);
+    close(fd);
+
+    if (x->ifindex < 0 || xsk_socket(x, queue, mode))
+	return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = 4;
+    attr.value_size = 4;
+    attr.max_entries = XSK_QUEUES;
+
+    if ((x->map_fd = sys_bpf(BPF_MAP_CREATE, &attr)) < 0) {
+	fprintf(stderr, "error: cannot create the XSKMAP: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = x->map_fd;
+    attr.key = (U64) (unsigned long)&queue;
+    attr.value = (U64) (unsigned long)&x->fd;
+
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+	fprintf(stderr, "error: cannot add the socket to the XSKMAP: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    if (xsk_prog(x, protos))
+	return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = x->prog_fd;
+    attr.link_create.target_ifindex = x->ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = mode == XSK_SKB ? XDP_FLAGS_SKB_MODE :
+	XDP_FLAGS_DRV_MODE;
+
+    if ((x->link_fd = sys_bpf(BPF_LINK_CREATE, &attr)) < 0) {
+	fprintf(stderr, "error: cannot attach the XDP program to %s: %s\n",
+		iface, strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+/* the frames of the last batch back to the kernel, all at once */
+static void xsk_release(struct xsk *x)
+{
+    U64 *fill = x->fill.desc;
+    U32 i;
+
+    __atomic_store_n(x->rx.consumer, x->cur, __ATOMIC_RELEASE);
+
+    /* never full: there are as many slots as frames */
+    for (i = 0; i < x->nrecycle; i++)
+	fill[x->fill.cached++ & x->fill.mask] = x->recycle[i];
+
+    __atomic_store_n(x->fill.producer, x->fill.cached, __ATOMIC_RELEASE);
+    x->nrecycle = 0;
+}
+
+/* same as capture(), from the RX ring */
+int xdp_capture(struct xsk *x, struct packet *packet, size_t snaplen)
+{
+    const struct xdp_desc *d;
+
+    if (x->cur == x->end) {
+	U32 prod;
+
+	if (x->nrecycle)
+	    xsk_release(x);
+
+	while ((prod = __atomic_load_n(x->rx.producer, __ATOMIC_ACQUIRE))
+	       == x->cur) {
+	    struct pollfd pfd;
+
+	    pfd.fd = x->fd;
+	    pfd.events = POLLIN;
+	    pfd.revents = 0;
+
+	    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+		fprintf(stderr, "error: poll(): %s\n", strerror(errno));
+		return -1;
+	    }
+	}
+
+	x->end = prod - x->cur > XSK_BATCH ? x->cur + XSK_BATCH : prod;
+    }
+
+    d = (const struct xdp_desc *)x->rx.desc + (x->cur++ & x->rx.mask);
+
+    if (snaplen > PKT_DATA_LEN)
+	snaplen = PKT_DATA_LEN;
+
+    /* the ring has no timestamps, take ours */
+    clock_gettime(CLOCK_REALTIME, &packet->time);
+    packet->len = d->len;
+    packet->caplen = d->len < snaplen ? d->len : snaplen;
+    packet->type = 0;
+    packet->status = 0;
+    packet->vlan_tpid = 0;
+    packet->vlan_tci = 0;
+    packet->ifindex = x->ifindex;
+    packet->netns = 0;
+    memcpy(packet->base, x->umem + d->addr, packet->caplen);
+    capture_guard(packet);
+
+    x->recycle[x->nrecycle++] = d->addr & ~(U64) (XSK_FRAME_SIZE - 1);
+    x->packets++;
+    return 1;
+}
+
+/* drops since the socket was opened, every reason together */
+int xdp_counters(const struct xsk *x, U64 * drops)
+{
+    struct xdp_statistics st;
+    socklen_t len = sizeof(st);
+
+    if (getsockopt(x->fd, SOL_XDP, XDP_STATISTICS, &st, &len) < 0) {
+	fprintf(stderr, "error: cannot fetch AF_XDP statistics: %s\n",
+		strerror(errno));
+	return -1;
+    }
+
+    *drops = st.rx_dropped + st.rx_ring_full + st.rx_fill_ring_empty_descs;
+    return 0;
+}
+
+void xdp_stats(const struct xsk *x)
+{
+    struct xdp_statistics st;
+    socklen_t len = sizeof(st);
+
+    if (getsockopt(x->fd, SOL_XDP, XDP_STATISTICS, &st, &len) < 0) {
+	fprintf(stderr, "error: cannot fetch AF_XDP statistics: %s\n",
+		strerror(errno));
+	return;
+    }
+
+    fprintf(stdout, "\nPacket statistics\n-----------------\n");
+    fprintf(stdout, "\n%llu packets captured.\n",
+	    (unsigned long long)x->packets);
+    fprintf(stdout, "%llu packets dropped: %llu ring full, %llu no fill "
+	    "frame, %llu other.\n",
+	    (unsigned long long)(st.rx_dropped + st.rx_ring_full +
+				 st.rx_fill_ring_empty_descs),
+	    (unsigned long long)st.rx_ring_full,
+	    (unsigned long long)st.rx_fill_ring_empty_descs,
+	    (unsigned long long)st.rx_dropped);
+}
+
+void xdp_close(struct xsk *x)
+{
+    if (x->link_fd >= 0)
+	close(x->link_fd);
+
+    if (x->prog_fd >= 0)
+	close(x->prog_fd);
+
+    if (x->map_fd >= 0)
+	close(x->map_fd);
+
+    if (x->rx.map)
+	munmap(x->rx.map, x->rx.maplen);
+
+    if (x->fill.map)
+	munmap(x->fill.map, x->fill.maplen);
+
+    if (x->fd >= 0)
+	close(x->fd);
+
+    if (x->umem)
+	munmap(x->umem, (size_t)XSK_FRAMES * XSK_FRAME_SIZE);
+
+    memset(x, 0, sizeof(*x));
+    x->fd = x->map_fd = x->prog_fd = x->link_fd = -1;
+}
+
+#else /* !HAVE_LINUX_IF_XDP_H */
+
+int xdp_open(struct xsk *x, const char *iface, U32 queue, int mode,
+	     U32 protos)
+{
+    (void)x;
+    (void)queue;
+    (void)mode;
+    (void)protos;
+    fprintf(stderr, "error: %s: AF_XDP is not supported by this build\n",
+	    iface);
+    return -1;
+}
+
+int xdp_capture(struct xsk *x, struct packet *packet, size_t snaplen)
+{
+    (void)x;
+    (void)packet;
+    (void)snaplen;
+    errno = ENOSYS;
+    return -1;
+}
+
+int xdp_counters(const struct xsk *x, U64 * drops)
+{
+    (void)x;
+    *drops = 0;
+    return -1;
+}
+
+void xdp_stats(const struct xsk *x)
+{
+    (void)x;
+}
+
+void xdp_close(struct xsk *x)
+{
+    (void)x;
+}
+
+#endif /* HAVE_LINUX_IF_XDP_H */
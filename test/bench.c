@@ -0,0 +1,828 @@
+/*
+ * End to end capture benchmark: a veth pair in a private network
+ * namespace, a generator thread blasting a packet mix at increasing
+ * rates into one end and the capture loop on the other, for each
+ * capture mode. It reports the highest rate with no drops on the
+ * capture side, and the CPU time spent per captured packet.
+ *
+ * Needs root, see "make bench". The namespace, and with it the veth
+ * pair, goes away with the process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+#include <linux/if_packet.h>
+
+#include "pangolin.h"
+
+#define BENCH_TX "bench0"	/* the generator sends here */
+#define BENCH_RX "bench1"	/* and the capture loop reads there */
+#define BENCH_RING "pangolin-bench"
+
+#define FRAMES 1024		/* distinct frames, sent round robin */
+#define FRAME_MAX 1514
+#define BATCH 32		/* per sendmmsg() */
+#define SNAPLEN 2048
+
+/* IEEE local experimental ethertype, ends a step */
+#define WAKE_TYPE 0x88B5
+#define WAKE_QUIT 0xFFFFFFFF
+
+#ifndef PACKET_QDISC_BYPASS
+# define PACKET_QDISC_BYPASS 20
+#endif
+
+enum { MODE_SOCKET, MODE_RING, MODE_XDP, MODE_FANOUT, MODES };
+
+static const char *mode_names[MODES] = { "socket", "ring", "xdp", "fanout" };
+
+enum { MIX_UDP, MIX_TCP, MIX_ARP, MIXES };
+
+static const char *mix_names[MIXES] = { "udp", "tcp", "arp" };
+
+struct weight {
+    U32 value;
+    U32 weight;
+};
+
+#define SIZES_MAX 16
+
+static struct {
+    U32 duration;		/* ms per step */
+    double start;		/* pps */
+    double max;
+    double factor;
+    struct weight mix[MIXES];
+    struct weight sizes[SIZES_MAX];
+    int nsizes;
+    int modes[MODES];
+} opt;
+
+struct gen {
+    int fd;
+    double rate;
+    U32 step;
+    U32 acked;			/* last step whose end was seen */
+    U64 sent;
+    U64 errors;
+    double secs;
+};
+
+struct result {
+    double rate;		/* highest without drops, 0 if none */
+    double cpu;			/* ns per packet at that rate */
+    const char *stop;		/* why it stopped stepping */
+};
+
+static U8 frames[FRAMES][FRAME_MAX];
+static struct iovec iov[FRAMES];
+static struct mmsghdr msgs[FRAMES];
+
+static struct packet packet;
+static struct packet rpacket;	/* the fanout reader's */
+
+static int fd = -1;
+static int loindex;
+static struct ring ring;
+static struct xsk xsk;
+static struct fanout pub;
+static struct fanout sub;
+static U64 rcount;		/* packets read from the fanout ring */
+static U32 rseen;		/* last step the reader saw the end of */
+static int reading;		/* the reader thread runs */
+
+static U64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (U64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static U64 cpu_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (U64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_ns(U64 ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    nanosleep(&ts, NULL);
+}
+
+/* "name:weight,...", names from names or numbers if names is NULL */
+static int parse_weights(char *arg, struct weight *w, int max,
+			 const char **names)
+{
+    int n = 0;
+    char *tok, *save = NULL;
+
+    for (tok = strtok_r(arg, ",", &save); tok;
+	 tok = strtok_r(NULL, ",", &save)) {
+	char *colon = strchr(tok, ':'), *ep;
+	long v;
+
+	if (n == max)
+	    return -1;
+
+	if (colon)
+	    *colon = '\0';
+
+	if (names) {
+	    for (v = 0; v < max && strcmp(tok, names[v]); v++) ;
+
+	    if (v == max)
+		return -1;
+	} else {
+	    v = strtol(tok, &ep, 10);
+
+	    if (*ep != '\0' || v < 60 || v > FRAME_MAX)
+		return -1;
+	}
+
+	w[n].value = v;
+	w[n].weight = colon ? strtoul(colon + 1, &ep, 10) : 1;
+
+	if (colon && *ep != '\0')
+	    return -1;
+
+	n++;
+    }
+
+    return n;
+}
+
+static U32 pick(const struct weight *w, int n, U32 *seed)
+{
+    U32 total = 0, r;
+    int i;
+
+    for (i = 0; i < n; i++)
+	total += w[i].weight;
+
+    *seed = *seed * 1103515245 + 12345;
+    r = (*seed >> 8) % (total ? total : 1);
+
+    for (i = 0; i < n - 1 && r >= w[i].weight; i++)
+	r -= w[i].weight;
+
+    return w[i].value;
+}
+
+static void put16(U8 * p, U16 v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+/* unicast to nobody, so that the stack behind the capture drops them */
+static U32 build_frame(U8 * p, int proto, U32 size, U32 i)
+{
+    static const U8 dst[6] = { 0x02, 0, 0, 0, 0, 0x02 };
+    static const U8 src[6] = { 0x02, 0, 0, 0, 0, 0x01 };
+    U8 *ip = p + 14, *l4 = p + 34;
+
+    memset(p, 0, FRAME_MAX);
+    memcpy(p, dst, 6);
+    memcpy(p + 6, src, 6);
+
+    if (proto == MIX_ARP) {
+	put16(p + 12, 0x0806);
+	put16(ip, 1);
+	put16(ip + 2, 0x0800);
+	ip[4] = 6;
+	ip[5] = 4;
+	put16(ip + 6, 1);
+	memcpy(ip + 8, src, 6);
+	ip[14] = 10, ip[15] = 2, ip[17] = 1;
+	ip[24] = 10, ip[25] = 2, ip[27] = 2;
+	return 60;
+    }
+
+    put16(p + 12, 0x0800);
+    ip[0] = 0x45;
+    put16(ip + 2, size - 14);
+    put16(ip + 4, i);
+    ip[8] = 64;
+    ip[9] = proto == MIX_TCP ? 6 : 17;
+    ip[12] = 10, ip[13] = 2, ip[15] = 1;
+    ip[16] = 10, ip[17] = 2, ip[19] = 2;
+    put16(l4, 1024 + i);
+
+    if (proto == MIX_TCP) {
+	put16(l4 + 2, 80);
+	l4[12] = 0x50;
+	l4[13] = i & 1 ? 0x10 : 0x02;
+    } else {
+	put16(l4 + 2, 53);
+	put16(l4 + 4, size - 34);
+    }
+
+    return size;
+}
+
+static void build_frames(void)
+{
+    U32 seed = 1, i;
+
+    for (i = 0; i < FRAMES; i++) {
+	int proto = pick(opt.mix, MIXES, &seed);
+	U32 size = pick(opt.sizes, opt.nsizes, &seed);
+
+	iov[i].iov_base = frames[i];
+	iov[i].iov_len = build_frame(frames[i], proto, size, i);
+	msgs[i].msg_hdr.msg_iov = &iov[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+/* the step a frame ends, 0 for traffic */
+static U32 wake_step(const struct packet *p)
+{
+    if (p->caplen < 18 || GET16(p->base + 12) != WAKE_TYPE)
+	return 0;
+
+    return GET32(p->base + 14);
+}
+
+static void send_wake(int fd, U32 step)
+{
+    U8 wake[60];
+
+    memset(wake, 0, sizeof(wake));
+    memcpy(wake, frames[0], 12);
+    put16(wake + 12, WAKE_TYPE);
+    wake[14] = step >> 24;
+    wake[15] = step >> 16;
+    wake[16] = step >> 8;
+    wake[17] = step;
+    (void)send(fd, wake, sizeof(wake), 0);
+}
+
+/* paced by batches, then ends the step until the capture side saw it */
+static void *generate(void *arg)
+{
+    struct gen *g = arg;
+    U64 start = now_ns(), end = start + opt.duration * 1000000ULL, t;
+    U32 cur = 0;
+
+    g->sent = 0;
+    g->errors = 0;
+
+    while ((t = now_ns()) < end) {
+	U64 due = (double)(t - start) * g->rate / 1e9;
+	U32 n = FRAMES - cur < BATCH ? FRAMES - cur : BATCH;
+	int sent;
+
+	if (g->sent + n > due) {
+	    U64 wait = (g->sent + n - due) * 1e9 / g->rate;
+
+	    sleep_ns(wait < 1000000 ? wait : 1000000);
+	    continue;
+	}
+
+	if ((sent = sendmmsg(g->fd, msgs + cur, n, 0)) < 0) {
+	    g->errors++;
+	    continue;
+	}
+
+	g->sent += sent;
+	cur = (cur + sent) % FRAMES;
+    }
+
+    g->secs = (now_ns() - start) / 1e9;
+
+    /* the end of a step may be dropped as well */
+    while (__atomic_load_n(&g->acked, __ATOMIC_ACQUIRE) != g->step) {
+	send_wake(g->fd, g->step);
+	sleep_ns(10000000);
+    }
+
+    return NULL;
+}
+
+static int gen_open(struct gen *g)
+{
+    struct sockaddr_ll sll;
+    int one = 1;
+
+    memset(g, 0, sizeof(*g));
+
+    if ((g->fd = socket(PF_PACKET, SOCK_RAW, 0)) < 0) {
+	fprintf(stderr, "error: socket(): %s\n", strerror(errno));
+	return -1;
+    }
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = PF_PACKET;
+    sll.sll_ifindex = if_nametoindex(BENCH_TX);
+
+    if (bind(g->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+	fprintf(stderr, "error: bind(): %s\n", strerror(errno));
+	return -1;
+    }
+
+    (void)setsockopt(g->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one,
+		     sizeof(one));
+    return 0;
+}
+
+static void *read_fanout(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+	int sts = capture_fanout(&rpacket, &sub, SNAPLEN);
+	U32 step;
+
+	if (sts < 0)
+	    break;
+
+	if (sts == 0)
+	    continue;
+
+	if ((step = wake_step(&rpacket)) == WAKE_QUIT)
+	    break;
+
+	if (step) {
+	    __atomic_store_n(&rseen, step, __ATOMIC_RELEASE);
+	    continue;
+	}
+
+	dissect(&rpacket, DEPTH_L7);
+	rcount++;
+    }
+
+    return NULL;
+}
+
+static void publish(const struct packet *p)
+{
+    struct fanout_desc d;
+
+    memset(&d, 0, sizeof(d));
+    d.time = (U64) p->time.tv_sec * 1000000000 + p->time.tv_nsec;
+    d.caplen = p->caplen;
+    d.len = p->len;
+    d.ifindex = p->ifindex;
+    fanout_publish(&pub, &d, p->base);
+}
+
+static int mode_open(int mode, pthread_t * reader)
+{
+    if (mode == MODE_XDP)
+	return xdp_open(&xsk, BENCH_RX, 0, XSK_SKB, 0);
+
+    if ((fd = if_open(BENCH_RX, NULL)) < 0)
+	return -1;
+
+    loindex = if_index(fd, "lo");
+
+    if (mode == MODE_RING)
+	return if_ring(fd, &ring, SNAPLEN);
+
+    if (mode == MODE_FANOUT) {
+	if (fanout_create(&pub, BENCH_RING,
+			  PUBLISH_SLOT - sizeof(struct fanout_slot))
+	    || fanout_attach(&sub, BENCH_RING))
+	    return -1;
+
+	rcount = 0;
+	rseen = 0;
+
+	if (pthread_create(reader, NULL, read_fanout, NULL)) {
+	    fprintf(stderr, "error: pthread_create()\n");
+	    return -1;
+	}
+
+	reading = 1;
+    }
+
+    return 0;
+}
+
+static void mode_close(int mode, pthread_t reader)
+{
+    if (reading) {
+	packet.caplen = 60;
+	packet.base[12] = WAKE_TYPE >> 8;
+	packet.base[13] = WAKE_TYPE & 0xFF;
+	memset(packet.base + 14, 0xFF, 4);
+	publish(&packet);
+	pthread_join(reader, NULL);
+	reading = 0;
+    }
+
+    if (sub.ring)
+	fanout_close(&sub);
+
+    if (pub.ring)
+	fanout_close(&pub);
+
+    if (mode == MODE_XDP)
+	xdp_close(&xsk);
+
+    if_ring_close(&ring);
+
+    if (fd != -1)
+	if_close(fd);
+
+    fd = -1;
+}
+
+/* drops on the capture side so far, or since the last call */
+static int drops(int mode, U64 * n)
+{
+    U32 packets, socket = 0;
+
+    if (mode == MODE_XDP)
+	return xdp_counters(&xsk, n);
+
+    if (if_counters(fd, &packets, &socket))
+	return -1;
+
+    *n = socket;
+
+    if (mode == MODE_FANOUT)
+	*n += sub.me->skipped;
+
+    return 0;
+}
+
+/* one step at g->rate, -1 if the capture failed */
+static int step(int mode, struct gen *g, pthread_t reader, U64 * captured,
+		U64 * dropped, double *cpu)
+{
+    clockid_t rclock;
+    pthread_t t;
+    U64 d0, d1, c0, r0 = 0, count = 0;
+
+    if (drops(mode, &d0))
+	return -1;
+
+    /* cumulative for the fanout reader, reset for the socket */
+    if (mode == MODE_FANOUT)
+	d0 = sub.me->skipped;
+    else if (mode != MODE_XDP)
+	d0 = 0;
+
+    if (mode == MODE_FANOUT) {
+	pthread_getcpuclockid(reader, &rclock);
+	r0 = cpu_ns(rclock);
+	count = rcount;
+    }
+
+    c0 = cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+    g->step++;
+
+    if (pthread_create(&t, NULL, generate, g)) {
+	fprintf(stderr, "error: pthread_create()\n");
+	return -1;
+    }
+
+    for (;;) {
+	int sts;
+	U32 s;
+
+	if (mode == MODE_XDP)
+	    sts = xdp_capture(&xsk, &packet, SNAPLEN);
+	else if (mode == MODE_RING)
+	    sts = capture_ring(&packet, fd, &ring, loindex, 0);
+	else
+	    sts = capture(&packet, fd, loindex, SNAPLEN, 0);
+
+	if (sts < 0) {
+	    __atomic_store_n(&g->acked, g->step, __ATOMIC_RELEASE);
+	    pthread_join(t, NULL);
+	    return -1;
+	}
+
+	if (sts == 0)
+	    continue;
+
+	s = wake_step(&packet);
+
+	if (mode == MODE_FANOUT) {
+	    publish(&packet);
+
+	    if (s == g->step)
+		break;
+
+	    continue;
+	}
+
+	/* the ends of the previous steps come late */
+	if (s == g->step)
+	    break;
+
+	if (s == 0) {
+	    dissect(&packet, DEPTH_L7);
+	    count++;
+	}
+    }
+
+    if (mode == MODE_FANOUT) {
+	while (__atomic_load_n(&rseen, __ATOMIC_ACQUIRE) != g->step)
+	    sleep_ns(1000000);
+
+	count = rcount - count;
+    }
+
+    *cpu = cpu_ns(CLOCK_THREAD_CPUTIME_ID) - c0;
+
+    if (mode == MODE_FANOUT)
+	*cpu += cpu_ns(rclock) - r0;
+
+    __atomic_store_n(&g->acked, g->step, __ATOMIC_RELEASE);
+    pthread_join(t, NULL);
+
+    if (drops(mode, &d1))
+	return -1;
+
+    *captured = count;
+    *dropped = d1 - d0;
+    return 0;
+}
+
+static void bench(int mode, struct gen *g, struct result *res)
+{
+    pthread_t reader = 0;
+    double rate;
+
+    res->rate = 0;
+    res->cpu = 0;
+    res->stop = "max rate";
+
+    if (mode_open(mode, &reader)) {
+	res->stop = "cannot open";
+	mode_close(mode, reader);
+	return;
+    }
+
+    for (rate = opt.start; rate <= opt.max; rate *= opt.factor) {
+	U64 captured, dropped;
+	double cpu, achieved, lost;
+
+	g->rate = rate;
+
+	if (step(mode, g, reader, &captured, &dropped, &cpu)) {
+	    res->stop = "capture failed";
+	    break;
+	}
+
+	achieved = g->sent / g->secs;
+	lost = g->sent > captured + dropped ?
+	    g->sent - captured - dropped : 0;
+
+	fprintf(stdout, "%-7s %10.0f %10.0f %10llu %8llu %8.0f %8.0f\n",
+		mode_names[mode], rate, achieved,
+		(unsigned long long)captured, (unsigned long long)dropped,
+		lost, captured ? cpu / captured : 0);
+	fflush(stdout);
+
+	if (dropped) {
+	    res->stop = "drops";
+	    break;
+	}
+
+	res->rate = achieved;
+	res->cpu = captured ? cpu / captured : 0;
+
+	/* the generator is the bottleneck now */
+	if (achieved < 0.9 * rate) {
+	    res->stop = "generator";
+	    break;
+	}
+    }
+
+    mode_close(mode, reader);
+}
+
+/* rtnetlink request, waiting for its ack */
+static int rtnl_do(int nl, struct nlmsghdr *nh)
+{
+    U8 buf[4096];
+    struct nlmsghdr *ack = (struct nlmsghdr *)buf;
+    ssize_t n;
+
+    nh->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+
+    if (send(nl, nh, nh->nlmsg_len, 0) < 0
+	|| (n = recv(nl, buf, sizeof(buf), 0)) < 0) {
+	fprintf(stderr, "error: rtnetlink: %s\n", strerror(errno));
+	return -1;
+    }
+
+    if (n >= (ssize_t) NLMSG_LENGTH(sizeof(struct nlmsgerr))
+	&& ack->nlmsg_type == NLMSG_ERROR) {
+	struct nlmsgerr *err = NLMSG_DATA(ack);
+
+	if (err->error) {
+	    fprintf(stderr, "error: rtnetlink: %s\n", strerror(-err->error));
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+/* appends an attribute; with no data, a nest closed by nest_end() */
+static struct rtattr *attr(struct nlmsghdr *nh, U16 type, const void *data,
+			   U16 len)
+{
+    struct rtattr *rta;
+
+    rta = (struct rtattr *)((U8 *) nh + NLMSG_ALIGN(nh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+
+    if (data)
+	memcpy(RTA_DATA(rta), data, len);
+    else
+	memset(RTA_DATA(rta), 0, len);
+
+    nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+    return rta;
+}
+
+static void nest_end(struct nlmsghdr *nh, struct rtattr *rta)
+{
+    rta->rta_len = (U8 *) nh + nh->nlmsg_len - (U8 *) rta;
+}
+
+static int link_up(int nl, const char *name)
+{
+    struct {
+	struct nlmsghdr nh;
+	struct ifinfomsg ifi;
+    } req;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nh.nlmsg_type = RTM_NEWLINK;
+    req.ifi.ifi_index = if_nametoindex(name);
+    req.ifi.ifi_flags = IFF_UP;
+    req.ifi.ifi_change = IFF_UP;
+    return rtnl_do(nl, &req.nh);
+}
+
+static int veth_create(void)
+{
+    struct {
+	struct nlmsghdr nh;
+	U8 buf[1024];
+    } req;
+    struct rtattr *info, *data, *peer;
+    int nl, sts;
+
+    if ((nl = rtnl_open(0)) < 0)
+	return -1;
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    req.nh.nlmsg_type = RTM_NEWLINK;
+    req.nh.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+    attr(&req.nh, IFLA_IFNAME, BENCH_TX, sizeof(BENCH_TX));
+    info = attr(&req.nh, IFLA_LINKINFO, NULL, 0);
+    attr(&req.nh, IFLA_INFO_KIND, "veth", 4);
+    data = attr(&req.nh, IFLA_INFO_DATA, NULL, 0);
+    peer = attr(&req.nh, VETH_INFO_PEER, NULL, sizeof(struct ifinfomsg));
+    attr(&req.nh, IFLA_IFNAME, BENCH_RX, sizeof(BENCH_RX));
+    nest_end(&req.nh, peer);
+    nest_end(&req.nh, data);
+    nest_end(&req.nh, info);
+
+    sts = rtnl_do(nl, &req.nh) || link_up(nl, BENCH_TX)
+	|| link_up(nl, BENCH_RX) ? -1 : 0;
+    close(nl);
+    return sts;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-d ms] [-r pps] [-x pps] [-f factor] "
+	    "[-m udp:6,tcp:3,arp:1] [-s 60:7,576:4,1514:1] "
+	    "[-M socket,ring,xdp,fanout]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct result res[MODES];
+    char mix[] = "udp:6,tcp:3,arp:1", sizes[] = "60:7,576:4,1514:1";
+    struct weight modes[MODES];
+    struct gen g;
+    int c, i, n;
+
+    opt.duration = 500;
+    opt.start = 10000;
+    opt.max = 5000000;
+    opt.factor = 1.5;
+
+    if (parse_weights(mix, opt.mix, MIXES, mix_names) < 0
+	|| (opt.nsizes = parse_weights(sizes, opt.sizes, SIZES_MAX,
+				       NULL)) < 0)
+	return 1;
+
+    for (i = 0; i < MODES; i++)
+	opt.modes[i] = 1;
+
+    while ((c = getopt(argc, argv, "d:r:x:f:m:s:M:")) != -1) {
+	switch (c) {
+	case 'd':
+	    opt.duration = atoi(optarg);
+	    break;
+
+	case 'r':
+	    opt.start = atof(optarg);
+	    break;
+
+	case 'x':
+	    opt.max = atof(optarg);
+	    break;
+
+	case 'f':
+	    opt.factor = atof(optarg);
+	    break;
+
+	case 'm':
+	    memset(opt.mix, 0, sizeof(opt.mix));
+
+	    if (parse_weights(optarg, opt.mix, MIXES, mix_names) < 1)
+		usage(argv[0]);
+
+	    break;
+
+	case 's':
+	    if ((opt.nsizes = parse_weights(optarg, opt.sizes, SIZES_MAX,
+					    NULL)) < 1)
+		usage(argv[0]);
+
+	    break;
+
+	case 'M':
+	    if ((n = parse_weights(optarg, modes, MODES, mode_names)) < 1)
+		usage(argv[0]);
+
+	    memset(opt.modes, 0, sizeof(opt.modes));
+
+	    for (i = 0; i < n; i++)
+		opt.modes[modes[i].value] = 1;
+
+	    break;
+
+	default:
+	    usage(argv[0]);
+	}
+    }
+
+    if (opt.duration < 10 || !(opt.start > 0) || !(opt.factor > 1))
+	usage(argv[0]);
+
+    if (unshare(CLONE_NEWNET) < 0) {
+	fprintf(stderr, "error: unshare(CLONE_NEWNET): %s\n",
+		strerror(errno));
+	return 1;
+    }
+
+    if (veth_create() || gen_open(&g))
+	return 1;
+
+    build_frames();
+
+    fprintf(stdout, "%-7s %10s %10s %10s %8s %8s %8s\n", "mode", "pps",
+	    "sent pps", "captured", "drops", "lost", "cpu ns");
+
+    for (i = 0; i < MODES; i++)
+	if (opt.modes[i])
+	    bench(i, &g, &res[i]);
+
+    fprintf(stdout, "\nHighest rate without drops\n"
+	    "--------------------------\n\n");
+
+    for (i = 0; i < MODES; i++)
+	if (opt.modes[i])
+	    fprintf(stdout, "%-7s %10.0f pps, %6.0f ns of CPU per packet "
+		    "(stopped by %s)\n", mode_names[i], res[i].rate,
+		    res[i].cpu, res[i].stop);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pangolin.h"
+
+static int failures;
+
+#define CHECK(cond) \
+    do { \
+	if (!(cond)) { \
+	    fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	    failures++; \
+	} \
+    } while (0)
+
+/*
+ * Frame builders. build_ip() and build_ip6() clear the packet and lay out
+ * an Ethernet header and an IPv4 (10.0.0.1 > 192.168.1.2, TTL 64) or IPv6
+ * (::1 > ::2, hop limit 64) header carrying len bytes, captured whole;
+ * they return the offset of the payload. build_tcp() and build_udp() fill
+ * the transport header at that offset, a 20 bytes TCP header, a UDP one
+ * covering the rest of the packet. None of them dissects.
+ */
+static inline U16 build_ip(struct packet *packet, U8 proto, U16 len)
+{
+    U8 *p = packet->base;
+
+    memset(packet, 0, sizeof(*packet));
+    p[12] = 0x08;
+    p[14] = 0x45;
+    p[16] = (20 + len) >> 8;
+    p[17] = (20 + len) & 0xFF;
+    p[22] = 64;
+    p[23] = proto;
+    memcpy(p + 26, "\x0a\x00\x00\x01", 4);
+    memcpy(p + 30, "\xc0\xa8\x01\x02", 4);
+    packet->caplen = packet->len = 34 + len;
+    return 34;
+}
+
+static inline U16 build_ip6(struct packet *packet, U8 nxt, U16 len)
+{
+    U8 *p = packet->base;
+
+    memset(packet, 0, sizeof(*packet));
+    p[12] = 0x86;
+    p[13] = 0xDD;
+    p[14] = 0x60;
+    p[18] = len >> 8;
+    p[19] = len & 0xFF;
+    p[20] = nxt;
+    p[21] = 64;
+    p[37] = 1;
+    p[53] = 2;
+    packet->caplen = packet->len = 54 + len;
+    return 54;
+}
+
+static inline void build_tcp(struct packet *packet, U16 off, U16 sport,
+			     U16 dport, U8 flags)
+{
+    U8 *h = packet->base + off;
+
+    h[0] = sport >> 8, h[1] = sport & 0xFF;
+    h[2] = dport >> 8, h[3] = dport & 0xFF;
+    h[12] = 0x50;
+    h[13] = flags;
+}
+
+static inline void build_udp(struct packet *packet, U16 off, U16 sport,
+			     U16 dport)
+{
+    U8 *h = packet->base + off;
+    U16 len = packet->len - off;
+
+    h[0] = sport >> 8, h[1] = sport & 0xFF;
+    h[2] = dport >> 8, h[3] = dport & 0xFF;
+    h[4] = len >> 8, h[5] = len & 0xFF;
+}
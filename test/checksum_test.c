@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/if_packet.h>
+
+#include "check.h"
+
+static struct packet packet;
+
+/* RFC 1071, byte by byte in network order */
+static U16 reference(const U8 *p, U32 len)
+{
+    U32 sum = 0, i;
+
+    for (i = 0; i < len; i++)
+	sum += i & 1 ? p[i] : p[i] << 8;
+
+    while (sum >> 16)
+	sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return sum;
+}
+
+static void test_sum(void)
+{
+    static U8 buf[2048 + 64];
+    U32 len, off, i;
+
+    srand(1);
+
+    for (i = 0; i < sizeof(buf); i++)
+	buf[i] = rand();
+
+    /* in host order: every vector tail, odd lengths, unaligned starts */
+    for (len = 0; len < 300; len++)
+	for (off = 0; off < 33; off += 3)
+	    CHECK(csum_partial(buf + off, len, 0) ==
+		  TONET16(reference(buf + off, len)));
+
+    /* all ones never overflow the lanes */
+    memset(buf, 0xFF, sizeof(buf));
+    CHECK(csum_partial(buf, 2048, 0) == 0xFFFF);
+}
+
+static void fill(U8 *field, const U8 *p, U32 len, U32 seed)
+{
+    U16 s;
+
+    field[0] = field[1] = 0;
+    s = ~csum_partial(p, len, seed);
+    memcpy(field, &s, 2);
+}
+
+static void test_verify(void)
+{
+    struct checksum cs;
+    U8 *p = packet.base, pseudo[12];
+    U32 i;
+
+    memset(&cs, 0, sizeof(cs));
+    build_ip(&packet, 17, 8 + 11);
+    build_udp(&packet, 34, 53, 53);
+    memcpy(p + 42, "hello world", 11);
+
+    fill(p + 24, p + 14, 20, 0);
+    memcpy(pseudo, p + 26, 8);
+    pseudo[8] = 0, pseudo[9] = 17, pseudo[10] = 0, pseudo[11] = 19;
+    fill(p + 40, p + 34, 19, csum_partial(pseudo, 12, 0));
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(checksum_verify(&cs, &packet) == 0);
+    CHECK(cs.verified == 1);
+
+    p[50] ^= 1;
+    CHECK(checksum_verify(&cs, &packet) == CSUM_BAD_UDP);
+    p[22]--;
+    CHECK(checksum_verify(&cs, &packet) == (CSUM_BAD_IP | CSUM_BAD_UDP));
+    CHECK(cs.bad_ip == 1 && cs.bad_udp == 2);
+
+    /* left to the NIC: only the IP header is verified */
+    packet.status = TP_STATUS_CSUMNOTREADY;
+    CHECK(checksum_verify(&cs, &packet) == CSUM_BAD_IP);
+    CHECK(cs.offloaded == 1);
+    packet.status = 0;
+    p[22]++;
+
+    /* the payload was not captured */
+    packet.caplen = 44;
+    CHECK(checksum_verify(&cs, &packet) == 0);
+    CHECK(cs.truncated == 1);
+
+    /* TCP over IPv6 */
+    build_tcp(&packet, build_ip6(&packet, 6, 20 + 5), 12345, 80, 0x18);
+    memcpy(p + 74, "abcde", 5);
+
+    {
+	U8 ph[40];
+
+	memcpy(ph, p + 22, 32);
+	memset(ph + 32, 0, 8);
+	ph[35] = 25, ph[39] = 6;
+	fill(p + 70, p + 54, 25, csum_partial(ph, 40, 0));
+    }
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(checksum_verify(&cs, &packet) == 0);
+
+    for (i = 54; i < packet.caplen; i++) {
+	p[i] ^= 0x80;
+	CHECK(checksum_verify(&cs, &packet) == CSUM_BAD_TCP);
+	p[i] ^= 0x80;
+    }
+}
+
+int main(void)
+{
+    test_sum();
+    test_verify();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+static struct packet packet;
+static struct dedup d;
+
+/* a UDP datagram from a MAC, with a TTL, on ifindex, at ns */
+static int udp(U8 mac, U8 ttl, int vlan, int ifindex, long ns)
+{
+    U8 *p = packet.base;
+
+    build_udp(&packet, build_ip(&packet, 17, 8), 0, 53);
+    p[11] = mac;
+    p[22] = ttl;
+    p[24] = ttl;		/* stands for the checksum */
+
+    if (vlan) {
+	memmove(p + 16, p + 12, packet.caplen - 12);
+	p[12] = 0x81, p[13] = 0x00;
+	p[14] = 0x00, p[15] = 42;
+	packet.caplen = packet.len += 4;
+    }
+
+    packet.ifindex = ifindex;
+    packet.time.tv_sec = 100;
+    packet.time.tv_nsec = ns;
+    return dedup_check(&d, &packet);
+}
+
+int main(void)
+{
+    CHECK(udp(1, 64, 0, 2, 0) == 0);
+
+    /* routed: new MACs, one hop less, another interface */
+    CHECK(udp(2, 63, 0, 3, 1000) == 1);
+
+    /* bridged onto a VLAN */
+    CHECK(udp(3, 63, 1, 4, 2000) == 1);
+
+    /* the same bytes on the same interface are a new packet */
+    CHECK(udp(3, 63, 1, 4, 3000) == 0);
+
+    /* too late to be the same */
+    CHECK(udp(1, 64, 0, 5, 3000 + DEDUP_WINDOW + 1) == 0);
+
+    CHECK(d.packets == 5 && d.duplicates == 2);
+
+    /* a different payload */
+    CHECK(udp(1, 64, 0, 2, 0) == 0);
+    packet.base[14 + 27] = 1;
+    packet.ifindex = 3;
+    CHECK(dedup_check(&d, &packet) == 0);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+static struct packet packet;
+static struct dfilter df;
+
+static void build(U8 proto, const char *src, U16 sport, U16 dport, U8 flags)
+{
+    U16 off = build_ip(&packet, proto, 300);
+
+    inet_pton(AF_INET, src, packet.base + 26);
+
+    if (proto == 6)
+	build_tcp(&packet, off, sport, dport, flags);
+    else
+	build_udp(&packet, off, sport, dport);
+
+    /* a BOOTP reply */
+    if (proto == 17 && (sport == 67 || dport == 67))
+	packet.base[off + 8] = 2;
+
+    dissect(&packet, DEPTH_L7);
+}
+
+static int match(const char *expr)
+{
+    if (dfilter_compile(&df, expr)) {
+	fprintf(stderr, "cannot compile: %s\n", expr);
+	failures++;
+	return -1;
+    }
+
+    return dfilter_match(&df, &packet);
+}
+
+static void test_fields(void)
+{
+    build(6, "172.16.0.1", 40000, 80, 0x02);
+    CHECK(match("tcp") == 1);
+    CHECK(match("udp") == 0);
+    CHECK(match("tcp.flags.syn") == 1);
+    CHECK(match("tcp.flags.ack") == 0);
+    CHECK(match("tcp.flags.syn and not ip.src in 10/8") == 1);
+    CHECK(match("tcp.dstport == 80 && ip.ttl >= 64") == 1);
+    CHECK(match("tcp.port in { 22 443 }") == 0);
+    CHECK(match("tcp.port in { 22 80 443 }") == 1);
+    CHECK(match("ip.addr == 192.168.1.2") == 1);
+    CHECK(match("ip.addr != 192.168.1.2") == 0);
+    CHECK(match("ip.src == 172.16.0.0/12") == 1);
+    CHECK(match("ip.proto == tcp") == 1);
+    CHECK(match("tcp.srcport > 1024 and tcp.srcport lt 49152") == 1);
+
+    build(6, "10.1.2.3", 40000, 80, 0x02);
+    CHECK(match("tcp.flags.syn and not ip.src in 10/8") == 0);
+    CHECK(match("ip.src in 10.1/16") == 1);
+
+    /* comparisons on missing fields are false, their negation true */
+    build(17, "10.1.2.3", 5353, 5353, 0);
+    CHECK(match("tcp.port == 80") == 0);
+    CHECK(match("not tcp.port == 80") == 1);
+    CHECK(match("udp.port == 5353 or tcp.port == 5353") == 1);
+
+    build(17, "10.1.2.3", 67, 68, 0);
+    CHECK(match("bootp.op == reply") == 1);
+    CHECK(match("bootp.op == request") == 0);
+    CHECK(df.depth == DEPTH_L7);
+
+    /* tags stripped by the kernel are fields as well */
+    build(6, "10.1.2.3", 40000, 80, 0x02);
+    CHECK(match("vlan") == 0);
+    CHECK(match("not vlan.id == 100") == 1);
+    packet.vlan_tpid = 0x8100;
+    packet.vlan_tci = 0x6064;
+    dissect(&packet, DEPTH_L7);
+    CHECK(match("vlan.id == 100 and vlan.pcp == 3 and tcp") == 1);
+    CHECK(match("vlan.inner.id == 100") == 0);
+
+    /* IPv6 */
+    build_ip6(&packet, 58, 24);
+    packet.base[21] = 255;
+    packet.base[54] = 135;
+    dissect(&packet, DEPTH_L7);
+    CHECK(match("ipv6 and not ip") == 1);
+    CHECK(match("ipv6.nxt == icmpv6 and ipv6.hlim == 255") == 1);
+    CHECK(match("icmpv6.type == neighbor-solicitation") == 1);
+    CHECK(match("icmpv6.type == echo-request") == 0);
+    CHECK(match("ipv6.src == ::1 and ipv6.dst == ::2") == 1);
+    CHECK(match("ipv6.addr == ::2") == 1);
+    CHECK(match("ipv6.addr != ::2") == 0);
+    CHECK(match("ipv6.addr != ::3") == 1);
+    CHECK(match("ipv6.src == ::/0") == 1);
+
+    inet_pton(AF_INET6, "2001:db8:1::5", packet.base + 22);
+    CHECK(match("ipv6.src in 2001:db8::/32") == 1);
+    CHECK(df.len == 1);
+    CHECK(match("ipv6.src in 2001:db8:2::/48") == 0);
+    CHECK(match("ipv6.src == 2001:db8:1::5") == 1);
+    CHECK(df.len == 4);
+    CHECK(match("ipv6.addr in { fe80::/10 2001:db8:1::/64 }") == 1);
+    CHECK(match("not ipv6.dst in 2001:db8::/32") == 1);
+
+    /* comparisons on an IPv4 packet are false */
+    build(6, "10.1.2.3", 40000, 80, 0x02);
+    CHECK(match("ipv6.src != ::1") == 0);
+    CHECK(match("ipv6.src == ::/0") == 0);
+}
+
+static void test_folding(void)
+{
+    build(6, "172.16.0.1", 40000, 80, 0x02);
+
+    CHECK(match("tcp or true") == 1);
+    CHECK(df.len == 0 && df.entry == DF_ACCEPT);
+
+    CHECK(match("tcp and (false or not true)") == 0);
+    CHECK(df.len == 0 && df.entry == DF_REJECT);
+
+    CHECK(match("not not tcp") == 1);
+    CHECK(df.len == 1);
+
+    /* a value wider than the flag can never match */
+    CHECK(match("tcp.flags.syn == 2") == 0);
+    CHECK(df.len == 0);
+
+    /* beyond the field width: only presence is left to test */
+    CHECK(match("ip.ttl > 300") == 0);
+    CHECK(df.len == 0);
+    CHECK(match("ip.ttl >= 256") == 0);
+    CHECK(match("ip.ttl == 320") == 0);
+    CHECK(match("ip.ttl < 256") == 1);
+    CHECK(match("ip.ttl <= 300") == 1);
+    CHECK(match("ip.ttl != 320") == 1);
+    CHECK(df.len == 1 && df.code[0].op == DF_PRESENT);
+    CHECK(match("vlan.id < 4096") == 0);
+
+    build_ip6(&packet, 58, 24);
+    dissect(&packet, DEPTH_L7);
+    CHECK(match("ip.ttl != 320") == 0);
+    CHECK(match("ip.ttl < 256") == 0);
+    build(6, "172.16.0.1", 40000, 80, 0x02);
+
+    /* tcp.hdr_len is in bytes, whole 32 bit words */
+    CHECK(match("tcp.hdr_len == 20") == 1);
+    CHECK(match("tcp.hdr_len == 5") == 0);
+    CHECK(match("tcp.hdr_len == 21") == 0);
+    CHECK(match("tcp.hdr_len != 21") == 1);
+    CHECK(match("tcp.hdr_len < 21") == 1);
+    CHECK(match("tcp.hdr_len <= 19") == 0);
+    CHECK(match("tcp.hdr_len > 19") == 1);
+    CHECK(match("tcp.hdr_len >= 21") == 0);
+    CHECK(match("tcp.hdr_len <= 60") == 1);
+
+    /* one instruction per test, each "either" field two */
+    CHECK(match("tcp.flags.syn and not ip.src in 10/8") == 1);
+    CHECK(df.len == 2);
+    CHECK(match("tcp.port == 80") == 1);
+    CHECK(df.len == 2);
+}
+
+static void test_errors(void)
+{
+    CHECK(dfilter_compile(&df, "foo.bar == 1") == -1);
+    CHECK(dfilter_compile(&df, "tcp.port ==") == -1);
+    CHECK(dfilter_compile(&df, "(tcp") == -1);
+    CHECK(dfilter_compile(&df, "tcp == 1") == -1);
+    CHECK(dfilter_compile(&df, "ip.src in 10/33") == -1);
+    CHECK(dfilter_compile(&df, "tcp udp") == -1);
+    CHECK(dfilter_compile(&df, "ipv6.src < ::1") == -1);
+    CHECK(dfilter_compile(&df, "ipv6.dst == 2001:db8::/129") == -1);
+    CHECK(dfilter_compile(&df, "ipv6.dst == 10.0.0.1") == -1);
+}
+
+int main(void)
+{
+    test_fields();
+    test_folding();
+    test_errors();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+static struct packet packet;
+
+static void test_tcp(void)
+{
+    build_tcp(&packet, build_ip(&packet, 6, 20), 12345, 80, 0x12);
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.ethertype == 0x0800);
+    CHECK(packet.layers.l3_proto == PROTO_IP);
+    CHECK(packet.layers.l3 == 14);
+    CHECK(packet.layers.l4_proto == PROTO_TCP);
+    CHECK(packet.layers.l4 == 34);
+    CHECK(packet.layers.l7 == 54);
+    CHECK(packet.layers.sport == 12345);
+    CHECK(packet.layers.dport == 80);
+    CHECK(TOHOST32(packet.layers.saddr) == 0x0a000001);
+    CHECK(TOHOST32(packet.layers.daddr) == 0xc0a80102);
+
+    /* stops at the requested layer */
+    dissect(&packet, DEPTH_L3);
+    CHECK(packet.layers.l3_proto == PROTO_IP);
+    CHECK(packet.layers.l4_proto == PROTO_NONE);
+
+    /* a truncated transport header is not there */
+    packet.caplen = 40;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_IP);
+    CHECK(packet.layers.l4_proto == PROTO_NONE);
+}
+
+static void test_bootp(void)
+{
+    U16 off = build_ip(&packet, 17, 8 + 300);
+
+    build_udp(&packet, off, 68, 67);
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l4_proto == PROTO_UDP);
+    CHECK(packet.layers.l7 == off + 8);
+    CHECK(packet.layers.l7_proto == PROTO_BOOTP);
+
+    dissect(&packet, DEPTH_L4);
+    CHECK(packet.layers.l7_proto == PROTO_NONE);
+
+    packet.caplen = off + 8 + 100;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l4_proto == PROTO_UDP);
+    CHECK(packet.layers.l7_proto == PROTO_NONE);
+}
+
+static void test_dhcp(void)
+{
+    static const U8 options[] = {
+	0x63, 0x82, 0x53, 0x63,
+	53, 1, 5,			/* ACK */
+	0, 0,				/* pad */
+	54, 4, 10, 0, 0, 1,
+	51, 4, 0, 0, 0x0e, 0x10,	/* 3600 s */
+	12, 3, 'p', 'c', '1',
+	50, 3, 1, 2, 3,			/* bad length, ignored */
+	255
+    };
+    U16 off = build_ip(&packet, 17, 8 + 300);
+    U8 *h = packet.base + off + 8;
+    struct dhcp dhcp;
+
+    build_udp(&packet, off, 67, 68);
+    h[0] = 2;
+    memcpy(h + 16, "\x0a\x00\x00\x07", 4);
+    memcpy(h + 28, "\x02\x00\x00\xaa\xbb\xcc", 6);
+    memcpy(h + 236, options, sizeof(options));
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l7_proto == PROTO_BOOTP);
+    CHECK(dhcp_parse(&packet, packet.layers.l7, &dhcp) == 0);
+    CHECK(dhcp.type == 5);
+    CHECK(memcmp(dhcp.chaddr, "\x02\x00\x00\xaa\xbb\xcc", 6) == 0);
+    CHECK(TOHOST32(dhcp.yiaddr) == 0x0a000007);
+    CHECK(TOHOST32(dhcp.server) == 0x0a000001);
+    CHECK(dhcp.lease == 3600);
+    CHECK(dhcp.requested == 0);
+    CHECK(dhcp.hostname_len == 3
+	  && memcmp(packet.base + dhcp.hostname, "pc1", 3) == 0);
+
+    /* an option running past the capture stops the walk */
+    packet.caplen = off + 8 + 236 + 4 + 3 + 2 + 6 + 3;
+    CHECK(dhcp_parse(&packet, packet.layers.l7, &dhcp) == 0);
+    CHECK(dhcp.type == 5 && dhcp.server != 0 && dhcp.lease == 0);
+}
+
+static void test_ip_bounds(void)
+{
+    build_ip(&packet, 6, 20);
+
+    /* IHL larger than the captured bytes */
+    packet.base[14] = 0x4F;
+    packet.caplen = 50;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_NONE);
+
+    /* IHL shorter than the minimum header */
+    packet.base[14] = 0x44;
+    packet.caplen = 54;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_NONE);
+
+    /* later fragments have no transport header */
+    packet.base[14] = 0x45;
+    packet.base[21] = 0x10;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_IP);
+    CHECK(packet.layers.l4_proto == PROTO_NONE);
+}
+
+static void test_arp(void)
+{
+    U8 *p = packet.base;
+
+    memset(&packet, 0, sizeof(packet));
+    p[12] = 0x08;
+    p[13] = 0x06;
+    p[15] = 1;
+    p[16] = 0x08;
+    p[18] = 6;
+    p[19] = 4;
+    p[21] = 2;
+    packet.caplen = 42;
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_ARP);
+    CHECK(packet.layers.l3 == 14);
+
+    packet.caplen = 30;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_NONE);
+}
+
+static void test_ip6(void)
+{
+    U16 off = build_ip6(&packet, 0, 8 + 16 + 20);
+    U8 *h = packet.base + off;
+
+    /* hop-by-hop, 8 bytes, then destination options, 16 bytes, then TCP */
+    h[0] = 60;
+    h[8] = 6;
+    h[9] = 1;
+    h[24] = 0x30, h[25] = 0x39;
+    h[27] = 80;
+    h[36] = 0x50;
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_IP6);
+    CHECK(packet.layers.l3 == 14);
+    CHECK(packet.layers.ip_proto == 6);
+    CHECK(packet.layers.l4_proto == PROTO_TCP);
+    CHECK(packet.layers.l4 == off + 24);
+    CHECK(packet.layers.sport == 12345);
+    CHECK(packet.layers.dport == 80);
+
+    /* an extension header past the captured bytes */
+    packet.caplen = off + 12;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_IP6);
+    CHECK(packet.layers.l4_proto == PROTO_NONE);
+
+    /* later fragments have no transport header */
+    off = build_ip6(&packet, 44, 8 + 8);
+    h = packet.base + off;
+    h[0] = 17;
+    h[3] = 0x08;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.ip_proto == 17);
+    CHECK(packet.layers.l4_proto == PROTO_NONE);
+
+    h[3] = 0x01;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l4_proto == PROTO_UDP);
+    CHECK(packet.layers.l4 == off + 8);
+
+    /* neighbor solicitation */
+    off = build_ip6(&packet, 58, 24);
+    packet.base[off] = 135;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l4_proto == PROTO_ICMP6);
+    CHECK(packet.layers.l4 == off);
+
+    /* not version 6 */
+    packet.base[14] = 0x40;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_NONE);
+}
+
+/* inner IPv4 + TCP SYN 10.0.0.1:12345 > 10.0.0.2:80 at h, 40 bytes */
+static void build_inner(U8 * h)
+{
+    h[0] = 0x45;
+    h[3] = 40;
+    h[9] = 6;
+    memcpy(h + 12, "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+    h[20] = 0x30, h[21] = 0x39;
+    h[23] = 80;
+    h[32] = 0x50;
+}
+
+static void test_tunnel(void)
+{
+    U16 off = build_ip(&packet, 17, 8 + 8 + 14 + 40);
+    U8 *h = packet.base + off;
+
+    /* VXLAN, VNI 42 */
+    build_udp(&packet, off, 0, 4789);
+    h[8] = 0x08;
+    h[14] = 42;
+    h[16 + 12] = 0x08;
+    build_inner(h + 30);
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.tunnel == PROTO_VXLAN);
+    CHECK(packet.layers.tunnels == 1);
+    CHECK(packet.layers.vni == 42);
+    CHECK(packet.layers.tun == off + 8);
+    CHECK(packet.layers.tun_l3 == 14);
+    CHECK(packet.layers.l3 == off + 30);
+    CHECK(packet.layers.l4_proto == PROTO_TCP);
+    CHECK(packet.layers.dport == 80);
+    CHECK(TOHOST32(packet.layers.saddr) == 0x0a000001);
+
+    /* without the I flag it is plain UDP */
+    h[8] = 0;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.tunnel == PROTO_NONE);
+    CHECK(packet.layers.l4_proto == PROTO_UDP);
+    CHECK(packet.layers.dport == 4789);
+
+    /* a truncated inner packet keeps no outer transport */
+    h[8] = 0x08;
+    packet.caplen = off + 30 + 10;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.tunnel == PROTO_VXLAN);
+    CHECK(packet.layers.l3_proto == PROTO_NONE);
+    CHECK(packet.layers.l4_proto == PROTO_NONE);
+
+    /* GRE with a key carrying IPv4 */
+    off = build_ip(&packet, 47, 8 + 40);
+    h = packet.base + off;
+    h[0] = 0x20;
+    h[2] = 0x08;
+    h[7] = 7;
+    build_inner(h + 8);
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.tunnel == PROTO_GRE);
+    CHECK(packet.layers.vni == 7);
+    CHECK(packet.layers.ethertype == 0x0800);
+    CHECK(packet.layers.l4_proto == PROTO_TCP);
+
+    /* IP-in-IP */
+    off = build_ip(&packet, 4, 40);
+    build_inner(packet.base + off);
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.tunnel == PROTO_IPIP);
+    CHECK(packet.layers.l3 == off);
+    CHECK(packet.layers.l4_proto == PROTO_TCP);
+
+    /* nesting is bounded */
+    off = build_ip(&packet, 4, 20 * (TUNNEL_MAX + 1) + 40);
+
+    for (h = packet.base + off; h < packet.base + off + 20 * (TUNNEL_MAX + 1);
+	 h += 20) {
+	h[0] = 0x45;
+	h[9] = 4;
+    }
+
+    build_inner(h);
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.tunnels == TUNNEL_MAX);
+    CHECK(packet.layers.l4_proto == PROTO_NONE);
+}
+
+static void test_vlan(void)
+{
+    U8 *p = packet.base;
+
+    /* 802.1ad 100, 802.1Q 200, then IPv4 */
+    memset(&packet, 0, sizeof(packet));
+    p[12] = 0x88, p[13] = 0xA8;
+    p[14] = 0x20, p[15] = 100;
+    p[16] = 0x81, p[17] = 0x00;
+    p[18] = 0x00, p[19] = 200;
+    p[20] = 0x08, p[21] = 0x00;
+    p[22] = 0x45;
+    p[31] = 17;
+    packet.caplen = packet.len = 22 + 20 + 8;
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.vlans == 2);
+    CHECK(GET16(packet.layers.vlan) == 0x88A8);
+    CHECK((GET16(packet.layers.vlan + 2) & 0x0FFF) == 100);
+    CHECK(packet.layers.vlan[2] >> 5 == 1);
+    CHECK(GET16(packet.layers.vlan + 4) == 0x8100);
+    CHECK((GET16(packet.layers.vlan + 6) & 0x0FFF) == 200);
+    CHECK(packet.layers.ethertype == 0x0800);
+    CHECK(packet.layers.l3 == 22);
+    CHECK(packet.layers.l4_proto == PROTO_UDP);
+
+    /* the kernel stripped the outer tag */
+    memmove(p + 12, p + 16, 34);
+    packet.caplen -= 4;
+    packet.vlan_tpid = 0x88A8;
+    packet.vlan_tci = 100;
+
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.vlans == 2);
+    CHECK((GET16(packet.layers.vlan + 2) & 0x0FFF) == 100);
+    CHECK((GET16(packet.layers.vlan + 6) & 0x0FFF) == 200);
+    CHECK(packet.layers.l3 == 18);
+    CHECK(packet.layers.l4_proto == PROTO_UDP);
+
+    /* a truncated tag stops the dissection */
+    packet.vlan_tpid = 0;
+    packet.caplen = 16;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l3_proto == PROTO_NONE);
+}
+
+/* a TCP segment to or from port 80 carrying msg */
+static void build_http(const char *msg, int response)
+{
+    U32 len = strlen(msg);
+    U16 off = build_ip(&packet, 6, 20 + len);
+
+    build_tcp(&packet, off, response ? 80 : 0x99, response ? 0x99 : 80, 0);
+    memcpy(packet.base + off + 20, msg, len);
+    dissect(&packet, DEPTH_L7);
+}
+
+static void test_http(void)
+{
+    struct http http;
+    const U8 *p;
+
+    build_http("GET /index.html?q=1 HTTP/1.1\r\nUser-Agent: x\r\n"
+	       "host:  example.org \r\nContent-Length: 12\r\n\r\nbody", 0);
+    p = packet.base;
+    CHECK(packet.layers.l7_proto == PROTO_HTTP);
+    CHECK(http_parse(&packet, &http) == 0);
+    CHECK(http.response == 0);
+    CHECK(http.method_len == 3 && memcmp(p + http.method, "GET", 3) == 0);
+    CHECK(http.uri_len == 15
+	  && memcmp(p + http.uri, "/index.html?q=1", 15) == 0);
+    CHECK(http.host_len == 11 && memcmp(p + http.host, "example.org", 11) == 0);
+    CHECK(http.length == 12);
+
+    build_http("HTTP/1.0 404 Not Found\r\nServer: y\r\n", 1);
+    CHECK(packet.layers.l7_proto == PROTO_HTTP);
+    CHECK(http_parse(&packet, &http) == 0);
+    CHECK(http.response == 1 && http.status == 404);
+    CHECK(http.host == 0 && http.length == HTTP_LENGTH_NONE);
+
+    /* not a message start */
+    build_http("\x16\x03\x01 binary", 0);
+    CHECK(packet.layers.l7_proto == PROTO_NONE);
+    build_http("HTTP/1.1 2x0 OK\r\n", 1);
+    CHECK(http_parse(&packet, &http) == -1);
+}
+
+static const U8 client_hello[] = {
+    0x16, 0x03, 0x01, 0x00, 0x84,	/* handshake record */
+    0x01, 0x00, 0x00, 0x80,		/* ClientHello */
+    0x03, 0x03,
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+    0x00,				/* session id */
+    0x00, 0x14, 0x0a, 0x0a, 0x13, 0x01, 0x13, 0x02, 0x13, 0x03, 0xc0, 0x2b,
+    0xc0, 0x2c, 0xc0, 0x2f, 0xc0, 0x30, 0xcc, 0xa9, 0xcc, 0xa8,
+    0x01, 0x00,				/* compression */
+    0x00, 0x43,				/* extensions */
+    0x1a, 0x1a, 0x00, 0x00,		/* GREASE */
+    0x00, 0x00, 0x00, 0x10, 0x00, 0x0e, 0x00, 0x00, 0x0b,
+    'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'o', 'r', 'g',
+    0x00, 0x0a, 0x00, 0x06, 0x00, 0x04, 0x00, 0x1d, 0x00, 0x17,
+    0x00, 0x0b, 0x00, 0x02, 0x01, 0x00,
+    0x00, 0x10, 0x00, 0x0e, 0x00, 0x0c, 0x02, 'h', '2',
+    0x08, 'h', 't', 't', 'p', '/', '1', '.', '1',
+    0x00, 0x2b, 0x00, 0x05, 0x04, 0x03, 0x04, 0x03, 0x03
+};
+
+static void test_tls(void)
+{
+    /* MD5 of 771,4865-4866-...-52392,0-10-11-16-43,29-23,0 */
+    static const U8 ja3[16] = {
+	0x23, 0xe6, 0x0e, 0x3f, 0xf8, 0x53, 0x1e, 0x35,
+	0xad, 0xb1, 0x51, 0x00, 0x26, 0xda, 0xd4, 0x58
+    };
+    U16 off = build_ip(&packet, 6, 20 + sizeof(client_hello));
+    U8 *h = packet.base + off;
+    struct tls tls;
+
+    build_tcp(&packet, off, 0x9900, 443, 0);
+    memcpy(h + 20, client_hello, sizeof(client_hello));
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l7_proto == PROTO_TLS);
+    CHECK(tls_parse(&packet, &tls, 1) == 0);
+    CHECK(tls.type == 1 && tls.version == 0x0304);
+    CHECK(tls.sni_len == 11
+	  && memcmp(packet.base + tls.sni, "example.org", 11) == 0);
+    CHECK(tls.alpn_len == 2 && memcmp(packet.base + tls.alpn, "h2", 2) == 0);
+    CHECK(tls.has_ja3 && memcmp(tls.ja3, ja3, 16) == 0);
+
+    /* cut in the extensions: what is there is still decoded */
+    packet.caplen = off + 20 + 100;
+    dissect(&packet, DEPTH_L7);
+    CHECK(tls_parse(&packet, &tls, 0) == 0);
+    CHECK(tls.sni_len == 11 && tls.alpn_len == 0);
+
+    /* application data is not looked at */
+    h[20] = 0x17;
+    dissect(&packet, DEPTH_L7);
+    CHECK(packet.layers.l7_proto == PROTO_NONE);
+}
+
+int main(void)
+{
+    test_tcp();
+    test_bootp();
+    test_dhcp();
+    test_ip_bounds();
+    test_arp();
+    test_ip6();
+    test_vlan();
+    test_tunnel();
+    test_http();
+    test_tls();
+    return failures ? 1 : 0;
+}
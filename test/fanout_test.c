@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "check.h"
+
+static struct fanout w, a, b, x;
+
+static void publish(U32 n)
+{
+    struct fanout_desc d;
+    U8 data[64];
+
+    memset(&d, 0, sizeof(d));
+    memset(data, n & 0xFF, sizeof(data));
+    d.time = n;
+    d.caplen = d.len = sizeof(data);
+    fanout_publish(&w, &d, data);
+}
+
+int main(void)
+{
+    const struct fanout_slot *s;
+    char name[64], path[sizeof(name) + 1];
+    U32 i, slots;
+    int fd;
+
+    snprintf(name, sizeof(name), "pangolin-test-%d", (int)getpid());
+    snprintf(path, sizeof(path), "/%s", name);
+
+    /* someone else's object, or a ring still being initialised: kept */
+    fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    CHECK(fd >= 0);
+    CHECK(fanout_create(&w, name, 64) == -1);
+    close(fd);
+    fd = shm_open(path, O_RDWR, 0);
+    CHECK(fd >= 0);
+    close(fd);
+    shm_unlink(path);
+
+    if (fanout_create(&w, name, 64))
+	return 1;
+
+    slots = w.ring->slots;
+    CHECK(w.ring->slot_len == 128);
+    CHECK(fanout_attach(&a, name) == 0);
+    CHECK(fanout_attach(&b, name) == 0);
+    CHECK(a.me != b.me);
+
+    /* one publisher at a time */
+    CHECK(fanout_create(&x, name, 64) == -1);
+
+    CHECK(fanout_next(&a, &s, 0) == 0);
+
+    /* each reader sees every packet, in place */
+    publish(1);
+    publish(2);
+    CHECK(fanout_next(&a, &s, 0) == 1);
+    CHECK(s->desc.time == 1 && s->data[63] == 1);
+    CHECK(fanout_done(&a) == 1);
+    CHECK(fanout_next(&b, &s, 0) == 1 && s->desc.time == 1);
+    CHECK(fanout_done(&b) == 1);
+    CHECK(fanout_next(&a, &s, 0) == 1 && s->desc.time == 2);
+    CHECK(fanout_done(&a) == 1);
+    CHECK(fanout_next(&a, &s, 0) == 0);
+
+    /* b holds packet 2 while the writer laps it */
+    CHECK(fanout_next(&b, &s, 0) == 1 && s->desc.time == 2);
+
+    for (i = 3; i < slots + 3; i++)
+	publish(i);
+
+    CHECK(fanout_done(&b) == 0);
+    CHECK(b.me->read == 1 && b.me->skipped == 1);
+
+    /* a whole ring behind: moved half a ring back from the head */
+    publish(i++);
+    CHECK(fanout_next(&b, &s, 0) == 1);
+    CHECK(s->desc.time == i - slots / 2);
+    CHECK(fanout_done(&b) == 1);
+    CHECK(b.me->skipped == 1 + (i - slots / 2) - 3);
+
+    /* a was lapped as well: the writer waits for no one */
+    CHECK(fanout_next(&a, &s, 0) == 1 && s->desc.time == i - slots / 2);
+    CHECK(fanout_done(&a) == 1);
+
+    fanout_close(&a);
+    fanout_close(&b);
+    fanout_close(&w);
+
+    /* gone with the writer */
+    CHECK(fanout_attach(&a, name) == -1);
+
+    return failures ? 1 : 0;
+}
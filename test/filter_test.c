@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+static struct packet packet;
+static struct filter filter;
+
+/* stage boundaries of filter, the last one starts the filter_finish() code */
+static U16 start[16];
+static int stages;
+
+/* what the ancillary loads see */
+static U32 hatype = 1, rnd, vlan_tci;
+static int vlan_present;
+
+static void build(void)
+{
+    filter_init(&filter);
+    stages = 0;
+}
+
+static int append(const struct sock_filter *code, U16 len)
+{
+    start[stages++] = filter.len;
+    return filter_append(&filter, code, len);
+}
+
+static int finish(U32 snaplen)
+{
+    start[stages] = filter.len;
+    return filter_finish(&filter, snaplen);
+}
+
+/* checks the jump targets: inside the stage or on the next one */
+static int chained(void)
+{
+    U16 i, t, end;
+    int s = 0;
+
+    for (i = 0; i < filter.len; i++) {
+	const struct sock_filter *insn = &filter.code[i];
+
+	while (s < stages && i >= start[s + 1])
+	    s++;
+	end = s < stages ? start[s + 1] : filter.len - 1;
+
+	if (insn->code == 0x06 && insn->k != 0 && s < stages)
+	    return 0;		/* accepts before the last stage */
+
+	if ((insn->code & 0x07) != 0x05)
+	    continue;
+
+	t = i + 1 + (insn->code == 0x05 ? insn->k : insn->jt);
+	if (t > end)
+	    return 0;
+	t = i + 1 + (insn->code == 0x05 ? insn->k : insn->jf);
+	if (t > end)
+	    return 0;
+    }
+
+    return filter.len > 0 && (filter.code[filter.len - 1].code == 0x06 ||
+			      filter.code[filter.len - 1].code == 0x16);
+}
+
+static int load(U32 off, U32 size, U32 *a)
+{
+    const U8 *p = packet.base + off;
+
+    if (off + size > packet.caplen)
+	return -1;
+
+    *a = size == 4 ? GET32(p) : size == 2 ? GET16(p) : *p;
+    return 0;
+}
+
+/* the classic BPF subset of filters.c, as the kernel runs it */
+static U32 run(void)
+{
+    U32 a = 0, x = 0, k;
+    U16 pc;
+
+    for (pc = 0; pc < filter.len; pc++) {
+	const struct sock_filter *insn = &filter.code[pc];
+
+	k = insn->k;
+	switch (insn->code) {
+	case 0x00:		/* ld #k */
+	    a = k;
+	    break;
+	case 0x20:		/* ld [k] */
+	    if (k == 0xfffff01c)
+		a = hatype;
+	    else if (k == 0xfffff02c)
+		a = vlan_tci;
+	    else if (k == 0xfffff030)
+		a = vlan_present;
+	    else if (k == 0xfffff038)
+		a = rnd;
+	    else if (load(k, 4, &a))
+		return 0;
+	    break;
+	case 0x28:		/* ldh [k] */
+	    if (load(k, 2, &a))
+		return 0;
+	    break;
+	case 0x30:		/* ldb [k] */
+	    if (load(k, 1, &a))
+		return 0;
+	    break;
+	case 0x40:		/* ld [x + k] */
+	    if (load(x + k, 4, &a))
+		return 0;
+	    break;
+	case 0x48:		/* ldh [x + k] */
+	    if (load(x + k, 2, &a))
+		return 0;
+	    break;
+	case 0x50:		/* ldb [x + k] */
+	    if (load(x + k, 1, &a))
+		return 0;
+	    break;
+	case 0xb1:		/* ldx 4 * ([k] & 0xf) */
+	    if (load(k, 1, &x))
+		return 0;
+	    x = (x & 0xF) << 2;
+	    break;
+	case 0x04:		/* add #k */
+	    a += k;
+	    break;
+	case 0x0c:		/* add x */
+	    a += x;
+	    break;
+	case 0x54:		/* and #k */
+	    a &= k;
+	    break;
+	case 0x74:		/* rsh #k */
+	    a >>= k;
+	    break;
+	case 0x05:		/* ja */
+	    pc += k;
+	    break;
+	case 0x15:		/* jeq #k */
+	    pc += a == k ? insn->jt : insn->jf;
+	    break;
+	case 0x35:		/* jge #k */
+	    pc += a >= k ? insn->jt : insn->jf;
+	    break;
+	case 0x45:		/* jset #k */
+	    pc += a & k ? insn->jt : insn->jf;
+	    break;
+	case 0x06:		/* ret #k */
+	    return k;
+	case 0x16:		/* ret a */
+	    return a;
+	default:
+	    fprintf(stderr, "unknown opcode 0x%02x at %u\n", insn->code, pc);
+	    failures++;
+	    return 0;
+	}
+    }
+
+    fprintf(stderr, "fell off the end\n");
+    failures++;
+    return 0;
+}
+
+static void tcp(U16 dport, U16 payload)
+{
+    build_tcp(&packet, build_ip(&packet, 6, 20 + payload), 1234, dport, 0x02);
+}
+
+static void tcp6(U16 dport, U16 payload)
+{
+    build_tcp(&packet, build_ip6(&packet, 6, 20 + payload), 1234, dport, 0x02);
+}
+
+static void udp(U16 dport)
+{
+    build_udp(&packet, build_ip(&packet, 17, 8), 53, dport);
+}
+
+/* inserts an 802.1Q tag in the frame, as in one the kernel did not strip */
+static void tag(U16 vid)
+{
+    U8 *p = packet.base;
+
+    memmove(p + 16, p + 12, packet.caplen - 12);
+    p[12] = 0x81, p[13] = 0x00;
+    p[14] = vid >> 8, p[15] = vid & 0xFF;
+    packet.caplen = packet.len += 4;
+}
+
+/* -p tcp -s port -h host, as main() builds them */
+static void tcp_port_host(U16 port, U32 host)
+{
+    PORT_code[7].k = PORT_code[9].k = port;
+    PORT_code[19].k = PORT_code[21].k = port;
+    HOST_code[3].k = HOST_code[5].k = host;
+    HOST_code[9].k = HOST_code[11].k = host;
+
+    append(TCP_code, 9);
+    append(PORT_code, 24);
+    append(HOST_code, 14);
+}
+
+int main(void)
+{
+    /* nothing to filter: a bare snaplen */
+    build();
+    CHECK(finish(96) == 0);
+    CHECK(filter.len == 1 && chained());
+    tcp(80, 100);
+    CHECK(run() == 96);
+
+    /* -p tcp -h 10.0.0.1 -s 80 -S headers */
+    build();
+    tcp_port_host(80, 0x0A000001);
+    CHECK(finish(SNAPLEN_HEADERS) == 0);
+    CHECK(chained());
+    tcp(80, 100);
+    CHECK(run() == 54);
+    tcp(81, 100);
+    CHECK(run() == 0);
+    udp(80);
+    CHECK(run() == 0);
+    tcp6(80, 100);
+    CHECK(run() == 0);	/* not an IPv4 host */
+    tcp(80, 0);
+    packet.base[27] = 2;	/* source 10.0.0.2 */
+    CHECK(run() == 0);
+    memcpy(packet.base + 30, "\x0a\x00\x00\x01", 4);	/* destination */
+    CHECK(run() == 54);
+
+    /* -p tcp -h 192.168.1.2 -s 80 -S 128 */
+    build();
+    tcp_port_host(80, 0xC0A80102);
+    CHECK(finish(128) == 0);
+    CHECK(chained());
+    tcp(80, 1000);
+    CHECK(run() == 128);
+    build_tcp(&packet, 34, 80, 1234, 0x10);	/* source port */
+    CHECK(run() == 128);
+
+    /* -p tcp -s 80 -S headers over IPv6 */
+    build();
+    PORT_code[7].k = PORT_code[9].k = 80;
+    PORT_code[19].k = PORT_code[21].k = 80;
+    append(TCP_code, 9);
+    append(PORT_code, 24);
+    CHECK(finish(SNAPLEN_HEADERS) == 0);
+    CHECK(chained());
+    tcp6(80, 100);
+    CHECK(run() == 74);
+    tcp6(443, 100);
+    CHECK(run() == 0);
+    udp(80);
+    CHECK(run() == 0);
+
+    /* -i any -p tcp -s 80 --sample 0.5: the first and last stages */
+    build();
+    SAMPLE_code[1].k = 0x80000000;
+    append(HATYPE_code, 5);
+    append(TCP_code, 9);
+    append(PORT_code, 24);
+    append(SAMPLE_code, 4);
+    CHECK(finish(SNAPLEN_MAX) == 0);
+    CHECK(chained());
+    tcp(80, 100);
+    rnd = 0x7FFFFFFF;
+    CHECK(run() == SNAPLEN_MAX);
+    rnd = 0x80000000;
+    CHECK(run() == 0);
+    rnd = 0;
+    hatype = 0xFFFE;		/* ARPHRD_NONE, a tun device */
+    CHECK(run() == 0);
+    hatype = 772;		/* ARPHRD_LOOPBACK */
+    CHECK(run() == SNAPLEN_MAX);
+    hatype = 1;
+
+    /* --vlan 42 -p udp: the tag stripped by the kernel only */
+    build();
+    VLAN_code[9].k = 42;
+    append(VLAN_code, 12);
+    append(UDP_code, 9);
+    CHECK(finish(64) == 0);
+    CHECK(chained());
+    udp(53);
+    CHECK(run() == 0);
+    vlan_present = 1, vlan_tci = 0x2000 | 42;
+    CHECK(run() == 64);
+    vlan_tci = 43;
+    CHECK(run() == 0);
+    vlan_present = 0;
+    tag(42);
+    CHECK(run() == 0);
+
+    /* --vlan 42 alone: the tag in the frame as well */
+    build();
+    append(VLAN_code, 12);
+    CHECK(finish(64) == 0);
+    CHECK(chained());
+    CHECK(run() == 64);
+    udp(53);
+    tag(43);
+    CHECK(run() == 0);
+
+    /* too long: the filter is left as it was */
+    build();
+    while (filter.len + 24 <= FILTER_MAX_LEN)
+	CHECK(append(PORT_code, 24) == 0);
+    CHECK(filter_append(&filter, PORT_code, 24) == -1);
+    CHECK(filter.len == FILTER_MAX_LEN / 24 * 24);
+
+    return failures ? 1 : 0;
+}
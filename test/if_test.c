@@ -1,6 +1,55 @@
-#include "pangolin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int main(void) 
+#include <linux/if.h>
+
+#include "check.h"
+
+/* the loopback is in every network namespace */
+static void test_links(void)
+{
+    struct if_link *links;
+    struct if_addr *addrs;
+    int fd, n, m, i, lo = 0;
+    U8 localhost[4] = { 127, 0, 0, 1 };
+
+    fd = rtnl_open(0);
+    CHECK(fd >= 0);
+
+    if (fd < 0)
+	return;
+
+    n = if_links(fd, &links);
+    CHECK(n > 0);
+
+    for (i = 0; i < n; i++)
+	if (strcmp(links[i].name, "lo") == 0) {
+	    lo = links[i].index;
+	    CHECK(links[i].flags & IFF_LOOPBACK);
+	    CHECK(links[i].mtu > 0);
+	}
+
+    CHECK(lo > 0);
+
+    m = if_addrs(fd, &addrs);
+    CHECK(m >= 0);
+
+    for (i = 0; i < m; i++)
+	if (addrs[i].family == AF_INET &&
+	    memcmp(addrs[i].addr, localhost, 4) == 0) {
+	    CHECK(addrs[i].index == lo);
+	    CHECK(addrs[i].prefix == 8);
+	}
+
+    free(links);
+    free(addrs);
+    close(fd);
+}
+
+int main(void)
 {
-    return 0;
+    test_links();
+    return failures ? 1 : 0;
 }
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+static struct packet packet;
+static struct leases leases;
+
+static const U8 mac_a[6] = { 0x02, 0, 0, 0, 0, 0x0a };
+static const U8 mac_b[6] = { 0x02, 0, 0, 0, 0, 0x0b };
+
+/* a DHCP message from or to mac about ip, at time t */
+static void dhcp(U8 type, const U8 *mac, const char *ip, U32 lease, long t)
+{
+    U16 off = build_ip(&packet, 17, 8 + 300);
+    U8 *h = packet.base + off + 8;
+
+    build_udp(&packet, off, 67, 68);
+    h[0] = type == 7 ? 1 : 2;
+    inet_pton(AF_INET, ip, h + (type == 7 ? 12 : 16));
+    memcpy(h + 28, mac, 6);
+    memcpy(h + 236, "\x63\x82\x53\x63\x35\x01", 6);
+    h[242] = type;
+    h[243] = 51, h[244] = 4;
+    h[245] = lease >> 24, h[246] = lease >> 16;
+    h[247] = lease >> 8, h[248] = lease;
+    h[249] = 255;
+    packet.time.tv_sec = t;
+    dissect(&packet, DEPTH_L7);
+    lease_update(&leases, &packet);
+}
+
+static const U8 *who(const char *ip, long t)
+{
+    U32 a;
+
+    inet_pton(AF_INET, ip, &a);
+    return lease_lookup(&leases, a, t);
+}
+
+int main(void)
+{
+    const U8 *m;
+
+    dhcp(5, mac_a, "10.0.0.7", 100, 1000);
+    CHECK(who("10.0.0.7", 999) == NULL);
+    CHECK((m = who("10.0.0.7", 1000)) && memcmp(m, mac_a, 6) == 0);
+    CHECK(who("10.0.0.7", 1100) == NULL);	/* expired */
+    CHECK(who("10.0.0.8", 1000) == NULL);
+
+    /* renewal, then release */
+    dhcp(5, mac_a, "10.0.0.7", 100, 1050);
+    CHECK(who("10.0.0.7", 1120) != NULL);
+    dhcp(7, mac_a, "10.0.0.7", 0, 1130);
+    CHECK(who("10.0.0.7", 1129) != NULL);
+    CHECK(who("10.0.0.7", 1130) == NULL);
+
+    /* the address goes to b, a moves to another one */
+    dhcp(5, mac_b, "10.0.0.7", 3600, 2000);
+    dhcp(5, mac_a, "10.0.0.9", 3600, 2100);
+    dhcp(5, mac_b, "10.0.0.9", 3600, 2200);
+    CHECK((m = who("10.0.0.7", 1000)) && memcmp(m, mac_a, 6) == 0);
+    CHECK((m = who("10.0.0.7", 2150)) && memcmp(m, mac_b, 6) == 0);
+    CHECK((m = who("10.0.0.9", 2150)) && memcmp(m, mac_a, 6) == 0);
+    CHECK((m = who("10.0.0.9", 2300)) && memcmp(m, mac_b, 6) == 0);
+
+    /* b left 10.0.0.7 for 10.0.0.9 */
+    CHECK(who("10.0.0.7", 2300) == NULL);
+
+    /* offers bind nothing */
+    dhcp(2, mac_a, "10.0.0.20", 3600, 3000);
+    CHECK(who("10.0.0.20", 3000) == NULL);
+
+    return failures ? 1 : 0;
+}
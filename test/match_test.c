@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "check.h"
+
+static struct matcher m;
+
+static void build(const char **patterns, int icase)
+{
+    memset(&m, 0, sizeof(m));
+
+    while (*patterns)
+	if (matcher_add(&m, *patterns++))
+	    failures++;
+
+    if (matcher_build(&m, icase))
+	failures++;
+}
+
+static U32 scan(const char *s)
+{
+    return matcher_scan(&m, (const U8 *)s, strlen(s));
+}
+
+static void test_literals(void)
+{
+    const char *p[] = { "he", "she", "his", "hers", NULL };
+
+    build(p, 0);
+    CHECK(scan("ushers") == 2);	/* "she" ends first */
+    CHECK(scan("ahis") == 3);
+    CHECK(scan("hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhe") == 1);
+    CHECK(scan("HERS") == 0);
+    CHECK(scan("") == 0);
+    CHECK(m.nfirst == 2);
+
+    build(p, 1);
+    CHECK(scan("uSHErs") == 2);
+    CHECK(scan("xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxHiS") == 3);
+    CHECK(m.nfirst == 4);
+}
+
+static void test_hex(void)
+{
+    const char *p[] = { "0x474554", "0xdeadbeef", "0x1", NULL };
+    U8 buf[64];
+
+    build(p, 0);
+    CHECK(m.npatterns == 3 && m.patterns[2].len == 3);
+    CHECK(scan("xxGETyy") == 1);
+    CHECK(scan("0x1") == 3);
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf + 31, "\xde\xad\xbe\xef", 4);
+    CHECK(matcher_scan(&m, buf, sizeof(buf)) == 2);
+    CHECK(matcher_scan(&m, buf, 34) == 0);
+}
+
+/* against a naive search, with too many first bytes for the skip */
+static void test_random(void)
+{
+    static char text[4096];
+    char pat[40][5];
+    const char *p[41];
+    int i, j, n;
+
+    srand(2);
+
+    for (i = 0; i < 40; i++) {
+	n = 2 + rand() % 3;
+
+	for (j = 0; j < n; j++)
+	    pat[i][j] = 'a' + rand() % 12;
+
+	pat[i][n] = '\0';
+	p[i] = pat[i];
+    }
+
+    p[40] = NULL;
+    build(p, 0);
+    CHECK(m.nfirst == 0);
+
+    for (n = 0; n < 200; n++) {
+	U32 found, len = rand() % 64;
+	int any = 0;
+
+	for (j = 0; j < (int)len; j++)
+	    text[j] = 'a' + rand() % 26;
+
+	text[len] = '\0';
+
+	for (i = 0; i < 40; i++)
+	    any |= strstr(text, pat[i]) != NULL;
+
+	found = scan(text);
+	CHECK(!found == !any);
+	CHECK(!found || strstr(text, pat[found - 1]));
+    }
+}
+
+int main(void)
+{
+    test_literals();
+    test_hex();
+    test_random();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+
+static struct packet packet;
+static struct neigh_table t;
+
+static const U8 mac_a[6] = { 0x02, 0, 0, 0, 0, 0x0a };
+static const U8 mac_b[6] = { 0x02, 0, 0, 0, 0, 0x0b };
+
+/* an ARP reply from mac claiming spa, at time now */
+static int arp(const U8 *mac, const char *spa, const char *tpa, long now)
+{
+    U8 *p = packet.base;
+
+    memset(&packet, 0, sizeof(packet));
+    memset(p, 0xFF, 6);
+    memcpy(p + 6, mac, 6);
+    p[12] = 0x08, p[13] = 0x06;
+    p[15] = 1;			/* ethernet */
+    p[16] = 0x08;		/* IPv4 */
+    p[18] = 6, p[19] = 4;
+    p[21] = 2;			/* reply */
+    memcpy(p + 22, mac, 6);
+    inet_pton(AF_INET, spa, p + 28);
+    inet_pton(AF_INET, tpa, p + 38);
+    packet.caplen = packet.len = 60;
+    packet.time.tv_sec = now;
+    dissect(&packet, DEPTH_L7);
+    return neigh_update(&t, &packet);
+}
+
+/* a UDP datagram from mac and saddr, at time now */
+static int ip4(const U8 *mac, U32 saddr, long now)
+{
+    build_udp(&packet, build_ip(&packet, 17, 8), 53, 53);
+    memcpy(packet.base + 6, mac, 6);
+    memcpy(packet.base + 26, &saddr, 4);
+    packet.time.tv_sec = now;
+    dissect(&packet, DEPTH_L7);
+    return neigh_update(&t, &packet);
+}
+
+int main(void)
+{
+    U32 ip;
+    int i, ev = 0;
+
+    inet_pton(AF_INET, "10.0.0.1", &ip);
+
+    CHECK(arp(mac_a, "10.0.0.1", "10.0.0.2", 100) == 0);
+    CHECK(t.bindings == 1);
+    CHECK(neigh_ip(&t, mac_a, 100) == ip);
+    CHECK(neigh_ip(&t, mac_b, 100) == 0);
+
+    /* another MAC for a fresh binding, then back */
+    CHECK(arp(mac_b, "10.0.0.1", "10.0.0.2", 110) == NEIGH_CONFLICT);
+    CHECK(arp(mac_a, "10.0.0.1", "10.0.0.2", 120) == NEIGH_FLAP);
+    CHECK(t.conflicts == 1 && t.flaps == 1);
+
+    /* stale bindings move silently */
+    CHECK(arp(mac_b, "10.0.0.1", "10.0.0.2", 120 + 300) == 0);
+    CHECK(neigh_ip(&t, mac_a, 120 + 300) == 0);
+
+    /* gratuitous storm, raised once per second */
+    for (i = 0; i < 50; i++)
+	ev |= arp(mac_b, "10.0.0.1", "10.0.0.1", 500);
+
+    CHECK(ev == NEIGH_STORM && t.storms == 1);
+
+    /* the sender is not the ethernet source */
+    arp(mac_b, "10.0.0.3", "10.0.0.1", 600);
+    memcpy(packet.base + 6, mac_a, 6);
+    CHECK(neigh_update(&t, &packet) == NEIGH_SPOOF);
+
+    /* IPv4 from the bound MAC keeps the binding fresh, learns nothing */
+    inet_pton(AF_INET, "10.0.0.3", &ip);
+    CHECK(ip4(mac_b, ip, 700) == 0);
+    CHECK(neigh_ip(&t, mac_b, 700 + 299) == ip);
+    CHECK(arp(mac_a, "10.0.0.3", "10.0.0.2", 700 + 299) == NEIGH_CONFLICT);
+
+    /* not from the bound MAC any more */
+    CHECK(ip4(mac_b, ip, 1000) == 0);
+    CHECK(neigh_ip(&t, mac_b, 1000) == 0);
+    CHECK(t.bindings == 2);
+
+    /* a probe claims nothing */
+    CHECK(arp(mac_a, "0.0.0.0", "10.0.0.3", 600) == 0);
+
+    return failures ? 1 : 0;
+}
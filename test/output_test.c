@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+
+static struct packet packet;
+static struct output output;
+static U8 buf[4096];
+
+/* --sample-prob 0.3, as the kernel threshold */
+#define SAMPLE ((U32) (0.3 * SAMPLE_SCALE))
+
+/* a TCP SYN from 10.0.0.1:12345 to 192.168.1.2:80 */
+static void build(void)
+{
+    build_tcp(&packet, build_ip(&packet, 6, 20), 12345, 80, 0x02);
+    packet.caplen = 54;
+    packet.len = 60;
+    packet.time.tv_sec = 1;
+    packet.time.tv_nsec = 5;
+    dissect(&packet, DEPTH_L7);
+}
+
+/* encodes one packet, returns the bytes written */
+static ssize_t encode(int format, U32 sample)
+{
+    int pfd[2];
+    ssize_t n;
+
+    if (pipe(pfd) < 0)
+	return -1;
+
+    output_open(&output, format, pfd[1], 96, sample);
+    output_packet(&output, &packet);
+    output_close(&output);
+    close(pfd[1]);
+
+    memset(buf, 0, sizeof(buf));
+    n = read(pfd[0], buf, sizeof(buf) - 1);
+    close(pfd[0]);
+    return n;
+}
+
+static U32 le(const U8 *p, int bytes)
+{
+    U32 v = 0;
+
+    while (bytes--)
+	v = v << 8 | p[bytes];
+
+    return v;
+}
+
+static void test_binary(void)
+{
+    const U8 *r = buf + 16;
+
+    build();
+    CHECK(encode(OUT_BINARY, SAMPLE) == 16 + OUT_RECORD_LEN);
+    CHECK(memcmp(buf, "PNGL", 4) == 0);
+    CHECK(le(buf + 4, 2) == OUT_VERSION);
+    CHECK(le(buf + 6, 2) == OUT_RECORD_LEN);
+    CHECK(le(buf + 8, 4) == 96);
+    CHECK(le(buf + 12, 4) == SAMPLE);
+
+    CHECK(le(r, 4) == 1000000005);
+    CHECK(le(r + 8, 4) == 54);
+    CHECK(le(r + 12, 4) == 60);
+    CHECK(le(r + 16, 2) == 0x0800);
+    CHECK(r[18] == 6);
+    CHECK(r[19] == 0x02);
+    CHECK(r[21] == PROTO_TCP);
+    CHECK(r[23] == 64);
+    CHECK(r[34] == 0xFF && r[35] == 0xFF);
+    CHECK(memcmp(r + 36, "\x0a\x00\x00\x01", 4) == 0);
+    CHECK(memcmp(r + 52, "\xc0\xa8\x01\x02", 4) == 0);
+    CHECK(le(r + 56, 2) == 12345);
+    CHECK(le(r + 58, 2) == 80);
+}
+
+static void test_text(void)
+{
+    build();
+    CHECK(encode(OUT_JSON, SAMPLE) > 0);
+    CHECK(strcmp((char *)buf, "{\"snaplen\":96,\"sample\":0.3}\n"
+		 "{\"ts\":1.000000005,\"caplen\":54,\"len\":60,"
+		 "\"ethertype\":2048,\"src\":\"10.0.0.1\",\"dst\":\"192.168.1.2\","
+		 "\"ip_proto\":6,\"proto\":\"tcp\",\"sport\":12345,\"dport\":80,"
+		 "\"flags\":\"S\"}\n") == 0);
+
+    CHECK(encode(OUT_CSV, SAMPLE) > 0);
+    CHECK(strcmp((char *)buf,
+		 "ts,caplen,len,ethertype,proto,src,dst,sport,dport,flags,sample\n"
+		 "1.000000005,54,60,2048,tcp,10.0.0.1,192.168.1.2,12345,80,S,"
+		 "0.3\n")
+	  == 0);
+
+    /* every packet captured */
+    CHECK(encode(OUT_CSV, 0) > 0);
+    CHECK(strstr((char *)buf, ",S,1\n") != NULL);
+}
+
+int main(void)
+{
+    test_binary();
+    test_text();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "check.h"
+
+static U8 buf[256];
+static size_t len;
+
+static void put32(U32 v, int big)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+	buf[len++] = big ? v >> (24 - 8 * i) : v >> (8 * i);
+}
+
+/* a file header, then two records of 3 and 5 bytes */
+static void build(U32 magic, int big)
+{
+    int i;
+
+    len = 0;
+    put32(magic, big);
+    put32(0x00040002, big);	/* version 2.4, as two u16 */
+    put32(0, big);
+    put32(0, big);
+    put32(65535, big);
+    put32(1, big);
+
+    put32(10, big);
+    put32(500, big);
+    put32(3, big);
+    put32(60, big);
+    for (i = 0; i < 3; i++)
+	buf[len++] = 0xA0 + i;
+
+    put32(11, big);
+    put32(0, big);
+    put32(5, big);
+    put32(5, big);
+    for (i = 0; i < 5; i++)
+	buf[len++] = 0xB0 + i;
+}
+
+static int open_buf(struct pcap *p)
+{
+    char path[] = "/tmp/pcap_testXXXXXX";
+    int fd = mkstemp(path), sts;
+
+    if (fd < 0 || write(fd, buf, len) != (ssize_t)len) {
+	perror(path);
+	exit(1);
+    }
+
+    close(fd);
+    sts = pcap_open(p, path);
+    unlink(path);
+    return sts;
+}
+
+static void test_read(U32 magic, int big, U64 frac)
+{
+    struct pcap p;
+    struct pcap_rec rec;
+
+    build(magic, big);
+    CHECK(open_buf(&p) == 0);
+    CHECK(p.linktype == 1);
+    CHECK(p.snaplen == 65535);
+
+    CHECK(pcap_next(&p, &rec) == 1);
+    CHECK(rec.time == 10 * 1000000000ULL + 500 * frac);
+    CHECK(rec.caplen == 3 && rec.len == 60);
+    CHECK(rec.data[0] == 0xA0 && rec.data[2] == 0xA2);
+
+    CHECK(pcap_next(&p, &rec) == 1);
+    CHECK(rec.time == 11 * 1000000000ULL);
+    CHECK(rec.caplen == 5 && rec.data[4] == 0xB4);
+    CHECK(pcap_next(&p, &rec) == 0);
+
+    pcap_rewind(&p);
+    CHECK(pcap_next(&p, &rec) == 1);
+    CHECK(rec.caplen == 3);
+    pcap_close(&p);
+}
+
+static void test_errors(void)
+{
+    struct pcap p;
+    struct pcap_rec rec;
+
+    build(0xA1B2C3D4, 0);
+    buf[0] = 0;
+    CHECK(open_buf(&p) == -1);
+
+    /* the last record is missing a byte */
+    build(0xA1B2C3D4, 0);
+    len--;
+    CHECK(open_buf(&p) == 0);
+    CHECK(pcap_next(&p, &rec) == 1);
+    CHECK(pcap_next(&p, &rec) == -1);
+    pcap_close(&p);
+
+    CHECK(pcap_open(&p, "/nonexistent") == -1);
+}
+
+int main(void)
+{
+    /* little and big endian writers, micro and nanoseconds */
+    test_read(0xA1B2C3D4, 0, 1000);
+    test_read(0xA1B2C3D4, 1, 1000);
+    test_read(0xA1B23C4D, 0, 1);
+    test_read(0xA1B23C4D, 1, 1);
+    test_errors();
+    return failures ? 1 : 0;
+}